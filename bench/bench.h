@@ -0,0 +1,252 @@
+#pragma once
+
+// Minimal benchmark runner with the Google Benchmark interface the module's
+// benchmarks need, so they build anywhere without extra packages:
+//
+//   static void BM_Thing(bench::State &state) {
+//       for (auto _ : state)
+//           bench::do_not_optimize(thing());
+//   }
+//   BENCHMARK(BM_Thing);
+//
+// Each benchmark is rerun with more iterations until it takes at least
+// --benchmark_min_time seconds.  --benchmark_filter=substring picks benchmarks
+// and --benchmark_out=file.json writes results in Google Benchmark's JSON
+// format, so the usual compare.py tooling works on them.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <chrono>
+#include <ctime>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace bench {
+
+template <typename T>
+inline void do_not_optimize(const T &value) {
+#if defined(__GNUC__) || defined(__clang__)
+    asm volatile("" : : "r,m"(value) : "memory");
+#else
+    static const void *volatile sink;
+    sink = &value;
+#endif
+}
+
+#if defined(__GNUC__) || defined(__clang__)
+#define BENCH_UNUSED __attribute__((unused))
+#else
+#define BENCH_UNUSED
+#endif
+
+class State {
+    public:
+        // what `for (auto _ : state)` binds; never read, so it mustn't warn
+        struct BENCH_UNUSED Value {};
+
+        struct iterator {
+            State *state;
+            uint64_t left;
+
+            bool operator!=(const iterator &) {
+                if (left)
+                    return true;
+                state->finish();
+                return false;
+            }
+            void operator++() {
+                --left;
+            }
+            Value operator*() const {
+                return Value();
+            }
+        };
+
+        explicit State(uint64_t iterations) : iterations_(iterations) {}
+
+        iterator begin() {
+            cpuStart = std::clock();
+            realStart = std::chrono::steady_clock::now();
+            return iterator{this, iterations_};
+        }
+
+        iterator end() {
+            return iterator{this, 0};
+        }
+
+        uint64_t iterations() const {
+            return iterations_;
+        }
+
+        void setItemsProcessed(uint64_t items) {
+            itemsProcessed = items;
+        }
+
+        void setBytesProcessed(uint64_t bytes) {
+            bytesProcessed = bytes;
+        }
+
+        void skipWithError(const char *msg) {
+            error = msg;
+        }
+
+        double realSeconds = 0, cpuSeconds = 0;
+        uint64_t itemsProcessed = 0, bytesProcessed = 0;
+        std::string error;
+
+    private:
+        uint64_t iterations_;
+        std::clock_t cpuStart = 0;
+        std::chrono::steady_clock::time_point realStart;
+
+        void finish() {
+            realSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - realStart).count();
+            cpuSeconds = double(std::clock() - cpuStart) / CLOCKS_PER_SEC;
+        }
+};
+
+typedef void (*Function)(State &);
+
+struct Benchmark {
+    const char *name;
+    Function fn;
+};
+
+inline std::vector<Benchmark> &registry() {
+    static std::vector<Benchmark> benchmarks;
+    return benchmarks;
+}
+
+inline int add(const char *name, Function fn) {
+    registry().push_back(Benchmark{name, fn});
+    return 0;
+}
+
+#define BENCHMARK(fn) static int bench_registered_##fn = bench::add(#fn, fn)
+
+inline std::string json_escape(const std::string &s) {
+    std::string out;
+    for (char c : s) {
+        if (c == '"' || c == '\\')
+            out += '\\';
+        out += c;
+    }
+    return out;
+}
+
+inline int run(int argc, char **argv) {
+    std::string filter, out;
+    double minTime = 0.5;
+    for (int i = 1; i < argc; ++i) {
+        const char *arg = argv[i];
+        if (!strncmp(arg, "--benchmark_filter=", 19)) {
+            filter = arg + 19;
+        } else if (!strncmp(arg, "--benchmark_out=", 16)) {
+            out = arg + 16;
+        } else if (!strncmp(arg, "--benchmark_min_time=", 21)) {
+            minTime = atof(arg + 21);
+        } else if (!strcmp(arg, "--benchmark_list_tests")) {
+            for (auto &b : registry())
+                printf("%s\n", b.name);
+            return 0;
+        } else if (!strncmp(arg, "--benchmark_format=", 19) || !strncmp(arg, "--benchmark_out_format=", 23)) {
+            // only console and json exist here
+        } else {
+            fprintf(stderr, "unknown argument %s\n", arg);
+            return 1;
+        }
+    }
+
+    std::string json;
+    printf("%-40s %14s %14s %12s\n", "Benchmark", "Time", "CPU", "Iterations");
+    int failed = 0;
+    for (auto &b : registry()) {
+        if (!filter.empty() && !strstr(b.name, filter.c_str()))
+            continue;
+
+        // grow the iteration count until one run is long enough to time
+        uint64_t iterations = 1;
+        State state(iterations);
+        for (;;) {
+            state = State(iterations);
+            b.fn(state);
+            if (!state.error.empty() || state.realSeconds >= minTime || iterations >= 1000000000)
+                break;
+            double grow = state.realSeconds > 0 ? minTime * 1.4 / state.realSeconds : 10;
+            if (grow > 10)
+                grow = 10;
+            uint64_t next = (uint64_t) (iterations * grow);
+            iterations = next > iterations ? next : iterations + 1;
+        }
+
+        if (!state.error.empty()) {
+            printf("%-40s ERROR: %s\n", b.name, state.error.c_str());
+            ++failed;
+        } else {
+            double realNs = state.realSeconds * 1e9 / iterations;
+            double cpuNs = state.cpuSeconds * 1e9 / iterations;
+            printf("%-40s %11.1f ns %11.1f ns %12llu", b.name, realNs, cpuNs, (unsigned long long) iterations);
+            if (state.itemsProcessed)
+                printf(" items/s=%.3gM", state.itemsProcessed / state.realSeconds / 1e6);
+            printf("\n");
+
+            char buf[512];
+            snprintf(buf, sizeof(buf),
+                    "%s    {\n"
+                    "      \"name\": \"%s\",\n"
+                    "      \"run_name\": \"%s\",\n"
+                    "      \"run_type\": \"iteration\",\n"
+                    "      \"iterations\": %llu,\n"
+                    "      \"real_time\": %.6e,\n"
+                    "      \"cpu_time\": %.6e,\n"
+                    "      \"time_unit\": \"ns\"",
+                    json.empty() ? "" : ",\n",
+                    json_escape(b.name).c_str(), json_escape(b.name).c_str(),
+                    (unsigned long long) iterations, realNs, cpuNs);
+            json += buf;
+            if (state.itemsProcessed) {
+                snprintf(buf, sizeof(buf), ",\n      \"items_per_second\": %.6e", state.itemsProcessed / state.realSeconds);
+                json += buf;
+            }
+            if (state.bytesProcessed) {
+                snprintf(buf, sizeof(buf), ",\n      \"bytes_per_second\": %.6e", state.bytesProcessed / state.realSeconds);
+                json += buf;
+            }
+            json += "\n    }";
+        }
+        fflush(stdout);
+    }
+
+    if (!out.empty()) {
+        FILE *f = fopen(out.c_str(), "w");
+        if (!f) {
+            fprintf(stderr, "cannot write %s\n", out.c_str());
+            return 1;
+        }
+        char date[64];
+        time_t now = time(NULL);
+        strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", localtime(&now));
+        fprintf(f, "{\n  \"context\": {\n"
+                "    \"date\": \"%s\",\n"
+                "    \"executable\": \"%s\",\n"
+                "    \"num_cpus\": %u,\n"
+#ifdef NDEBUG
+                "    \"library_build_type\": \"release\"\n"
+#else
+                "    \"library_build_type\": \"debug\"\n"
+#endif
+                "  },\n  \"benchmarks\": [\n%s\n  ]\n}\n",
+                date, json_escape(argv[0]).c_str(), std::thread::hardware_concurrency(), json.c_str());
+        fclose(f);
+    }
+    return failed ? 1 : 0;
+}
+
+}
+
+#define BENCHMARK_MAIN() int main(int argc, char **argv) { return bench::run(argc, argv); }
@@ -0,0 +1,75 @@
+// Churn benchmark for DeviceTable expiry: millions of simulated addresses,
+// most seen only a few times, against a ttl and a row cap.
+//
+//   g++ -O2 -std=c++11 -I.. bench_devtable.cpp -o bench_devtable
+//   ./bench_devtable [sightings] [address pool] [ttl seconds] [cap] [rssi filter]
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <chrono>
+#include <random>
+#include <vector>
+
+#include "devtable.h"
+
+int main(int argc, char **argv) {
+    uint64_t sightings = argc > 1 ? strtoull(argv[1], NULL, 10) : 10000000;
+    uint64_t pool = argc > 2 ? strtoull(argv[2], NULL, 10) : 4000000;
+    double ttl = argc > 3 ? atof(argv[3]) : 30;
+    size_t cap = argc > 4 ? (size_t) strtoull(argv[4], NULL, 10) : 100000;
+    RssiFilter filter;
+    if (!parse_rssi_filter(argc > 5 ? argv[5] : "kalman", 0, filter)) {
+        fprintf(stderr, "unknown rssi filter\n");
+        return 1;
+    }
+
+    // simulated radio: 20k advertisements per simulated second, skewed so a
+    // small set of devices is seen constantly and the rest churn through
+    const uint64_t stepNs = 50000;
+    std::mt19937_64 rng(42);
+    DeviceTable table(0);
+    table.setExpiry((uint64_t) (ttl * 1e9), cap, 0);
+    table.setFilter(filter);
+
+    // sightings arrive in radio-sized batches
+    const size_t batch = 64;
+    uint64_t addresses[batch];
+    int16_t rssis[batch];
+
+    std::vector<uint64_t> lost;
+    uint64_t now = 0, expired = 0;
+    size_t peak = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    for (uint64_t i = 0; i < sightings; i += batch) {
+        for (size_t j = 0; j < batch; ++j) {
+            uint64_t r = rng();
+            uint64_t address = (r & 7) ? (r >> 8) % pool : (r >> 8) % 1000;
+            addresses[j] = 0xC0FFEE000000ull | address;
+            rssis[j] = (int16_t) -(int) (40 + (r >> 3) % 50);
+        }
+        table.upsertBatch(addresses, rssis, batch, now);
+        now += stepNs * batch;
+        // sweep every ~5 simulated seconds, like the watcher timer does
+        if (i % (batch * 1600) == 0) {
+            lost.clear();
+            expired += table.expire(now, lost);
+            if (table.size() > peak)
+                peak = table.size();
+        }
+    }
+    lost.clear();
+    expired += table.expire(now, lost);
+    double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    printf("sightings      %llu\n", (unsigned long long) sightings);
+    printf("address pool   %llu\n", (unsigned long long) pool);
+    printf("ttl            %.1fs, cap %zu, %s filter\n", ttl, cap, argc > 5 ? argv[5] : "kalman");
+    printf("simulated time %.1fs\n", now / 1e9);
+    printf("lost           %llu\n", (unsigned long long) expired);
+    printf("peak rows      %zu\n", peak);
+    printf("final rows     %zu\n", table.size());
+    printf("elapsed        %.3fs, %.1f M sightings/s\n", secs, sightings / secs / 1e6);
+    return 0;
+}
@@ -0,0 +1,822 @@
+// Benchmarks for the module's portable hot paths: string conversion, address
+// and GUID text, provide()'s characteristic parsing, and the pybind11 dispatch
+// cost of every exported function.  Dispatch is measured against stubs with the
+// same signatures and bindings as pywinble.cpp and empty bodies, so it is the
+// binding overhead alone; the radio calls behind them need Windows.
+//
+//   cmake -S bench -B build-bench && cmake --build build-bench
+//   build-bench/pywinble_bench --benchmark_out=bench.json
+
+#include "pybind11/embed.h"
+#include "pybind11/functional.h"
+#include "pybind11/stl.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <new>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "bench.h"
+#include "callback.h"
+#include "characteristics.h"
+#include "devtable.h"
+#include "util.h"
+
+namespace py = pybind11;
+
+// ################ ALLOCATIONS
+
+// every C++ heap allocation in the process, so a benchmark can assert that
+// a path doesn't allocate at all.  All the replaced forms go through these
+// two, out of line: with the malloc behind operator new inlined into a
+// caller, GCC pairs it with the free and warns of a mismatch.
+static std::atomic<uint64_t> allocations{0};
+
+#if defined(_MSC_VER)
+#define BENCH_NOINLINE __declspec(noinline)
+#else
+#define BENCH_NOINLINE __attribute__((noinline))
+#endif
+
+static BENCH_NOINLINE void *counted_alloc(size_t size, size_t align) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (!size)
+        size = 1;
+    if (align <= alignof(std::max_align_t))
+        return malloc(size);
+#ifdef _WIN32
+    return _aligned_malloc(size, align);
+#else
+    void *ptr;
+    return posix_memalign(&ptr, align, size) ? nullptr : ptr;
+#endif
+}
+
+static BENCH_NOINLINE void counted_free(void *ptr, size_t align) noexcept {
+#ifdef _WIN32
+    if (align > alignof(std::max_align_t))
+        return _aligned_free(ptr);
+#endif
+    (void) align;
+    free(ptr);
+}
+
+static void *counted_new(size_t size, size_t align) {
+    if (void *ptr = counted_alloc(size, align))
+        return ptr;
+    throw std::bad_alloc();
+}
+
+void *operator new(size_t size) {
+    return counted_new(size, 0);
+}
+
+void *operator new[](size_t size) {
+    return counted_new(size, 0);
+}
+
+void *operator new(size_t size, const std::nothrow_t &) noexcept {
+    return counted_alloc(size, 0);
+}
+
+void *operator new[](size_t size, const std::nothrow_t &) noexcept {
+    return counted_alloc(size, 0);
+}
+
+void operator delete(void *ptr) noexcept {
+    counted_free(ptr, 0);
+}
+
+void operator delete[](void *ptr) noexcept {
+    counted_free(ptr, 0);
+}
+
+void operator delete(void *ptr, size_t) noexcept {
+    counted_free(ptr, 0);
+}
+
+void operator delete[](void *ptr, size_t) noexcept {
+    counted_free(ptr, 0);
+}
+
+#ifdef __cpp_aligned_new
+void *operator new(size_t size, std::align_val_t align) {
+    return counted_new(size, (size_t) align);
+}
+
+void *operator new[](size_t size, std::align_val_t align) {
+    return counted_new(size, (size_t) align);
+}
+
+void operator delete(void *ptr, std::align_val_t align) noexcept {
+    counted_free(ptr, (size_t) align);
+}
+
+void operator delete[](void *ptr, std::align_val_t align) noexcept {
+    counted_free(ptr, (size_t) align);
+}
+
+void operator delete(void *ptr, size_t, std::align_val_t align) noexcept {
+    counted_free(ptr, (size_t) align);
+}
+
+void operator delete[](void *ptr, size_t, std::align_val_t align) noexcept {
+    counted_free(ptr, (size_t) align);
+}
+#endif
+
+// ################ STRINGS
+
+static const std::wstring deviceId = L"BluetoothLE#BluetoothLE00:1a:7d:da:71:13-c0:ff:ee:12:34:56";
+static const std::wstring deviceName = L"Zimmer-Thermometer üß ☃";
+
+static void BM_WideToUtf8(bench::State &state) {
+    for (auto _ : state)
+        bench::do_not_optimize(wide_to_utf8(deviceId));
+    state.setBytesProcessed(state.iterations() * deviceId.size() * sizeof(wchar_t));
+}
+BENCHMARK(BM_WideToUtf8);
+
+static void BM_WideToUtf8_NonAscii(bench::State &state) {
+    for (auto _ : state)
+        bench::do_not_optimize(wide_to_utf8(deviceName));
+}
+BENCHMARK(BM_WideToUtf8_NonAscii);
+
+static void BM_Utf8ToWide(bench::State &state) {
+    std::string id = wide_to_utf8(deviceId);
+    for (auto _ : state)
+        bench::do_not_optimize(utf8_to_wide(id));
+    state.setBytesProcessed(state.iterations() * id.size());
+}
+BENCHMARK(BM_Utf8ToWide);
+
+// what PyVar(hstring) does for every string property of every event
+static void BM_PyVar_Wide(bench::State &state) {
+    for (auto _ : state) {
+        PyObject *str = PyUnicode_FromWideChar(deviceId.c_str(), deviceId.size());
+        bench::do_not_optimize(str);
+        Py_DECREF(str);
+    }
+}
+BENCHMARK(BM_PyVar_Wide);
+
+static void BM_PyVar_WideNonAscii(bench::State &state) {
+    for (auto _ : state) {
+        PyObject *str = PyUnicode_FromWideChar(deviceName.c_str(), deviceName.size());
+        bench::do_not_optimize(str);
+        Py_DECREF(str);
+    }
+}
+BENCHMARK(BM_PyVar_WideNonAscii);
+
+// ################ ADDRESSES AND GUIDS
+
+static void BM_Hexlify(bench::State &state) {
+    uint64_t address = 0xc0ffee123456ull;
+    for (auto _ : state)
+        bench::do_not_optimize(hexlify(address++));
+}
+BENCHMARK(BM_Hexlify);
+
+static void BM_HexlifyColons(bench::State &state) {
+    uint64_t address = 0xc0ffee123456ull;
+    for (auto _ : state)
+        bench::do_not_optimize(hexlify(address++, true));
+}
+BENCHMARK(BM_HexlifyColons);
+
+static void BM_FormatAddress(bench::State &state) {
+    uint64_t address = 0xc0ffee123456ull;
+    for (auto _ : state)
+        bench::do_not_optimize(format_address(address++));
+}
+BENCHMARK(BM_FormatAddress);
+
+static void BM_ParseAddress(bench::State &state) {
+    uint64_t address = 0;
+    for (auto _ : state) {
+        parse_address("c0:ff:ee:12:34:56", address);
+        bench::do_not_optimize(address);
+    }
+}
+BENCHMARK(BM_ParseAddress);
+
+static void BM_ParseGuid(bench::State &state) {
+    Guid guid;
+    for (auto _ : state) {
+        bench::do_not_optimize(parse_guid("{eab08fe8-e7bd-4982-836e-8ec0839320ed}", guid));
+        bench::do_not_optimize(guid);
+    }
+}
+BENCHMARK(BM_ParseGuid);
+
+static void BM_FormatGuid(bench::State &state) {
+    Guid guid;
+    parse_guid("eab08fe8-e7bd-4982-836e-8ec0839320ed", guid);
+    for (auto _ : state) {
+        bench::do_not_optimize(format_guid(guid));
+        ++guid.Data1;
+    }
+}
+BENCHMARK(BM_FormatGuid);
+
+// ################ PROVIDE
+
+static py::dict characteristics_dict(size_t count = 4) {
+    static const char *uuids[] = {
+        "{2a6e0000-0000-1000-8000-00805f9b34fb}",
+        "{2a6f0000-0000-1000-8000-00805f9b34fb}",
+        "{2a190000-0000-1000-8000-00805f9b34fb}",
+        "{eab08fe8-e7bd-4982-836e-8ec0839320ed}",
+    };
+    py::dict dict;
+    for (size_t i = 0; i < count; ++i) {
+        py::dict props;
+        props["flags"] = 0x12;
+        props["description"] = "Temperature °C";
+        char uuid[40];
+        snprintf(uuid, sizeof(uuid), "%s", uuids[i % 4]);
+        if (i >= 4) {
+            // distinct ids past the fixed four
+            char prefix[5];
+            snprintf(prefix, sizeof(prefix), "%04x", (unsigned) i);
+            memcpy(uuid + 1, prefix, 4);
+        }
+        dict[uuid] = props;
+    }
+    return dict;
+}
+
+// the argument conversion pybind11 does for provide(), then the parse
+static void BM_ParseCharacteristics(bench::State &state) {
+    py::dict dict = characteristics_dict();
+    for (auto _ : state) {
+        auto specs = parse_characteristics(dict.cast<characteristic_map>());
+        bench::do_not_optimize(specs);
+    }
+    state.setItemsProcessed(state.iterations() * dict.size());
+}
+BENCHMARK(BM_ParseCharacteristics);
+
+// a large service, 64 characteristics
+static void BM_ParseCharacteristics64(bench::State &state) {
+    py::dict dict = characteristics_dict(64);
+    for (auto _ : state) {
+        auto specs = parse_characteristics(dict.cast<characteristic_map>());
+        bench::do_not_optimize(specs);
+    }
+    state.setItemsProcessed(state.iterations() * dict.size());
+}
+BENCHMARK(BM_ParseCharacteristics64);
+
+// what the same argument cost when provide() took it as nested std::maps
+static void BM_ParseCharacteristicsCopied(bench::State &state) {
+    py::dict dict = characteristics_dict(64);
+    for (auto _ : state) {
+        auto map = dict.cast<std::map<std::string, std::map<std::string, py::handle>>>();
+        bench::do_not_optimize(map);
+    }
+    state.setItemsProcessed(state.iterations() * dict.size());
+}
+BENCHMARK(BM_ParseCharacteristicsCopied);
+
+// ################ DISPATCH
+
+struct StubProvider {
+    std::string getUUID() { return "{EAB08FE8-E7BD-4982-836E-8EC0839320ED}"; }
+    void start() {}
+};
+
+struct StubWatcher {
+    size_t size() { return 0; }
+};
+
+// the same short-lived view, with and without py::instance_pool
+struct StubView { size_t version = 0; };
+struct StubPooledView { size_t version = 0; };
+
+PYBIND11_EMBEDDED_MODULE(pywinble_stub, m) {
+    py::class_<StubProvider>(m, "BLEProvider")
+        .def_property_readonly("uuid", &StubProvider::getUUID)
+        .def("start", &StubProvider::start);
+
+    py::class_<StubWatcher, std::shared_ptr<StubWatcher>>(m, "BLEWatcher")
+        .def("__len__", &StubWatcher::size);
+
+    py::class_<StubView>(m, "View");
+    py::class_<StubPooledView>(m, "PooledView", py::instance_pool());
+
+    m.def("advertise", [](const char *data, py::object) {
+        bench::do_not_optimize(data);
+    }, py::arg("data"), py::arg("on_status") = py::none());
+
+    m.def("provide", [](const std::string &, characteristic_map characteristics) {
+        bench::do_not_optimize(characteristics);
+        return std::unique_ptr<StubProvider>(new StubProvider());
+    });
+
+    m.def("info", []() {
+        py::dict dict;
+        dict["DeviceId"] = "BluetoothAdapter";
+        dict["BluetoothAddress"] = hexlify(0xc0ffee123456ull, true);
+        dict["IsLowEnergySupported"] = true;
+        return dict;
+    });
+
+    m.def("metrics", []() { return py::dict(); });
+
+    m.def("metrics_export", [](const std::string &) {}, py::arg("path"));
+
+    m.def("gil_profile", [](bool, uint32_t) {},
+        py::arg("enable") = true, py::arg("sample_every") = 1);
+
+    m.def("gil_profile_dump", []() { return py::dict(); });
+
+    m.def("watch", [](std::vector<std::string>, py::object, double, size_t, const std::string &, double, double, double) {
+        return std::make_shared<StubWatcher>();
+    }, py::arg("props"), py::arg("callback") = py::none(),
+        py::arg("ttl") = 0.0, py::arg("max_devices") = 0,
+        py::arg("rssi_filter") = "none", py::arg("rssi_param") = 0.0,
+        py::arg("tx_power") = -59.0, py::arg("path_loss_exponent") = 2.0);
+
+    // bare call overhead by argument count
+    m.def("call0", []() {});
+    m.def("call1", [](int a) { bench::do_not_optimize(a); });
+    m.def("call3", [](int, double, const std::string &c) { bench::do_not_optimize(c); });
+
+    // one string argument, by each way a binding can take it
+    m.def("string_arg", [](const std::string &s) { bench::do_not_optimize(s); });
+    m.def("chars_arg", [](const char *s) { bench::do_not_optimize(s); });
+#ifdef PYBIND11_HAS_STRING_VIEW
+    m.def("view_arg", [](std::string_view s) { bench::do_not_optimize(s); });
+#endif
+
+    // five overloads, resolved in order: the provider matches the third in
+    // the first pass, an int only the fifth, after the conversion pass
+    m.def("overloaded", [](const std::string &) { return 1; });
+    m.def("overloaded", [](py::bytes) { return 2; });
+    m.def("overloaded", [](StubProvider &) { return 3; });
+    m.def("overloaded", [](std::vector<int>) { return 4; });
+    m.def("overloaded", [](double) { return 5; });
+}
+
+// calls a stub with prebuilt args, as the interpreter would
+static void dispatch(bench::State &state, const char *name, py::tuple args, py::dict kwargs = py::dict()) {
+    py::object fn = py::module::import("pywinble_stub").attr(name);
+    for (auto _ : state) {
+        PyObject *result = PyObject_Call(fn.ptr(), args.ptr(), kwargs.ptr());
+        if (!result) {
+            py::error_already_set err;
+            state.skipWithError(err.what());
+            return;
+        }
+        Py_DECREF(result);
+    }
+}
+
+// calls a stub the way the interpreter does for f(a, b, c): arguments in an
+// array, no tuple
+static void vectorcall(bench::State &state, const char *name, std::vector<py::object> args) {
+    py::object fn = py::module::import("pywinble_stub").attr(name);
+    std::vector<PyObject *> argv;
+    py::tuple tuple(args.size());
+    for (size_t i = 0; i < args.size(); ++i) {
+        argv.push_back(args[i].ptr());
+        tuple[i] = args[i];
+    }
+    for (auto _ : state) {
+#if PY_VERSION_HEX >= 0x03080000
+        PyObject *result = PyObject_Vectorcall(fn.ptr(), argv.data(), argv.size(), NULL);
+#else
+        PyObject *result = PyObject_Call(fn.ptr(), tuple.ptr(), NULL);
+#endif
+        if (!result) {
+            py::error_already_set err;
+            state.skipWithError(err.what());
+            return;
+        }
+        Py_DECREF(result);
+    }
+}
+
+static void BM_Call_0Args(bench::State &state) {
+    vectorcall(state, "call0", {});
+}
+BENCHMARK(BM_Call_0Args);
+
+static void BM_Call_1Arg(bench::State &state) {
+    vectorcall(state, "call1", {py::int_(7)});
+}
+BENCHMARK(BM_Call_1Arg);
+
+static void BM_Call_3Args(bench::State &state) {
+    vectorcall(state, "call3", {py::int_(7), py::float_(0.5), py::str("c0:ff:ee:12:34:56")});
+}
+BENCHMARK(BM_Call_3Args);
+
+// provide()'s uuid: ASCII, the common case
+static void BM_Call_StringArg(bench::State &state) {
+    vectorcall(state, "string_arg", {py::str("{eab08fe8-e7bd-4982-836e-8ec0839320ed}")});
+}
+BENCHMARK(BM_Call_StringArg);
+
+// advertise()'s local name, with an accent
+static void BM_Call_StringArgNonAscii(bench::State &state) {
+    vectorcall(state, "string_arg", {py::str("capteur t\xc3\xa9l\xc3\xa9m\xc3\xa9trie")});
+}
+BENCHMARK(BM_Call_StringArgNonAscii);
+
+static void BM_Call_CharsArg(bench::State &state) {
+    vectorcall(state, "chars_arg", {py::str("capteur t\xc3\xa9l\xc3\xa9m\xc3\xa9trie")});
+}
+BENCHMARK(BM_Call_CharsArg);
+
+#ifdef PYBIND11_HAS_STRING_VIEW
+static void BM_Call_ViewArg(bench::State &state) {
+    vectorcall(state, "view_arg", {py::str("capteur t\xc3\xa9l\xc3\xa9m\xc3\xa9trie")});
+}
+BENCHMARK(BM_Call_ViewArg);
+#endif
+
+static void BM_Call_Overload3rd(bench::State &state) {
+    py::object provider = py::module::import("pywinble_stub").attr("provide")("{eab08fe8-e7bd-4982-836e-8ec0839320ed}", py::dict());
+    vectorcall(state, "overloaded", {provider});
+}
+BENCHMARK(BM_Call_Overload3rd);
+
+static void BM_Call_Overload5thConverted(bench::State &state) {
+    vectorcall(state, "overloaded", {py::int_(7)});
+}
+BENCHMARK(BM_Call_Overload5thConverted);
+
+// a method without arguments, like BLEProvider.start, must not touch the
+// C++ heap; the run fails if it does
+static void BM_Call_MethodAllocations(bench::State &state) {
+    py::object provider = py::module::import("pywinble_stub").attr("provide")("{eab08fe8-e7bd-4982-836e-8ec0839320ed}", py::dict());
+    py::object start = provider.attr("start");
+    // first calls may size pybind11's own bookkeeping
+    start();
+    uint64_t before = allocations.load();
+    for (auto _ : state) {
+        PyObject *result = PyObject_CallObject(start.ptr(), NULL);
+        Py_XDECREF(result);
+    }
+    uint64_t count = allocations.load() - before;
+    if (count) {
+        std::string msg = std::to_string(count) + " allocations in " + std::to_string(state.iterations()) + " calls";
+        state.skipWithError(msg.c_str());
+    }
+}
+BENCHMARK(BM_Call_MethodAllocations);
+
+static void BM_Dispatch_advertise(bench::State &state) {
+    dispatch(state, "advertise", py::make_tuple("pywinble"));
+}
+BENCHMARK(BM_Dispatch_advertise);
+
+static void BM_Dispatch_provide(bench::State &state) {
+    dispatch(state, "provide", py::make_tuple("{eab08fe8-e7bd-4982-836e-8ec0839320ed}", characteristics_dict()));
+}
+BENCHMARK(BM_Dispatch_provide);
+
+static void BM_Dispatch_info(bench::State &state) {
+    dispatch(state, "info", py::make_tuple());
+}
+BENCHMARK(BM_Dispatch_info);
+
+static void BM_Dispatch_metrics(bench::State &state) {
+    dispatch(state, "metrics", py::make_tuple());
+}
+BENCHMARK(BM_Dispatch_metrics);
+
+static void BM_Dispatch_metrics_export(bench::State &state) {
+    dispatch(state, "metrics_export", py::make_tuple("metrics.prom"));
+}
+BENCHMARK(BM_Dispatch_metrics_export);
+
+static void BM_Dispatch_gil_profile(bench::State &state) {
+    py::dict kwargs;
+    kwargs["sample_every"] = 64;
+    dispatch(state, "gil_profile", py::make_tuple(true), kwargs);
+}
+BENCHMARK(BM_Dispatch_gil_profile);
+
+static void BM_Dispatch_gil_profile_dump(bench::State &state) {
+    dispatch(state, "gil_profile_dump", py::make_tuple());
+}
+BENCHMARK(BM_Dispatch_gil_profile_dump);
+
+static void BM_Dispatch_watch(bench::State &state) {
+    py::dict kwargs;
+    kwargs["ttl"] = 30.0;
+    kwargs["rssi_filter"] = "kalman";
+    py::list props;
+    props.append("System.Devices.Aep.DeviceAddress");
+    props.append("System.Devices.Aep.SignalStrength");
+    dispatch(state, "watch", py::make_tuple(props, py::none()), kwargs);
+}
+BENCHMARK(BM_Dispatch_watch);
+
+static void BM_Dispatch_method(bench::State &state) {
+    py::object watcher = py::module::import("pywinble_stub").attr("watch")(py::list());
+    py::object len = watcher.attr("__len__");
+    for (auto _ : state) {
+        PyObject *result = PyObject_CallObject(len.ptr(), NULL);
+        Py_XDECREF(result);
+    }
+}
+BENCHMARK(BM_Dispatch_method);
+
+static void BM_Dispatch_property(bench::State &state) {
+    py::object provider = py::module::import("pywinble_stub").attr("provide")("{eab08fe8-e7bd-4982-836e-8ec0839320ed}", py::dict());
+    for (auto _ : state) {
+        PyObject *result = PyObject_GetAttrString(provider.ptr(), "uuid");
+        Py_XDECREF(result);
+    }
+}
+BENCHMARK(BM_Dispatch_property);
+
+// ################ INSTANCES
+
+// this many objects already wrapped, so the instance table is past the cache
+// like a module with a busy watcher's devices and providers alive
+const size_t liveInstances = 4096;
+
+static std::vector<py::object> wrap_instances(size_t n) {
+    py::module::import("pywinble_stub");
+    std::vector<py::object> objects;
+    for (size_t i = 0; i < n; ++i)
+        objects.push_back(py::cast(new StubProvider(), py::return_value_policy::take_ownership));
+    return objects;
+}
+
+// returning a new object to Python and dropping it: register, then deregister
+static void BM_Instance_CreateDestroy(bench::State &state) {
+    auto live = wrap_instances(liveInstances);
+    for (auto _ : state) {
+        py::object provider = py::cast(new StubProvider(), py::return_value_policy::take_ownership);
+        bench::do_not_optimize(provider);
+    }
+}
+BENCHMARK(BM_Instance_CreateDestroy);
+
+// returning an object Python already holds finds its existing wrapper
+static void BM_Instance_Lookup(bench::State &state) {
+    auto live = wrap_instances(liveInstances);
+    std::vector<StubProvider *> pointers;
+    for (auto &object : live)
+        pointers.push_back(object.cast<StubProvider *>());
+    size_t i = 0;
+    for (auto _ : state) {
+        py::object provider = py::cast(pointers[i++ % pointers.size()], py::return_value_policy::reference);
+        bench::do_not_optimize(provider);
+    }
+}
+BENCHMARK(BM_Instance_Lookup);
+
+// create-and-drop cycles in objects/s, as `watcher.devices` does; the pool
+// hands the last instance's memory straight back
+template <class View>
+static void create_and_drop(bench::State &state) {
+    auto live = wrap_instances(liveInstances);
+    for (auto _ : state) {
+        py::object view = py::cast(new View(), py::return_value_policy::take_ownership);
+        bench::do_not_optimize(view);
+    }
+    state.setItemsProcessed(state.iterations());
+}
+
+static void BM_Instance_CreateDropUnpooled(bench::State &state) {
+    create_and_drop<StubView>(state);
+}
+BENCHMARK(BM_Instance_CreateDropUnpooled);
+
+static void BM_Instance_CreateDropPooled(bench::State &state) {
+    create_and_drop<StubPooledView>(state);
+}
+BENCHMARK(BM_Instance_CreateDropPooled);
+
+// the table alone, against the std::unordered_multimap it replaced; keys are
+// heap addresses of live objects, as in the module
+static std::vector<std::unique_ptr<StubProvider>> table_keys() {
+    std::vector<std::unique_ptr<StubProvider>> keys;
+    for (size_t i = 0; i < liveInstances; ++i)
+        keys.emplace_back(new StubProvider());
+    return keys;
+}
+
+static py::detail::instance *fake_instance(size_t i) {
+    return reinterpret_cast<py::detail::instance *>(0x1000 + i * 64);
+}
+
+static void BM_InstanceTable_Churn(bench::State &state) {
+    auto keys = table_keys();
+    py::detail::instance_map table;
+    for (size_t i = 0; i < keys.size(); ++i)
+        table.emplace(keys[i].get(), fake_instance(i));
+    size_t i = 0;
+    for (auto _ : state) {
+        size_t k = i++ % keys.size();
+        table.erase_if(keys[k].get(), [](py::detail::instance *) { return true; });
+        table.emplace(keys[k].get(), fake_instance(k));
+    }
+}
+BENCHMARK(BM_InstanceTable_Churn);
+
+static void BM_InstanceTable_ChurnMultimap(bench::State &state) {
+    auto keys = table_keys();
+    std::unordered_multimap<const void *, py::detail::instance *> table;
+    for (size_t i = 0; i < keys.size(); ++i)
+        table.emplace(keys[i].get(), fake_instance(i));
+    size_t i = 0;
+    for (auto _ : state) {
+        size_t k = i++ % keys.size();
+        auto range = table.equal_range(keys[k].get());
+        table.erase(range.first);
+        table.emplace(keys[k].get(), fake_instance(k));
+    }
+}
+BENCHMARK(BM_InstanceTable_ChurnMultimap);
+
+static void BM_InstanceTable_Lookup(bench::State &state) {
+    auto keys = table_keys();
+    py::detail::instance_map table;
+    for (size_t i = 0; i < keys.size(); ++i)
+        table.emplace(keys[i].get(), fake_instance(i));
+    size_t i = 0;
+    for (auto _ : state)
+        bench::do_not_optimize(table.find_if(keys[(i++ * 7919) % keys.size()].get(), [](py::detail::instance *) { return true; }));
+}
+BENCHMARK(BM_InstanceTable_Lookup);
+
+static void BM_InstanceTable_LookupMultimap(bench::State &state) {
+    auto keys = table_keys();
+    std::unordered_multimap<const void *, py::detail::instance *> table;
+    for (size_t i = 0; i < keys.size(); ++i)
+        table.emplace(keys[i].get(), fake_instance(i));
+    size_t i = 0;
+    for (auto _ : state) {
+        auto range = table.equal_range(keys[(i++ * 7919) % keys.size()].get());
+        bench::do_not_optimize(range.first == range.second ? nullptr : range.first->second);
+    }
+}
+BENCHMARK(BM_InstanceTable_LookupMultimap);
+
+// ################ CALLBACKS
+
+// a Python function shaped like the module's callbacks, doing nothing
+static py::object python_callback(const char *params) {
+    py::dict scope;
+    py::exec(std::string("def callback(") + params + "):\n    pass\n", scope);
+    return scope["callback"];
+}
+
+static void report(bench::State &state, PyObject *result) {
+    if (!result) {
+        py::error_already_set err;
+        state.skipWithError(err.what());
+    }
+    Py_XDECREF(result);
+}
+
+// on_status(error, status) the way advertise's callback used to be called
+static void BM_Callback_StatusFormat(bench::State &state) {
+    py::object fn = python_callback("error, status");
+    for (auto _ : state)
+        report(state, PyObject_CallFunction(fn.ptr(), "ii", 0, 1));
+}
+BENCHMARK(BM_Callback_StatusFormat);
+
+static void BM_Callback_StatusInvoker(bench::State &state) {
+    pycall::Invoker<int, int> callback(python_callback("error, status"));
+    for (auto _ : state)
+        report(state, callback.invoke(0, 1));
+}
+BENCHMARK(BM_Callback_StatusInvoker);
+
+// a watcher event, callback(event, id, properties), through a fresh tuple
+static void BM_Callback_EventTuple(bench::State &state) {
+    py::object fn = python_callback("event, id, props");
+    py::str event("updated"), id("BluetoothLE#BluetoothLE00:00:00:00:00:00-c0:ff:ee:12:34:56");
+    py::dict props;
+    for (auto _ : state)
+        report(state, PyObject_CallFunctionObjArgs(fn.ptr(), event.ptr(), id.ptr(), props.ptr(), NULL));
+}
+BENCHMARK(BM_Callback_EventTuple);
+
+static void BM_Callback_EventInvoker(bench::State &state) {
+    pycall::Invoker<py::handle, py::handle, py::handle> callback(python_callback("event, id, props"));
+    py::str event("updated"), id("BluetoothLE#BluetoothLE00:00:00:00:00:00-c0:ff:ee:12:34:56");
+    py::dict props;
+    for (auto _ : state)
+        report(state, callback.invoke(event, id, props));
+}
+BENCHMARK(BM_Callback_EventInvoker);
+
+// an RSSI reading as a Python int: CPython's own cache stops at -5
+static void BM_Callback_RssiLong(bench::State &state) {
+    for (auto _ : state)
+        Py_DECREF(PyLong_FromLong(-67));
+}
+BENCHMARK(BM_Callback_RssiLong);
+
+static void BM_Callback_RssiCached(bench::State &state) {
+    for (auto _ : state)
+        Py_DECREF(pycall::int_object(-67));
+}
+BENCHMARK(BM_Callback_RssiCached);
+
+// ################ STD::FUNCTION
+
+// a Python callable converted to std::function, as a binding taking one gets it
+template <typename Signature>
+static std::function<Signature> python_function(const char *params, const char *body = "pass") {
+    py::dict scope;
+    py::exec(std::string("def fn(") + params + "):\n    " + body + "\n", scope);
+    return py::cast<std::function<Signature>>(scope["fn"]);
+}
+
+static void BM_Function_Void(bench::State &state) {
+    auto fn = python_function<void(int, int)>("error, status");
+    for (auto _ : state)
+        fn(0, 1);
+}
+BENCHMARK(BM_Function_Void);
+
+// the caster's old wrapper: GIL, tuple, generic call, cast<void> on every call
+static void BM_Function_VoidGeneric(bench::State &state) {
+    py::dict scope;
+    py::exec("def fn(error, status):\n    pass\n", scope);
+    py::function func = scope["fn"].cast<py::function>();
+    std::function<void(int, int)> fn = [func](int error, int status) {
+        py::gil_scoped_acquire acq;
+        py::object retval(func(error, status));
+        retval.cast<void>();
+    };
+    for (auto _ : state)
+        fn(0, 1);
+}
+BENCHMARK(BM_Function_VoidGeneric);
+
+static void BM_Function_IntResult(bench::State &state) {
+    auto fn = python_function<int(int)>("x", "return x");
+    for (auto _ : state)
+        bench::do_not_optimize(fn(7));
+}
+BENCHMARK(BM_Function_IntResult);
+
+// called from a thread without the GIL, as a native callback would be
+static void BM_Function_VoidForeignThread(bench::State &state) {
+    auto fn = python_function<void(int, int)>("error, status");
+    py::gil_scoped_release release;
+    std::thread thread([&] {
+        for (auto _ : state)
+            fn(0, 1);
+    });
+    thread.join();
+}
+BENCHMARK(BM_Function_VoidForeignThread);
+
+// ################ GIL
+
+// a callback thread the interpreter didn't start, as WinRT's pool threads
+// are, taking the GIL once per callback while the main thread runs without it
+template <class Acquire>
+static void foreign_thread(bench::State &state) {
+    py::gil_scoped_release release;
+    std::thread thread([&state] {
+        for (auto _ : state) {
+            Acquire acquire;
+        }
+    });
+    thread.join();
+}
+
+// what gil_lock used to do
+struct GilStateEnsure {
+    PyGILState_STATE gstate = PyGILState_Ensure();
+    ~GilStateEnsure() { PyGILState_Release(gstate); }
+};
+
+static void BM_Gil_AcquireForeignThread(bench::State &state) {
+    foreign_thread<py::gil_scoped_acquire>(state);
+}
+BENCHMARK(BM_Gil_AcquireForeignThread);
+
+static void BM_Gil_EnsureForeignThread(bench::State &state) {
+    foreign_thread<GilStateEnsure>(state);
+}
+BENCHMARK(BM_Gil_EnsureForeignThread);
+
+int main(int argc, char **argv) {
+    py::scoped_interpreter python;
+    return bench::run(argc, argv);
+}
@@ -0,0 +1,66 @@
+"""Capacity sweep: doubles the simulated fleet until the python callback
+stops keeping up, then prints where that happened.
+
+    python bench/fleet_sweep.py [--hz 10] [--watchers 1] [--seconds 3]
+        [--max-drop 0.001] [--max-p99 0.05] [--work 0]
+
+--work is busy time in seconds spent per callback, a stand-in for what your
+application does with each event.
+"""
+
+import argparse
+import time
+
+from pywinble import bench
+
+
+def busy(seconds):
+    end = time.perf_counter() + seconds
+    while time.perf_counter() < end:
+        pass
+
+
+def main():
+    ap = argparse.ArgumentParser()
+    ap.add_argument("--hz", type=float, default=10.0, help="advertisements per device per second")
+    ap.add_argument("--watchers", type=int, default=1)
+    ap.add_argument("--clients", type=int, default=0, help="gatt clients writing to the provider")
+    ap.add_argument("--write-hz", type=float, default=10.0)
+    ap.add_argument("--seconds", type=float, default=3.0, help="length of each step")
+    ap.add_argument("--max-drop", type=float, default=0.001)
+    ap.add_argument("--max-p99", type=float, default=0.05, help="seconds")
+    ap.add_argument("--work", type=float, default=0.0)
+    ap.add_argument("--start", type=int, default=16, help="devices in the first step")
+    ap.add_argument("--limit", type=int, default=1 << 20)
+    args = ap.parse_args()
+
+    def on_event(*_):
+        if args.work:
+            busy(args.work)
+
+    print("%8s %10s %10s %8s %10s %10s %10s" % ("devices", "offered/s", "events/s", "drop", "p50 ms", "p99 ms", "p999 ms"))
+    best = None
+    devices = args.start
+    while devices <= args.limit:
+        fleet = bench.fleet(advertisers=devices, advertise_hz=args.hz, watchers=args.watchers,
+                            clients=args.clients, write_hz=args.write_hz,
+                            on_advertisement=on_event, on_write=on_event)
+        report = fleet.run(args.seconds)
+        adv = report["advertisement"]
+        print("%8d %10.0f %10.0f %8.4f %10.3f %10.3f %10.3f" % (
+            devices, devices * args.hz * args.watchers, adv["rate"], adv["drop_rate"],
+            adv["latency"]["p50"] * 1e3, adv["latency"]["p99"] * 1e3, adv["latency"]["p999"] * 1e3))
+        if adv["drop_rate"] > args.max_drop or adv["latency"]["p99"] > args.max_p99:
+            break
+        best = devices
+        devices *= 2
+
+    if best is None:
+        print("the smallest fleet already exceeds the limits")
+    else:
+        print("sustained %d devices (%.0f events/s) within drop <= %g and p99 <= %gs"
+              % (best, best * args.hz * args.watchers, args.max_drop, args.max_p99))
+
+
+if __name__ == "__main__":
+    main()
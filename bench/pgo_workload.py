@@ -0,0 +1,108 @@
+"""Representative workload for profile-guided builds, and the benchmark the
+PGO build is compared against a plain Release build with.
+
+    PYTHONPATH=<build dir> python bench/pgo_workload.py [--seconds 2] [--json out.json]
+
+Runs against the simulated backend: fleet advertisements and gatt writes
+delivered to python callbacks at saturation, watcher events, and tight
+loops over the module's dispatch paths (advertise, provide with a
+characteristic map, info, DeviceTable lookups).  Every number is a rate,
+higher is better.
+"""
+
+import argparse
+import json
+import os
+import sys
+import time
+
+# read by the sim backend when a watcher is created
+os.environ.setdefault("PYWINBLE_SIM_DEVICES", "4096")
+os.environ.setdefault("PYWINBLE_SIM_HZ", "50")
+
+import pywinble
+from pywinble import bench
+
+SERVICE = "eab08fe8-e7bd-4982-836e-8ec0839320ed"
+CHARACTERISTICS = {
+    "0000ff%02x-0000-1000-8000-00805f9b34fb" % i: {"flags": 4 if i % 2 else 10, "description": "char %d" % i}
+    for i in range(8)
+}
+
+
+def fleet_advertisement(seconds):
+    seen = [0]
+
+    def on_advertisement(event, id, props):
+        seen[0] += props["System.Devices.Aep.SignalStrength"] < 0
+
+    report = bench.fleet(advertisers=8192, advertise_hz=100, rssi_filter="kalman",
+                         queue=65536, on_advertisement=on_advertisement).run(seconds)
+    return report["advertisement"]["rate"]
+
+
+def fleet_write(seconds):
+    total = [0]
+
+    def on_write(characteristic, client, value):
+        total[0] += value[0] + len(value)
+
+    report = bench.fleet(advertisers=0, clients=2048, write_hz=400, characteristics=8,
+                         payload_size=244, queue=65536, on_write=on_write).run(seconds)
+    return report["write"]["rate"]
+
+
+def watcher(seconds):
+    count = [0]
+
+    def on_event(event, id, props):
+        count[0] += 1
+
+    w = pywinble.watch([], on_event, ttl=5.0, rssi_filter="kalman")
+    w.start()
+    time.sleep(seconds)
+    w.stop()
+    return count[0] / seconds, w
+
+
+def timed(seconds, fn):
+    calls = 0
+    end = time.perf_counter() + seconds
+    start = time.perf_counter()
+    while True:
+        for _ in range(64):
+            fn()
+        calls += 64
+        now = time.perf_counter()
+        if now >= end:
+            return calls / (now - start)
+
+
+def main():
+    ap = argparse.ArgumentParser()
+    ap.add_argument("--seconds", type=float, default=2.0, help="length of each section")
+    ap.add_argument("--json", help="write the results here")
+    args = ap.parse_args()
+
+    results = {}
+    results["fleet_advertisement_per_s"] = fleet_advertisement(args.seconds)
+    results["fleet_write_per_s"] = fleet_write(args.seconds)
+    results["watcher_events_per_s"], w = watcher(args.seconds)
+
+    table = w.devices
+    keys = list(table)[:256] or ["00:00:00:00:00:00"]
+    status = lambda error, state: None
+    results["advertise_per_s"] = timed(args.seconds, lambda: pywinble.advertise("vida:c0:ff:ee:00:00:01", status))
+    results["provide_per_s"] = timed(args.seconds, lambda: pywinble.provide(SERVICE, CHARACTERISTICS))
+    results["info_per_s"] = timed(args.seconds, pywinble.info)
+    results["table_get_per_s"] = timed(args.seconds, lambda: [table.get(k) for k in keys]) * len(keys)
+
+    for name, value in results.items():
+        print("%-28s %14.0f" % (name, value))
+    if args.json:
+        with open(args.json, "w") as f:
+            json.dump({"backend": pywinble.backend, "python": sys.version.split()[0], "results": results}, f, indent=2)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,89 @@
+"""Startup cost of short-lived worker processes that import pywinble.
+
+    PYTHONPATH=<build dir> python bench/startup.py [--runs 30] [--work 50]
+        [--adapter-ms 200]
+
+Each run is a fresh interpreter.  Reported per scenario, median and p90 in
+ms: the import itself, the first info() call, and the whole process from
+spawn to exit.  "work" stands for the worker's own setup between import and
+first use; with prewarm the adapter lookup overlaps it.  --adapter-ms sets
+PYWINBLE_SIM_ADAPTER_MS, the sim backend's stand-in for GetDefaultAsync.
+"""
+
+import argparse
+import json
+import os
+import subprocess
+import sys
+import time
+
+CHILD = r"""
+import json, sys, time
+t0 = time.perf_counter()
+import pywinble
+t1 = time.perf_counter()
+if %(prewarm_call)s:
+    pywinble.prewarm()
+time.sleep(%(work)f)
+t2 = time.perf_counter()
+if %(use)s:
+    pywinble.info()
+t3 = time.perf_counter()
+print(json.dumps({"import": t1 - t0, "info": t3 - t2}))
+"""
+
+SCENARIOS = [
+    # name, call info(), prewarm() after import, PYWINBLE_PREWARM, work between import and info()
+    ("import only", False, False, False, False),
+    ("first use", True, False, False, True),
+    ("prewarm() + first use", True, True, False, True),
+    ("PYWINBLE_PREWARM + first use", True, False, True, True),
+]
+
+
+def quantile(values, q):
+    values = sorted(values)
+    return values[min(len(values) - 1, int(q * len(values)))]
+
+
+def main():
+    ap = argparse.ArgumentParser()
+    ap.add_argument("--runs", type=int, default=30)
+    ap.add_argument("--work", type=float, default=50.0, help="ms of worker setup before first use")
+    ap.add_argument("--adapter-ms", type=float, default=200.0, help="simulated adapter lookup time")
+    args = ap.parse_args()
+
+    base_env = dict(os.environ, PYWINBLE_SIM_ADAPTER_MS=str(args.adapter_ms))
+    base_env.pop("PYWINBLE_PREWARM", None)
+
+    # interpreter startup alone, to separate it from the module's share
+    bare = []
+    for _ in range(args.runs):
+        start = time.perf_counter()
+        subprocess.check_call([sys.executable, "-c", "pass"], env=base_env)
+        bare.append(time.perf_counter() - start)
+    print("python -c pass: median %.1f ms, p90 %.1f ms\n" % (quantile(bare, 0.5) * 1e3, quantile(bare, 0.9) * 1e3))
+
+    print("%-30s %18s %18s %18s" % ("", "import ms", "first info() ms", "process ms"))
+    for name, use, prewarm_call, prewarm_env, work in SCENARIOS:
+        env = dict(base_env)
+        if prewarm_env:
+            env["PYWINBLE_PREWARM"] = "1"
+        code = CHILD % {"prewarm_call": prewarm_call, "use": use, "work": args.work / 1e3 if work else 0.0}
+        imports, infos, procs = [], [], []
+        for _ in range(args.runs):
+            start = time.perf_counter()
+            out = subprocess.check_output([sys.executable, "-c", code], env=env)
+            procs.append(time.perf_counter() - start)
+            result = json.loads(out)
+            imports.append(result["import"])
+            infos.append(result["info"])
+        cols = []
+        for values in (imports, infos if use else None, procs):
+            cols.append("%8.2f / %7.2f" % (quantile(values, 0.5) * 1e3, quantile(values, 0.9) * 1e3)
+                        if values else "%18s" % "-")
+        print("%-30s %18s %18s %18s" % (name, cols[0], cols[1], cols[2]))
+
+
+if __name__ == "__main__":
+    main()
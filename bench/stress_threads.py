@@ -0,0 +1,169 @@
+"""Hammer the module from many threads at once, to shake out races in its
+own state: providers, watchers, the advertising callback, fleets and
+shutdown() all racing each other.
+
+    PYTHONPATH=<build dir> python bench/stress_threads.py [--threads 16] [--seconds 10]
+
+Each thread picks operations at random.  RuntimeErrors for objects that were
+closed underneath it (by another thread or shutdown()) are expected and
+counted; anything else fails the run.  On a free-threaded build the GIL
+state is printed, since pywinble itself keeps it enabled.
+"""
+
+import argparse
+import collections
+import os
+import random
+import sys
+import threading
+import time
+
+os.environ.setdefault("PYWINBLE_SIM_DEVICES", "256")
+os.environ.setdefault("PYWINBLE_SIM_HZ", "200")
+
+import pywinble
+from pywinble import bench
+
+SERVICE = "eab08fe8-e7bd-4982-836e-8ec0839320ed"
+CHARACTERISTICS = {"0000ff01-0000-1000-8000-00805f9b34fb": {"flags": 10, "description": "stress"}}
+
+
+class Shared:
+    def __init__(self):
+        self.lock = threading.Lock()
+        self.providers = []
+        self.watchers = []
+
+    def pick(self, items):
+        with self.lock:
+            return random.choice(items) if items else None
+
+    def add(self, items, item, keep=8):
+        with self.lock:
+            items.append(item)
+            if len(items) > keep:
+                return items.pop(0)
+
+
+def op_info(shared):
+    pywinble.info()
+
+
+def op_advertise(shared):
+    pywinble.advertise("vida:stress", lambda error, status: None)
+
+
+def op_provide(shared):
+    old = shared.add(shared.providers, pywinble.provide(SERVICE, CHARACTERISTICS))
+    if old is not None:
+        old.close()
+
+
+def op_provider(shared):
+    provider = shared.pick(shared.providers)
+    if provider is not None:
+        random.choice([provider.start, provider.stop, provider.start, lambda: provider.close()])()
+
+
+def op_watch(shared):
+    events = [0]
+
+    def on_event(event, id, props):
+        events[0] += 1
+        # closing from inside our own callback must not deadlock
+        if random.random() < 0.001:
+            watcher.close()
+
+    watcher = pywinble.watch([], on_event, ttl=0.5)
+    watcher.start()
+    old = shared.add(shared.watchers, watcher, keep=4)
+    if old is not None:
+        old.close(timeout=1.0)
+
+
+def op_watcher(shared):
+    watcher = shared.pick(shared.watchers)
+    if watcher is not None:
+        action = random.choice(["devices", "pause", "resume", "start", "stop", "state"])
+        if action == "devices":
+            table = watcher.devices
+            for key in list(table)[:16]:
+                table.get(key)
+        elif action == "state":
+            watcher.state, watcher.paused, len(watcher)
+        else:
+            getattr(watcher, action)()
+
+
+def op_fleet(shared):
+    with bench.fleet(advertisers=64, advertise_hz=50, queue=256,
+                     on_advertisement=lambda event, id, props: None) as fleet:
+        fleet.run(0.02)
+
+
+def op_metrics(shared):
+    pywinble.metrics()
+
+
+def op_shutdown(shared):
+    pywinble.shutdown(timeout=2.0)
+
+
+OPS = [
+    (op_info, 10), (op_advertise, 10), (op_provide, 5), (op_provider, 20),
+    (op_watch, 3), (op_watcher, 20), (op_fleet, 1), (op_metrics, 10), (op_shutdown, 0.2),
+]
+
+
+def worker(shared, end, counts, expected, failures):
+    ops, weights = zip(*OPS)
+    while time.perf_counter() < end:
+        op = random.choices(ops, weights)[0]
+        try:
+            op(shared)
+            counts[op.__name__] += 1
+        except RuntimeError as e:
+            if "closed" not in str(e) and "stopping" not in str(e):
+                failures.append("%s: %r" % (op.__name__, e))
+            expected[op.__name__] += 1
+        except Exception as e:
+            failures.append("%s: %r" % (op.__name__, e))
+
+
+def main():
+    ap = argparse.ArgumentParser()
+    ap.add_argument("--threads", type=int, default=16)
+    ap.add_argument("--seconds", type=float, default=10.0)
+    args = ap.parse_args()
+
+    if hasattr(sys, "_is_gil_enabled"):
+        print("gil enabled: %s" % sys._is_gil_enabled())
+    # short slices make the interpreter switch threads inside our calls
+    sys.setswitchinterval(1e-5)
+
+    shared = Shared()
+    counts, expected = collections.Counter(), collections.Counter()
+    failures = []
+    end = time.perf_counter() + args.seconds
+    threads = [threading.Thread(target=worker, args=(shared, end, counts, expected, failures))
+               for _ in range(args.threads)]
+    start = time.perf_counter()
+    for t in threads:
+        t.start()
+    for t in threads:
+        t.join()
+    elapsed = time.perf_counter() - start
+
+    clean = pywinble.shutdown()
+    for op, _ in OPS:
+        name = op.__name__
+        print("%-14s %8d ok %6d closed" % (name[3:], counts[name], expected[name]))
+    print("%.0f ops/s over %d threads, final shutdown %s" % (sum(counts.values()) / elapsed, args.threads,
+                                                             "clean" if clean else "timed out"))
+    for failure in failures[:20]:
+        print("FAIL " + failure)
+    sys.exit(1 if failures or not clean else 0)
+
+
+if __name__ == "__main__":
+    main()
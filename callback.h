@@ -0,0 +1,111 @@
+#pragma once
+
+// Calling Python callbacks from event sites.
+//
+// Invoker<Args...> holds one callback and calls it with C++ values converted
+// at the call: arguments go on the stack and through vectorcall, with no
+// format string to parse and no argument tuple.  Ints in the range events
+// carry (status codes, RSSI in dBm) come from a table made once, since
+// CPython only caches -5..256 and RSSI is always negative.
+
+#include <Python.h>
+#include "pybind11/pybind11.h"
+
+#include <stdint.h>
+
+#include <string>
+
+#include "metrics.h"
+
+#if PY_VERSION_HEX >= 0x03080000 && PY_VERSION_HEX < 0x03090000
+    #define PyObject_Vectorcall _PyObject_Vectorcall
+#endif
+
+namespace pycall {
+
+namespace py = pybind11;
+
+const long smallIntMin = -128, smallIntMax = 256;
+
+// a new reference, from the table when v is in range; call with the GIL.
+// The table is never freed, like pybind11's internals.
+inline PyObject *int_object(long v) {
+    static PyObject **table = [] {
+        PyObject **objects = new PyObject *[smallIntMax - smallIntMin + 1];
+        for (long i = smallIntMin; i <= smallIntMax; ++i)
+            objects[i - smallIntMin] = PyLong_FromLong(i);
+        return objects;
+    }();
+    if (v < smallIntMin || v > smallIntMax)
+        return PyLong_FromLong(v);
+    PyObject *o = table[v - smallIntMin];
+    Py_INCREF(o);
+    return o;
+}
+
+inline py::object to_python(py::handle value) { return py::reinterpret_borrow<py::object>(value); }
+inline py::object to_python(int value) { return py::reinterpret_steal<py::object>(int_object(value)); }
+inline py::object to_python(long value) { return py::reinterpret_steal<py::object>(int_object(value)); }
+inline py::object to_python(uint64_t value) { return py::reinterpret_steal<py::object>(PyLong_FromUnsignedLongLong(value)); }
+inline py::object to_python(const std::string &value) { return py::str(value); }
+
+template <class... Args>
+class Invoker {
+    public:
+        static_assert(sizeof...(Args) > 0, "callbacks take at least one argument");
+
+        Invoker() {}
+        explicit Invoker(py::object fn) : fn(std::move(fn)) {}
+
+        // set and not None
+        explicit operator bool() const {
+            return fn && !fn.is_none();
+        }
+
+        const py::object &function() const {
+            return fn;
+        }
+
+        // lets go of the function without a decref, for when the GIL can't be had
+        void leak() {
+            fn.release();
+        }
+
+        // the result as a new reference, or NULL with the error set; with the GIL
+        PyObject *invoke(const Args &... args) const {
+            py::object values[] = {to_python(args)...};
+            // our own reference: the callback may drop this invoker's, e.g. by close()
+            py::object keep = fn;
+#if PY_VERSION_HEX >= 0x03080000
+            // slot 0 is scratch space the callee may use to prepend self
+            PyObject *argv[1 + sizeof...(Args)] = {nullptr};
+            for (size_t i = 0; i < sizeof...(Args); ++i)
+                argv[i + 1] = values[i].ptr();
+            return PyObject_Vectorcall(keep.ptr(), argv + 1, sizeof...(Args) | PY_VECTORCALL_ARGUMENTS_OFFSET, NULL);
+#else
+            py::tuple tuple(sizeof...(Args));
+            for (size_t i = 0; i < sizeof...(Args); ++i)
+                PyTuple_SET_ITEM(tuple.ptr(), i, values[i].release().ptr());
+            return PyObject_Call(keep.ptr(), tuple.ptr(), NULL);
+#endif
+        }
+
+        // calls it and reports an exception it raised as unraisable, counted
+        // in CallbackErrors; false if it raised
+        bool operator()(const Args &... args) const {
+            py::object keep = fn;
+            PyObject *result = invoke(args...);
+            if (!result) {
+                metrics::count(metrics::CallbackErrors);
+                PyErr_WriteUnraisable(keep.ptr());
+                return false;
+            }
+            Py_DECREF(result);
+            return true;
+        }
+
+    private:
+        py::object fn;
+};
+
+}
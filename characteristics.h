@@ -0,0 +1,71 @@
+#pragma once
+
+// provide()'s characteristic schema, {uuid: {"flags": int, "description": str}, ...},
+// validated and converted before any radio object is created.
+
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include "pybind11/pybind11.h"
+#include "pybind11/stl.h"
+
+#include "util.h"
+
+struct CharacteristicSpec {
+    Guid uuid;
+    uint32_t flags = 0;
+    bool hasDescription = false;
+    std::wstring description;
+};
+
+// read straight out of the caller's dicts, nothing copied before the parse
+typedef pybind11::dict_view<pybind11::str, pybind11::dict_view<pybind11::str, pybind11::handle>> characteristic_map;
+
+// a str key's UTF-8, borrowed from the object rather than copied
+inline const char *key_text(pybind11::handle key, Py_ssize_t &size) {
+    const char *text = PyUnicode_AsUTF8AndSize(key.ptr(), &size);
+    if (!text)
+        throw pybind11::error_already_set();
+    return text;
+}
+
+inline bool key_is(const char *text, Py_ssize_t size, const char *name) {
+    return (size_t) size == strlen(name) && memcmp(text, name, size) == 0;
+}
+
+inline std::vector<CharacteristicSpec> parse_characteristics(const characteristic_map &characteristics) {
+    std::vector<CharacteristicSpec> specs;
+    specs.reserve(characteristics.size());
+
+    for (auto item : characteristics) {
+        Py_ssize_t size;
+        const char *uuid = key_text(item.first, size);
+        if (size == 0)
+            throw pybind11::type_error("Invalid characteristic dict {uuid:{key:v},...}");
+
+        CharacteristicSpec spec;
+        if (!parse_guid(uuid, spec.uuid))
+            throw pybind11::value_error(std::string("Invalid characteristic uuid: ") + uuid);
+
+        for (auto prop : item.second) {
+            const char *key = key_text(prop.first, size);
+            if (size == 0)
+                throw pybind11::type_error("Invalid characteristic dict {uuid:{key:v},...}");
+
+            if (key_is(key, size, "flags")) {
+                long flags = PyLong_AsLong(prop.second.ptr());
+                if (flags == -1 && PyErr_Occurred())
+                    throw pybind11::error_already_set();
+                spec.flags = (uint32_t) flags;
+            } else if (key_is(key, size, "description")) {
+                std::string text = pybind11::str(prop.second);
+                spec.description = utf8_to_wide(text);
+                spec.hasDescription = true;
+            }
+        }
+        specs.push_back(std::move(spec));
+    }
+    return specs;
+}
@@ -0,0 +1,536 @@
+#pragma once
+
+// Device table maintained by BLEWatcher and read from python.
+//
+// Rows live in dense struct-of-arrays columns; an open-addressing index keyed
+// by the 48-bit bluetooth address maps addresses to rows.  Every mutation
+// bumps a generation counter and stamps the row, so readers can ask for only
+// the rows changed since the generation they last saw.
+//
+// Optionally rows expire when not seen within a ttl, and the table is capped
+// by evicting the least recently seen row; both are reported by expire().
+// Each row also carries a smoothed rssi and a path-loss distance estimate.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <mutex>
+#include <string>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "rssi.h"
+#include "timewheel.h"
+#include "util.h"
+
+// "aa:bb:cc:dd:ee:ff"
+inline std::string format_address(uint64_t addr) {
+    char buf[18];
+    snprintf(buf, sizeof(buf), "%02x:%02x:%02x:%02x:%02x:%02x",
+            (unsigned) (addr >> 40) & 0xff, (unsigned) (addr >> 32) & 0xff, (unsigned) (addr >> 24) & 0xff,
+            (unsigned) (addr >> 16) & 0xff, (unsigned) (addr >> 8) & 0xff, (unsigned) addr & 0xff);
+    return std::string(buf, 17);
+}
+
+// accepts "aa:bb:cc:dd:ee:ff", "aa-bb-..." or bare hex, returns false on junk
+inline bool parse_address(const char *str, uint64_t &addr) {
+    uint64_t v = 0;
+    int digits = 0;
+    for (const char *p = str; *p; ++p) {
+        char c = *p;
+        int d;
+        if (c >= '0' && c <= '9') d = c - '0';
+        else if (c >= 'a' && c <= 'f') d = c - 'a' + 10;
+        else if (c >= 'A' && c <= 'F') d = c - 'A' + 10;
+        else if (c == ':' || c == '-') continue;
+        else return false;
+        if (++digits > 12)
+            return false;
+        v = (v << 4) | (uint64_t) d;
+    }
+    if (!digits)
+        return false;
+    addr = v;
+    return true;
+}
+
+class DeviceTable {
+    public:
+        struct Row {
+            uint64_t address;
+            int16_t rssi;
+            float smoothed;         // rssi after the table's filter
+            float distance;         // meters, from the smoothed rssi
+            uint64_t lastSeen;      // steady clock, nanoseconds
+            uint64_t version;
+            std::string name;
+        };
+
+        // rows removed longer ago than this many removals can't be diffed
+        static const size_t maxRemovedLog = 4096;
+
+        // the rssi of a sighting that carried no signal strength: it refreshes
+        // the row but isn't a reading.  A row without any reading yet has this
+        // rssi and NaN for its smoothed rssi and distance.
+        static const int16_t noReading = INT16_MIN;
+
+        DeviceTable(uint64_t now = steady_now()) : wheel(TimingWheel::defaultTickNs, now) {
+            index.assign(16, 0);
+        }
+
+        // ttl of 0 never expires rows, capacity of 0 is unbounded
+        void setExpiry(uint64_t ttlNs, size_t maxRows, uint64_t now = steady_now()) {
+            std::lock_guard<std::mutex> lock(mtx);
+            ttl = ttlNs;
+            capacity = maxRows;
+            // a sixteenth of the ttl keeps expiry within ~6% of it
+            uint64_t tick = ttl ? ttl / 16 : TimingWheel::defaultTickNs;
+            if (tick < minTickNs)
+                tick = minTickNs;
+            wheel = TimingWheel(tick, now);
+            // re-added least recently seen first, so the cap still evicts in lru order
+            std::vector<uint32_t> order(addresses.size());
+            for (uint32_t row = 0; row < order.size(); ++row)
+                order[row] = row;
+            std::stable_sort(order.begin(), order.end(),
+                    [&](uint32_t a, uint32_t b) { return lastSeens[a] < lastSeens[b]; });
+            for (auto row : order)
+                timers[row] = wheel.add(addresses[row], deadline(lastSeens[row]));
+            while (capacity && addresses.size() > capacity)
+                evictOldest();
+        }
+
+        uint64_t getTtl() {
+            std::lock_guard<std::mutex> lock(mtx);
+            return ttl;
+        }
+
+        size_t getCapacity() {
+            std::lock_guard<std::mutex> lock(mtx);
+            return capacity;
+        }
+
+        // restarts every row's filter from its last raw reading
+        void setFilter(const RssiFilter &next) {
+            std::lock_guard<std::mutex> lock(mtx);
+            filter = next;
+            histories.assign(filter.kind == RssiFilterKind::Median ? addresses.size() * RssiFilter::maxWindow : 0, 0);
+            for (uint32_t row = 0; row < addresses.size(); ++row)
+                resetFilter(row);
+        }
+
+        RssiFilter getFilter() {
+            std::lock_guard<std::mutex> lock(mtx);
+            return filter;
+        }
+
+        // insert or refresh a device, name is left alone when null and the
+        // readings when rssi is noReading
+        uint64_t upsert(uint64_t address, int16_t rssi, uint64_t now, const std::string *name = nullptr) {
+            std::lock_guard<std::mutex> lock(mtx);
+            ++generation;
+            bool pending;
+            uint32_t row = touchRow(address, rssi, now, pending);
+            if (name)
+                names[row] = *name;
+            float sample = rssi;
+            if (pending)
+                filterRows(&row, &sample, 1);
+            if (capacity && addresses.size() > capacity)
+                evictOldest();
+            return generation;
+        }
+
+        // many sightings under one lock, filters run as batch kernels
+        uint64_t upsertBatch(const uint64_t *address, const int16_t *rssi, size_t n, uint64_t now) {
+            std::lock_guard<std::mutex> lock(mtx);
+            ++generation;
+            batchRows.clear();
+            batchSamples.clear();
+            ++batchEpoch;
+            for (size_t i = 0; i < n; ++i) {
+                bool pending;
+                uint32_t row = touchRow(address[i], rssi[i], now, pending);
+                // a repeat sighting must see the state left by the first one
+                if (batchMarks[row] == batchEpoch) {
+                    flushBatch();
+                    ++batchEpoch;
+                }
+                batchMarks[row] = batchEpoch;
+                if (pending) {
+                    batchRows.push_back(row);
+                    batchSamples.push_back(rssi[i]);
+                }
+            }
+            flushBatch();
+            while (capacity && addresses.size() > capacity)
+                evictOldest();
+            return generation;
+        }
+
+        bool remove(uint64_t address) {
+            std::lock_guard<std::mutex> lock(mtx);
+            size_t slot = find(address);
+            if (!index[slot])
+                return false;
+            wheel.remove(timers[index[slot] - 1]);
+            eraseRow(slot);
+            return true;
+        }
+
+        // drops rows past their ttl and hands back those plus any rows evicted
+        // by the capacity cap since the last call, oldest first
+        size_t expire(uint64_t now, std::vector<uint64_t> &lost) {
+            std::lock_guard<std::mutex> lock(mtx);
+            size_t before = lost.size();
+            // an address seen again since its eviction is back in the table,
+            // and one evicted twice is reported once
+            std::unordered_set<uint64_t> reported;
+            for (auto address : evicted) {
+                if (!index[find(address)] && reported.insert(address).second)
+                    lost.push_back(address);
+            }
+            evicted.clear();
+            size_t first = lost.size();
+            wheel.advance(now, lost);
+            for (size_t i = first; i < lost.size(); ++i) {
+                size_t slot = find(lost[i]);
+                if (index[slot])
+                    eraseRow(slot);
+            }
+            return lost.size() - before;
+        }
+
+        bool get(uint64_t address, Row &out) {
+            std::lock_guard<std::mutex> lock(mtx);
+            size_t slot = find(address);
+            if (!index[slot])
+                return false;
+            readRow(index[slot] - 1, out);
+            return true;
+        }
+
+        bool contains(uint64_t address) {
+            std::lock_guard<std::mutex> lock(mtx);
+            return index[find(address)] != 0;
+        }
+
+        size_t size() {
+            std::lock_guard<std::mutex> lock(mtx);
+            return addresses.size();
+        }
+
+        uint64_t version() {
+            std::lock_guard<std::mutex> lock(mtx);
+            return generation;
+        }
+
+        std::vector<uint64_t> keys() {
+            std::lock_guard<std::mutex> lock(mtx);
+            return addresses;
+        }
+
+        std::vector<Row> rows() {
+            std::lock_guard<std::mutex> lock(mtx);
+            std::vector<Row> out(addresses.size());
+            for (uint32_t i = 0; i < out.size(); ++i)
+                readRow(i, out[i]);
+            return out;
+        }
+
+        // rows modified and addresses removed after generation `since`.
+        // returns false if removals that old were already discarded, in which
+        // case `changed` holds every row and the caller should resync.
+        bool changesSince(uint64_t since, std::vector<Row> &changed, std::vector<uint64_t> &gone, uint64_t &current) {
+            std::lock_guard<std::mutex> lock(mtx);
+            current = generation;
+            bool complete = since >= removedFloor;
+            for (uint32_t i = 0; i < addresses.size(); ++i) {
+                if (!complete || versions[i] > since) {
+                    changed.emplace_back();
+                    readRow(i, changed.back());
+                }
+            }
+            if (complete) {
+                // an address removed and seen again is reported as changed only
+                for (auto it = removed.rbegin(); it != removed.rend() && it->second > since; ++it) {
+                    if (!index[find(it->first)])
+                        gone.push_back(it->first);
+                }
+            }
+            return complete;
+        }
+
+        void clear() {
+            std::lock_guard<std::mutex> lock(mtx);
+            ++generation;
+            for (auto address : addresses)
+                removed.emplace_back(address, generation);
+            if (removed.size() > maxRemovedLog) {
+                removedFloor = generation;
+                removed.clear();
+            }
+            addresses.clear();
+            rssis.clear();
+            smoothed.clear();
+            variances.clear();
+            distances.clear();
+            histories.clear();
+            historyCounts.clear();
+            batchMarks.clear();
+            lastSeens.clear();
+            versions.clear();
+            timers.clear();
+            names.clear();
+            evicted.clear();
+            index.assign(16, 0);
+            wheel = TimingWheel(wheel.tick(), steady_now());
+        }
+
+    private:
+        static const uint64_t minTickNs = 10000000ull;
+
+        std::mutex mtx;
+        uint64_t generation = 0;
+        uint64_t removedFloor = 0;
+
+        uint64_t ttl = 0;
+        size_t capacity = 0;
+        RssiFilter filter;
+        TimingWheel wheel;
+        std::vector<uint64_t> evicted;
+
+        // index slots hold row + 1, 0 is empty
+        std::vector<uint32_t> index;
+
+        std::vector<uint64_t> addresses;
+        std::vector<int16_t> rssis;
+        std::vector<float> smoothed;
+        std::vector<float> variances;       // kalman error estimate
+        std::vector<float> distances;
+        std::vector<int16_t> histories;     // median rings, maxWindow per row
+        std::vector<uint8_t> historyCounts;
+        std::vector<uint32_t> batchMarks;
+        std::vector<uint64_t> lastSeens;
+        std::vector<uint64_t> versions;
+        std::vector<uint32_t> timers;
+        std::vector<std::string> names;
+
+        std::vector<std::pair<uint64_t, uint64_t>> removed;
+
+        uint32_t batchEpoch = 0;
+        std::vector<uint32_t> batchRows;
+        std::vector<float> batchSamples;
+        std::vector<float> scratchA, scratchB;
+
+        // finds or appends the row and records the raw sighting; a new row
+        // starts its filter at the sample
+        // finds or adds the row and stamps it.  pending says the reading has
+        // yet to go through the row's filter; otherwise there was none, or the
+        // filter was started from it.
+        uint32_t touchRow(uint64_t address, int16_t rssi, uint64_t now, bool &pending) {
+            size_t slot = find(address);
+            uint32_t row;
+            bool added = !index[slot];
+            if (!added) {
+                row = index[slot] - 1;
+                wheel.touch(timers[row], deadline(now));
+            } else {
+                row = (uint32_t) addresses.size();
+                addresses.push_back(address);
+                rssis.push_back(0);
+                smoothed.push_back(0);
+                variances.push_back(0);
+                distances.push_back(0);
+                historyCounts.push_back(0);
+                batchMarks.push_back(0);
+                if (filter.kind == RssiFilterKind::Median)
+                    histories.resize(histories.size() + RssiFilter::maxWindow);
+                lastSeens.push_back(0);
+                versions.push_back(0);
+                timers.push_back(wheel.add(address, deadline(now)));
+                names.emplace_back();
+                index[slot] = row + 1;
+                if (addresses.size() * 4 > index.size() * 3)
+                    rehash(index.size() * 2);
+            }
+            lastSeens[row] = now;
+            versions[row] = generation;
+            pending = false;
+            if (rssi == noReading) {
+                if (added) {
+                    rssis[row] = noReading;
+                    resetFilter(row);
+                }
+            } else if (added || rssis[row] == noReading) {
+                rssis[row] = rssi;
+                resetFilter(row);
+            } else {
+                rssis[row] = rssi;
+                pending = true;
+            }
+            return row;
+        }
+
+        void resetFilter(uint32_t row) {
+            historyCounts[row] = 0;
+            if (rssis[row] == noReading) {
+                smoothed[row] = distances[row] = NAN;
+                return;
+            }
+            smoothed[row] = rssis[row];
+            variances[row] = filter.measureNoise;
+            if (filter.kind == RssiFilterKind::Median)
+                median_push(&histories[row * RssiFilter::maxWindow], historyCounts[row], filter.window, rssis[row]);
+            distances[row] = path_loss_distance(smoothed[row], filter.txPower, filter.pathLossExponent);
+        }
+
+        void flushBatch() {
+            if (!batchRows.empty())
+                filterRows(batchRows.data(), batchSamples.data(), batchRows.size());
+            batchRows.clear();
+            batchSamples.clear();
+        }
+
+        // rows must be distinct; gathers their state, runs the kernels, scatters back
+        void filterRows(const uint32_t *rows, const float *samples, size_t n) {
+            scratchA.resize(n);
+            scratchB.resize(n);
+            float *x = scratchA.data(), *p = scratchB.data();
+            switch (filter.kind) {
+                case RssiFilterKind::None:
+                    memcpy(x, samples, n * sizeof(float));
+                    break;
+                case RssiFilterKind::Ema:
+                    for (size_t i = 0; i < n; ++i)
+                        x[i] = smoothed[rows[i]];
+                    ema_batch(x, samples, n, filter.alpha);
+                    break;
+                case RssiFilterKind::Median:
+                    for (size_t i = 0; i < n; ++i)
+                        x[i] = median_push(&histories[rows[i] * RssiFilter::maxWindow], historyCounts[rows[i]], filter.window, (int16_t) samples[i]);
+                    break;
+                case RssiFilterKind::Kalman:
+                    for (size_t i = 0; i < n; ++i) {
+                        x[i] = smoothed[rows[i]];
+                        p[i] = variances[rows[i]];
+                    }
+                    kalman_batch(x, p, samples, n, filter.processNoise, filter.measureNoise);
+                    for (size_t i = 0; i < n; ++i)
+                        variances[rows[i]] = p[i];
+                    break;
+            }
+            for (size_t i = 0; i < n; ++i)
+                smoothed[rows[i]] = x[i];
+            distance_batch(x, p, n, filter.txPower, filter.pathLossExponent);
+            for (size_t i = 0; i < n; ++i)
+                distances[rows[i]] = p[i];
+        }
+
+        uint64_t deadline(uint64_t seen) const {
+            return ttl ? seen + ttl : TimingWheel::never;
+        }
+
+        void evictOldest() {
+            uint32_t node = wheel.oldest();
+            uint64_t address = wheel.key(node);
+            wheel.remove(node);
+            eraseRow(find(address));
+            evicted.push_back(address);
+        }
+
+        // timer must already be released
+        void eraseRow(size_t slot) {
+            ++generation;
+            uint32_t row = index[slot] - 1;
+            uint64_t address = addresses[row];
+            eraseSlot(slot);
+
+            // swap-remove the dense row, then repoint the moved row's slot
+            uint32_t last = (uint32_t) addresses.size() - 1;
+            if (row != last) {
+                addresses[row] = addresses[last];
+                rssis[row] = rssis[last];
+                smoothed[row] = smoothed[last];
+                variances[row] = variances[last];
+                distances[row] = distances[last];
+                historyCounts[row] = historyCounts[last];
+                batchMarks[row] = batchMarks[last];
+                if (!histories.empty())
+                    memcpy(&histories[row * RssiFilter::maxWindow], &histories[last * RssiFilter::maxWindow], RssiFilter::maxWindow * sizeof(int16_t));
+                lastSeens[row] = lastSeens[last];
+                versions[row] = versions[last];
+                timers[row] = timers[last];
+                names[row] = std::move(names[last]);
+                index[find(addresses[row])] = row + 1;
+            }
+            addresses.pop_back();
+            rssis.pop_back();
+            smoothed.pop_back();
+            variances.pop_back();
+            distances.pop_back();
+            historyCounts.pop_back();
+            batchMarks.pop_back();
+            if (!histories.empty())
+                histories.resize(histories.size() - RssiFilter::maxWindow);
+            lastSeens.pop_back();
+            versions.pop_back();
+            timers.pop_back();
+            names.pop_back();
+
+            removed.emplace_back(address, generation);
+            if (removed.size() > maxRemovedLog) {
+                size_t drop = removed.size() - maxRemovedLog / 2;
+                removedFloor = removed[drop - 1].second;
+                removed.erase(removed.begin(), removed.begin() + drop);
+            }
+        }
+
+        size_t home(uint64_t address) const {
+            // fibonacci hashing, index size is a power of two
+            return (size_t) ((address * 0x9E3779B97F4A7C15ull) >> 32) & (index.size() - 1);
+        }
+
+        // slot holding address, or the empty slot where it would go
+        size_t find(uint64_t address) const {
+            size_t mask = index.size() - 1;
+            for (size_t slot = home(address);; slot = (slot + 1) & mask) {
+                uint32_t row = index[slot];
+                if (!row || addresses[row - 1] == address)
+                    return slot;
+            }
+        }
+
+        // backward-shift deletion keeps probe chains intact without tombstones
+        void eraseSlot(size_t slot) {
+            size_t mask = index.size() - 1;
+            size_t hole = slot;
+            for (size_t next = (hole + 1) & mask; index[next]; next = (next + 1) & mask) {
+                size_t want = home(addresses[index[next] - 1]);
+                if (((next - want) & mask) >= ((next - hole) & mask)) {
+                    index[hole] = index[next];
+                    hole = next;
+                }
+            }
+            index[hole] = 0;
+        }
+
+        void rehash(size_t size) {
+            index.assign(size, 0);
+            for (uint32_t row = 0; row < addresses.size(); ++row)
+                index[find(addresses[row])] = row + 1;
+        }
+
+        void readRow(uint32_t row, Row &out) const {
+            out.address = addresses[row];
+            out.rssi = rssis[row];
+            out.smoothed = smoothed[row];
+            out.distance = distances[row];
+            out.lastSeen = lastSeens[row];
+            out.version = versions[row];
+            out.name = names[row];
+        }
+};
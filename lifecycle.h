@@ -0,0 +1,152 @@
+#pragma once
+
+// Deterministic teardown.  Objects that own threads, radio resources or
+// python callbacks register as a Resource, and shutdown() closes every live
+// one against a single deadline instead of leaving it to whichever thread
+// drops the last reference.
+
+#include <stdint.h>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace lifecycle {
+
+// a steady_now() value as a steady_clock time point, for wait_until
+inline std::chrono::steady_clock::time_point time_point(uint64_t ns) {
+    return std::chrono::steady_clock::time_point(
+            std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::nanoseconds(ns)));
+}
+
+class Resource {
+    public:
+        virtual ~Resource() {}
+
+        // stop, let callbacks in flight finish and join threads, giving up at
+        // deadlineNs; false if something was still running by then
+        virtual bool close(uint64_t deadlineNs) = 0;
+};
+
+// one per module instance, see ModuleState
+class Registry {
+    public:
+        void add(const std::shared_ptr<Resource> &resource) {
+            std::lock_guard<std::mutex> lock(mtx);
+            prune();
+            resources.push_back(resource);
+        }
+
+        // strong references, so nothing closes underneath the caller
+        std::vector<std::shared_ptr<Resource>> live() {
+            std::lock_guard<std::mutex> lock(mtx);
+            std::vector<std::shared_ptr<Resource>> out;
+            for (auto &weak : resources) {
+                if (auto resource = weak.lock())
+                    out.push_back(resource);
+            }
+            prune();
+            return out;
+        }
+
+    private:
+        std::mutex mtx;
+        std::vector<std::weak_ptr<Resource>> resources;
+
+        void prune() {
+            resources.erase(std::remove_if(resources.begin(), resources.end(),
+                    [](const std::weak_ptr<Resource> &weak) { return weak.expired(); }), resources.end());
+        }
+};
+
+template <class T>
+std::shared_ptr<T> track(Registry &registry, std::shared_ptr<T> resource) {
+    registry.add(resource);
+    return resource;
+}
+
+// counts callbacks in flight, so close() can wait for them to drain
+class Gate {
+    public:
+        // held for the length of one callback; false once the gate is closed.
+        // Each thread keeps a stack of the gates it holds passes on, so a
+        // callback that takes another one (a "lost" sweep calling back) is
+        // counted twice.
+        class Pass {
+            public:
+                Pass(Gate &gate) : gate(gate), open(gate.enter()) {
+                    if (open)
+                        held_gates().push_back(&gate);
+                }
+
+                ~Pass() {
+                    if (open) {
+                        held_gates().pop_back();
+                        gate.leave();
+                    }
+                }
+
+                Pass(const Pass &) = delete;
+                Pass &operator=(const Pass &) = delete;
+
+                explicit operator bool() const {
+                    return open;
+                }
+
+            private:
+                Gate &gate;
+                bool open;
+        };
+
+        // whether the calling thread is inside one of our callbacks
+        bool inside() const {
+            return held() > 0;
+        }
+
+        // lets no new callback in and waits for the ones in flight, except
+        // those the calling thread is inside of; call without the GIL
+        bool close(uint64_t deadlineNs) {
+            int own = held();
+            std::unique_lock<std::mutex> lock(mtx);
+            closed = true;
+            return idle.wait_until(lock, time_point(deadlineNs), [&] { return inFlight <= own; });
+        }
+
+    private:
+        std::mutex mtx;
+        std::condition_variable idle;
+        int inFlight = 0;
+        bool closed = false;
+
+        static std::vector<const Gate *> &held_gates() {
+            static thread_local std::vector<const Gate *> gates;
+            return gates;
+        }
+
+        // passes on this gate the calling thread holds
+        int held() const {
+            auto &gates = held_gates();
+            return (int) std::count(gates.begin(), gates.end(), this);
+        }
+
+        bool enter() {
+            std::lock_guard<std::mutex> lock(mtx);
+            if (closed)
+                return false;
+            ++inFlight;
+            return true;
+        }
+
+        void leave() {
+            {
+                std::lock_guard<std::mutex> lock(mtx);
+                --inFlight;
+            }
+            idle.notify_all();
+        }
+};
+
+}
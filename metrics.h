@@ -0,0 +1,428 @@
+#pragma once
+
+// Process-wide metrics for the bindings and event paths.
+//
+// Counters and latency histograms are sharded per thread: a thread only ever
+// writes its own shard with relaxed atomics, so recording never takes a lock
+// or contends a cache line.  Readers sum all shards into a Snapshot.  Shards
+// of exited threads are folded into a retired shard so nothing is lost.
+// Gauges are plain global atomics since they hold a level, not a rate.
+//
+// Histograms are HDR-style log-linear: values are bucketed by power of two
+// and then by the next subBits bits, giving ~6% relative precision from 1ns
+// up to ~2.4 hours (2^43 ns) in a fixed 640 slots.
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "util.h"
+
+namespace metrics {
+
+enum Counter {
+    AdapterLookups,
+    AdapterErrors,
+    ProvidersCreated,
+    ProviderErrors,
+    CharacteristicsCreated,
+    CharacteristicErrors,
+    AdvertisementsStarted,
+    AdvertisementsStopped,
+    AdvertisementErrors,
+    WatcherEventsReceived,
+    WatcherEventsDelivered,
+    WatcherEventsDropped,
+    CallbackErrors,
+    CounterCount
+};
+
+enum Gauge {
+    ActiveProviders,
+    ActiveWatchers,
+    TrackedDevices,
+    GaugeCount
+};
+
+enum Histogram {
+    AdapterLookupTime,
+    ProviderCreateTime,
+    CharacteristicCreateTime,
+    AdvertisementStartTime,
+    AdvertisementStopTime,
+    CallbackTime,
+    GilWaitTime,
+    HistogramCount
+};
+
+struct Info {
+    const char *name;
+    const char *help;
+};
+
+inline const Info &info(Counter c) {
+    static const Info infos[CounterCount] = {
+        {"adapter_lookups", "Bluetooth adapter lookups"},
+        {"adapter_errors", "Failed adapter lookups"},
+        {"providers_created", "GATT service providers created"},
+        {"provider_errors", "Failed GATT service provider creations"},
+        {"characteristics_created", "GATT characteristics created"},
+        {"characteristic_errors", "Failed GATT characteristic creations"},
+        {"advertisements_started", "Advertisement publishers and providers started"},
+        {"advertisements_stopped", "Advertisement publishers and providers stopped"},
+        {"advertisement_errors", "Advertisements that failed to start"},
+        {"watcher_events_received", "Device watcher events received from the radio stack"},
+        {"watcher_events_delivered", "Device watcher events delivered to callbacks"},
+        {"watcher_events_dropped", "Device watcher events dropped while paused, resyncing or torn down"},
+        {"callback_errors", "Python callbacks that raised"},
+    };
+    return infos[c];
+}
+
+inline const Info &info(Gauge g) {
+    static const Info infos[GaugeCount] = {
+        {"active_providers", "Live GATT service providers"},
+        {"active_watchers", "Live device watchers"},
+        {"tracked_devices", "Rows across all watcher device tables"},
+    };
+    return infos[g];
+}
+
+inline const Info &info(Histogram h) {
+    static const Info infos[HistogramCount] = {
+        {"adapter_lookup_seconds", "Time to resolve the default adapter"},
+        {"provider_create_seconds", "Time to create a GATT service provider"},
+        {"characteristic_create_seconds", "Time to create one GATT characteristic"},
+        {"advertisement_start_seconds", "Time to start advertising"},
+        {"advertisement_stop_seconds", "Time to stop advertising"},
+        {"callback_seconds", "Time spent in Python event callbacks"},
+        {"gil_wait_seconds", "Time callback threads waited for the GIL"},
+    };
+    return infos[h];
+}
+
+const int subBits = 4;
+const int magnitudes = 40;
+const int bucketCount = magnitudes << subBits;
+
+inline int bucket_of(uint64_t v) {
+    if (v < (1u << subBits))
+        return (int) v;
+    int msb = 63;
+    while (!(v >> msb))
+        --msb;
+    int mag = msb - subBits + 1;
+    if (mag >= magnitudes)
+        return bucketCount - 1;
+    return (mag << subBits) | (int) ((v >> (msb - subBits)) & ((1u << subBits) - 1));
+}
+
+// largest value that lands in the bucket
+inline uint64_t bucket_limit(int bucket) {
+    int mag = bucket >> subBits;
+    uint64_t sub = bucket & ((1u << subBits) - 1);
+    if (!mag)
+        return sub;
+    int shift = mag - 1;
+    return (((1ull << subBits) | sub) << shift) + (1ull << shift) - 1;
+}
+
+struct HistogramData {
+    uint64_t count = 0;
+    uint64_t sum = 0;
+    uint64_t min = ~(uint64_t) 0;
+    uint64_t max = 0;
+    uint64_t buckets[bucketCount] = {};
+
+    // upper bound of the bucket holding quantile q, clamped to the observed max
+    uint64_t quantile(double q) const {
+        if (!count)
+            return 0;
+        uint64_t rank = (uint64_t) (q * (count - 1)) + 1;
+        uint64_t seen = 0;
+        for (int i = 0; i < bucketCount; ++i) {
+            seen += buckets[i];
+            if (seen >= rank)
+                return bucket_limit(i) < max ? bucket_limit(i) : max;
+        }
+        return max;
+    }
+
+    void merge(const HistogramData &other) {
+        count += other.count;
+        sum += other.sum;
+        if (other.min < min) min = other.min;
+        if (other.max > max) max = other.max;
+        for (int i = 0; i < bucketCount; ++i)
+            buckets[i] += other.buckets[i];
+    }
+};
+
+struct Snapshot {
+    uint64_t counters[CounterCount] = {};
+    int64_t gauges[GaugeCount] = {};
+    HistogramData histograms[HistogramCount];
+};
+
+// single writer: plain load/store instead of a locked read-modify-write
+inline void bump(std::atomic<uint64_t> &a, uint64_t by) {
+    a.store(a.load(std::memory_order_relaxed) + by, std::memory_order_relaxed);
+}
+
+// HistogramData that one thread records into while others read it
+struct AtomicHistogram {
+    std::atomic<uint64_t> count, sum, min, max;
+    std::atomic<uint64_t> buckets[bucketCount];
+
+    AtomicHistogram() {
+        count.store(0, std::memory_order_relaxed);
+        sum.store(0, std::memory_order_relaxed);
+        min.store(~(uint64_t) 0, std::memory_order_relaxed);
+        max.store(0, std::memory_order_relaxed);
+        for (auto &b : buckets)
+            b.store(0, std::memory_order_relaxed);
+    }
+
+    void record(uint64_t v) {
+        bump(count, 1);
+        bump(sum, v);
+        if (v < min.load(std::memory_order_relaxed))
+            min.store(v, std::memory_order_relaxed);
+        if (v > max.load(std::memory_order_relaxed))
+            max.store(v, std::memory_order_relaxed);
+        bump(buckets[bucket_of(v)], 1);
+    }
+
+    void addTo(HistogramData &out) const {
+        HistogramData data;
+        data.count = count.load(std::memory_order_relaxed);
+        if (!data.count)
+            return;
+        data.sum = sum.load(std::memory_order_relaxed);
+        data.min = min.load(std::memory_order_relaxed);
+        data.max = max.load(std::memory_order_relaxed);
+        for (int b = 0; b < bucketCount; ++b)
+            data.buckets[b] = buckets[b].load(std::memory_order_relaxed);
+        out.merge(data);
+    }
+
+    void absorb(const HistogramData &in) {
+        if (!in.count)
+            return;
+        bump(count, in.count);
+        bump(sum, in.sum);
+        if (in.min < min.load(std::memory_order_relaxed))
+            min.store(in.min, std::memory_order_relaxed);
+        if (in.max > max.load(std::memory_order_relaxed))
+            max.store(in.max, std::memory_order_relaxed);
+        for (int b = 0; b < bucketCount; ++b)
+            bump(buckets[b], in.buckets[b]);
+    }
+};
+
+// one Shard per thread, summed into a Snap on demand.  Shard provides
+// addTo(Snap &) const and absorb(const Snap &); the latter folds an exiting
+// thread's totals into the retired shard, which is only written under mtx.
+template <class Shard, class Snap>
+class Sharded {
+    public:
+        Shard &local() {
+            thread_local Handle handle(this);
+            return *handle.shard;
+        }
+
+        void collect(Snap &snap) {
+            std::lock_guard<std::mutex> lock(mtx);
+            for (auto shard : shards)
+                shard->addTo(snap);
+            retired.addTo(snap);
+        }
+
+    private:
+        std::mutex mtx;
+        std::vector<Shard *> shards;
+        Shard retired;
+
+        struct Handle {
+            Sharded *owner;
+            Shard *shard;
+
+            Handle(Sharded *owner) : owner(owner), shard(new Shard()) {
+                std::lock_guard<std::mutex> lock(owner->mtx);
+                owner->shards.push_back(shard);
+            }
+
+            ~Handle() {
+                {
+                    std::lock_guard<std::mutex> lock(owner->mtx);
+                    for (size_t i = 0; i < owner->shards.size(); ++i) {
+                        if (owner->shards[i] == shard) {
+                            owner->shards[i] = owner->shards.back();
+                            owner->shards.pop_back();
+                            break;
+                        }
+                    }
+                    std::unique_ptr<Snap> snap(new Snap());
+                    shard->addTo(*snap);
+                    owner->retired.absorb(*snap);
+                }
+                delete shard;
+            }
+        };
+};
+
+class Registry {
+    public:
+        struct Shard {
+            std::atomic<uint64_t> counters[CounterCount];
+            AtomicHistogram histograms[HistogramCount];
+
+            Shard() {
+                for (auto &c : counters)
+                    c.store(0, std::memory_order_relaxed);
+            }
+
+            void addTo(Snapshot &snap) const {
+                for (int i = 0; i < CounterCount; ++i)
+                    snap.counters[i] += counters[i].load(std::memory_order_relaxed);
+                for (int i = 0; i < HistogramCount; ++i)
+                    histograms[i].addTo(snap.histograms[i]);
+            }
+
+            void absorb(const Snapshot &snap) {
+                for (int i = 0; i < CounterCount; ++i)
+                    bump(counters[i], snap.counters[i]);
+                for (int i = 0; i < HistogramCount; ++i)
+                    histograms[i].absorb(snap.histograms[i]);
+            }
+        };
+
+        static Registry &get() {
+            // leaked so threads exiting during static destruction can still retire
+            static Registry *registry = new Registry();
+            return *registry;
+        }
+
+        Shard &local() {
+            return shards.local();
+        }
+
+        std::atomic<int64_t> &gauge(Gauge g) {
+            return gauges[g];
+        }
+
+        Snapshot snapshot() {
+            Snapshot snap;
+            shards.collect(snap);
+            for (int i = 0; i < GaugeCount; ++i)
+                snap.gauges[i] = gauges[i].load(std::memory_order_relaxed);
+            return snap;
+        }
+
+    private:
+        Sharded<Shard, Snapshot> shards;
+        std::atomic<int64_t> gauges[GaugeCount];
+
+        Registry() {
+            for (auto &g : gauges)
+                g.store(0, std::memory_order_relaxed);
+        }
+};
+
+inline void count(Counter c, uint64_t by = 1) {
+    bump(Registry::get().local().counters[c], by);
+}
+
+inline void record(Histogram h, uint64_t ns) {
+    Registry::get().local().histograms[h].record(ns);
+}
+
+inline void gauge_add(Gauge g, int64_t by) {
+    Registry::get().gauge(g).fetch_add(by, std::memory_order_relaxed);
+}
+
+inline Snapshot snapshot() {
+    return Registry::get().snapshot();
+}
+
+// records the lifetime of the scope into a histogram
+class Timer {
+    public:
+        Timer(Histogram h) : hist(h), start(steady_now()) {}
+        ~Timer() { record(hist, steady_now() - start); }
+
+    private:
+        Histogram hist;
+        uint64_t start;
+};
+
+// prometheus text exposition; counters get _total, histograms are in seconds
+inline std::string prometheus(const Snapshot &snap, const char *prefix = "pywinble_") {
+    std::string out;
+    char line[256];
+    for (int i = 0; i < CounterCount; ++i) {
+        auto &meta = info((Counter) i);
+        snprintf(line, sizeof(line), "# HELP %s%s_total %s\n# TYPE %s%s_total counter\n%s%s_total %llu\n",
+                prefix, meta.name, meta.help, prefix, meta.name, prefix, meta.name,
+                (unsigned long long) snap.counters[i]);
+        out += line;
+    }
+    for (int i = 0; i < GaugeCount; ++i) {
+        auto &meta = info((Gauge) i);
+        snprintf(line, sizeof(line), "# HELP %s%s %s\n# TYPE %s%s gauge\n%s%s %lld\n",
+                prefix, meta.name, meta.help, prefix, meta.name, prefix, meta.name,
+                (long long) snap.gauges[i]);
+        out += line;
+    }
+    for (int i = 0; i < HistogramCount; ++i) {
+        auto &meta = info((Histogram) i);
+        auto &hist = snap.histograms[i];
+        snprintf(line, sizeof(line), "# HELP %s%s %s\n# TYPE %s%s histogram\n",
+                prefix, meta.name, meta.help, prefix, meta.name);
+        out += line;
+        // only the occupied buckets, cumulative as prometheus expects
+        uint64_t seen = 0;
+        for (int b = 0; b < bucketCount; ++b) {
+            if (!hist.buckets[b])
+                continue;
+            seen += hist.buckets[b];
+            snprintf(line, sizeof(line), "%s%s_bucket{le=\"%.9g\"} %llu\n",
+                    prefix, meta.name, bucket_limit(b) / 1e9, (unsigned long long) seen);
+            out += line;
+        }
+        snprintf(line, sizeof(line), "%s%s_bucket{le=\"+Inf\"} %llu\n%s%s_sum %.9g\n%s%s_count %llu\n",
+                prefix, meta.name, (unsigned long long) hist.count,
+                prefix, meta.name, hist.sum / 1e9,
+                prefix, meta.name, (unsigned long long) hist.count);
+        out += line;
+    }
+    return out;
+}
+
+// writes next to the target and renames, so scrapers never see a partial file
+inline bool export_prometheus(const std::string &path, const Snapshot &snap) {
+    std::string tmp = path + ".tmp";
+    FILE *f = fopen(tmp.c_str(), "wb");
+    if (!f)
+        return false;
+    std::string text = prometheus(snap);
+    bool ok = fwrite(text.data(), 1, text.size(), f) == text.size();
+    ok = fclose(f) == 0 && ok;
+    if (ok) {
+#ifdef _WIN32
+        // rename won't replace an existing file on windows
+        remove(path.c_str());
+#endif
+        ok = rename(tmp.c_str(), path.c_str()) == 0;
+    }
+    if (!ok)
+        remove(tmp.c_str());
+    return ok;
+}
+
+}
@@ -53,6 +53,14 @@ struct dynamic_attr { };
 /// Annotation which enables the buffer protocol for a type
 struct buffer_protocol { };
 
+/// Annotation which keeps up to `max_free` freed instances of a type for reuse by the next ones
+/// created, instead of handing each back to the allocator.  Off unless given; the kept instances
+/// are released at interpreter exit.  Can't be combined with `dynamic_attr`.
+struct instance_pool {
+    size_t max_free;
+    explicit instance_pool(size_t max_free = 256) : max_free(max_free) { }
+};
+
 /// Annotation which requests that a special metaclass is created for a type
 struct metaclass {
     handle value;
@@ -130,11 +138,62 @@ struct argument_record {
         : name(name), descr(descr), value(value), convert(convert), none(none) { }
 };
 
+struct function_record;
+
+/// Which overload recently took a positional call with given argument types, and in which pass,
+/// so the dispatcher can try it before walking the chain.  Lives on the first record of an
+/// overload chain and is dropped when an overload is added.  A hit tries that overload alone, so
+/// the dispatcher only remembers one when the overloads resolution would have tried first turned
+/// the arguments down by their types (see function_record::loads_by_type): an int too large for an
+/// int32 overload must not send the next, smaller int past it.
+struct overload_cache {
+    static constexpr size_t slots = 4;
+    static constexpr size_t max_args = 6;
+
+    struct entry {
+        PyTypeObject *types[max_args];
+        size_t nargs = 0;
+        function_record *overload = nullptr;
+        bool convert = false;
+    };
+
+    const entry *find(PyObject *const *args, size_t nargs) const {
+        if (nargs > max_args)
+            return nullptr;
+        for (auto &e : entries) {
+            if (!e.overload || e.nargs != nargs)
+                continue;
+            size_t i = 0;
+            while (i < nargs && Py_TYPE(args[i]) == e.types[i])
+                ++i;
+            if (i == nargs)
+                return &e;
+        }
+        return nullptr;
+    }
+
+    void remember(PyObject *const *args, size_t nargs, function_record *overload, bool convert) {
+        if (nargs > max_args)
+            return;
+        auto found = const_cast<entry *>(find(args, nargs));
+        entry &e = found ? *found : entries[next++ % slots];
+        for (size_t i = 0; i < nargs; ++i)
+            e.types[i] = Py_TYPE(args[i]);
+        e.nargs = nargs;
+        e.overload = overload;
+        e.convert = convert;
+    }
+
+private:
+    entry entries[slots];
+    size_t next = 0;
+};
+
 /// Internal data structure which holds metadata about a bound function (signature, overloads, etc.)
 struct function_record {
     function_record()
         : is_constructor(false), is_new_style_constructor(false), is_stateless(false),
-          is_operator(false), has_args(false), has_kwargs(false), is_method(false) { }
+          is_operator(false), has_args(false), has_kwargs(false), is_method(false), loads_by_type(false) { }
 
     /// Function name
     char *name = nullptr; /* why no C++ strings? They generate heavier code.. */
@@ -181,6 +240,10 @@ struct function_record {
     /// True if this is a method
     bool is_method : 1;
 
+    /// True if every argument is a registered class, so the no-convert pass accepts or rejects
+    /// the arguments by their types alone
+    bool loads_by_type : 1;
+
     /// Number of arguments (including py::args and/or py::kwargs, if present)
     std::uint16_t nargs;
 
@@ -195,6 +258,9 @@ struct function_record {
 
     /// Pointer to next overload
     function_record *next = nullptr;
+
+    /// Overloads that took recent calls, on the first record of a chain
+    std::unique_ptr<overload_cache> cache;
 };
 
 /// Special data structure which (temporarily) holds metadata about a bound class
@@ -250,6 +316,9 @@ struct type_record {
     /// Is the class definition local to the module shared object?
     bool module_local : 1;
 
+    /// Freed instances to keep for reuse (0: no pool)
+    size_t pool_size = 0;
+
     PYBIND11_NOINLINE void add_base(const std::type_info &base, void *(*caster)(void *)) {
         auto base_info = detail::get_type_info(base, false);
         if (!base_info) {
@@ -417,6 +486,11 @@ struct process_attribute<buffer_protocol> : process_attribute_default<buffer_pro
     static void init(const buffer_protocol &, type_record *r) { r->buffer_protocol = true; }
 };
 
+template <>
+struct process_attribute<instance_pool> : process_attribute_default<instance_pool> {
+    static void init(const instance_pool &p, type_record *r) { r->pool_size = p.max_free; }
+};
+
 template <>
 struct process_attribute<metaclass> : process_attribute_default<metaclass> {
     static void init(const metaclass &m, type_record *r) { r->metaclass = m.value; }
@@ -435,14 +435,29 @@ PYBIND11_NOINLINE inline std::string error_string() {
             trace = trace->tb_next;
 
         PyFrameObject *frame = trace->tb_frame;
+        Py_XINCREF(frame);
         errorString += "\n\nAt:\n";
         while (frame) {
+#if PY_VERSION_HEX >= 0x03090000
+            PyCodeObject *f_code = PyFrame_GetCode(frame);
+#else
+            PyCodeObject *f_code = frame->f_code;
+            Py_INCREF(f_code);
+#endif
             int lineno = PyFrame_GetLineNumber(frame);
             errorString +=
-                "  " + handle(frame->f_code->co_filename).cast<std::string>() +
+                "  " + handle(f_code->co_filename).cast<std::string>() +
                 "(" + std::to_string(lineno) + "): " +
-                handle(frame->f_code->co_name).cast<std::string>() + "\n";
-            frame = frame->f_back;
+                handle(f_code->co_name).cast<std::string>() + "\n";
+#if PY_VERSION_HEX >= 0x03090000
+            PyFrameObject *b_frame = PyFrame_GetBack(frame);
+#else
+            PyFrameObject *b_frame = frame->f_back;
+            Py_XINCREF(b_frame);
+#endif
+            Py_DECREF(f_code);
+            Py_DECREF(frame);
+            frame = b_frame;
         }
     }
 #endif
@@ -451,15 +466,13 @@ PYBIND11_NOINLINE inline std::string error_string() {
 }
 
 PYBIND11_NOINLINE inline handle get_object_handle(const void *ptr, const detail::type_info *type ) {
-    auto &instances = get_internals().registered_instances;
-    auto range = instances.equal_range(ptr);
-    for (auto it = range.first; it != range.second; ++it) {
-        for (auto vh : values_and_holders(it->second)) {
+    return handle((PyObject *) get_internals().registered_instances.find_if(ptr, [type](instance *inst) {
+        for (auto vh : values_and_holders(inst)) {
             if (vh.type == type)
-                return handle((PyObject *) it->second);
+                return true;
         }
-    }
-    return handle();
+        return false;
+    }));
 }
 
 inline PyThreadState *get_thread_state_unchecked() {
@@ -504,13 +517,15 @@ public:
         if (src == nullptr)
             return none().release();
 
-        auto it_instances = get_internals().registered_instances.equal_range(src);
-        for (auto it_i = it_instances.first; it_i != it_instances.second; ++it_i) {
-            for (auto instance_type : detail::all_type_info(Py_TYPE(it_i->second))) {
+        auto existing = get_internals().registered_instances.find_if(src, [tinfo](instance *inst) {
+            for (auto instance_type : detail::all_type_info(Py_TYPE(inst))) {
                 if (instance_type && same_type(*instance_type->cpptype, *tinfo->cpptype))
-                    return handle((PyObject *) it_i->second).inc_ref();
+                    return true;
             }
-        }
+            return false;
+        });
+        if (existing)
+            return handle((PyObject *) existing).inc_ref();
 
         auto inst = reinterpret_steal<object>(make_new_instance(tinfo->type));
         auto wrapper = reinterpret_cast<instance *>(inst.ptr());
@@ -1182,6 +1197,22 @@ template <typename StringType, bool IsView = false> struct string_caster {
 #endif
         }
 
+#if PY_MAJOR_VERSION >= 3 && !defined(PYPY_VERSION)
+        // Use the UTF-8 the str already has where we can: an ASCII str stores its text as
+        // UTF-8, and a view can point at the copy CPython caches on the object, which lives
+        // as long as the str does.  Other std::strings still encode, so that loading one
+        // doesn't leave a cached copy behind on every non-ASCII argument.
+        if (UTF_N == 8 && (IsView || PyUnicode_IS_COMPACT_ASCII(load_src.ptr()))) {
+            Py_ssize_t size;
+            const char *utf8 = PyUnicode_AsUTF8AndSize(load_src.ptr(), &size);
+            if (!utf8) { PyErr_Clear(); return false; }
+            value = StringType(reinterpret_cast<const CharT *>(utf8), (size_t) size);
+            if (IsView)
+                loader_life_support::add_patient(load_src);
+            return true;
+        }
+#endif
+
         object utfNbytes = reinterpret_steal<object>(PyUnicode_AsEncodedString(
             load_src.ptr(), UTF_N == 8 ? "utf-8" : UTF_N == 16 ? "utf-16" : "utf-32", nullptr));
         if (!utfNbytes) { PyErr_Clear(); return false; }
@@ -1264,6 +1295,9 @@ template <typename CharT> struct type_caster<CharT, enable_if_t<is_std_char_type
     StringCaster str_caster;
     bool none = false;
     CharT one_char = 0;
+    // a str's own UTF-8, for CharT == char; str_caster is left empty then
+    const char *utf8 = nullptr;
+    Py_ssize_t utf8_size = 0;
 public:
     bool load(handle src, bool convert) {
         if (!src) return false;
@@ -1273,6 +1307,14 @@ public:
             none = true;
             return true;
         }
+#if PY_MAJOR_VERSION >= 3 && !defined(PYPY_VERSION)
+        // The argument outlives the call, and with it the UTF-8 CPython keeps on it
+        if (std::is_same<CharT, char>::value && PyUnicode_Check(src.ptr())) {
+            utf8 = PyUnicode_AsUTF8AndSize(src.ptr(), &utf8_size);
+            if (!utf8) { PyErr_Clear(); return false; }
+            return true;
+        }
+#endif
         return str_caster.load(src, convert);
     }
 
@@ -1290,11 +1332,17 @@ public:
         return StringCaster::cast(StringType(1, src), policy, parent);
     }
 
-    operator CharT*() { return none ? nullptr : const_cast<CharT *>(static_cast<StringType &>(str_caster).c_str()); }
+    operator CharT*() {
+        if (none) return nullptr;
+        if (utf8) return reinterpret_cast<CharT *>(const_cast<char *>(utf8));
+        return const_cast<CharT *>(static_cast<StringType &>(str_caster).c_str());
+    }
     operator CharT&() {
         if (none)
             throw value_error("Cannot convert None to a character");
 
+        if (utf8)
+            static_cast<StringType &>(str_caster).assign(reinterpret_cast<const CharT *>(utf8), (size_t) utf8_size);
         auto &value = static_cast<StringType &>(str_caster);
         size_t str_len = value.size();
         if (str_len == 0)
@@ -1848,11 +1896,11 @@ struct function_call {
     /// The function data:
     const function_record &func;
 
-    /// Arguments passed to the function:
-    std::vector<handle> args;
+    /// Arguments passed to the function (inline up to 6, the rest on the heap):
+    small_vector<handle, 6> args;
 
     /// The `convert` value the arguments should be loaded with
-    std::vector<bool> args_convert;
+    small_vector<bool, 6> args_convert;
 
     /// Extra references for the optional `py::args` and/or `py::kwargs` arguments (which, if
     /// present, are also in `args` but without a reference).
@@ -1885,6 +1933,10 @@ public:
     static constexpr bool has_kwargs = kwargs_pos < 0;
     static constexpr bool has_args = args_pos < 0;
 
+    /// Every argument is a registered class, so whether they load without conversions depends
+    /// on their Python types alone, never on their values
+    static constexpr bool loads_by_type = all_of<std::is_base_of<type_caster_generic, make_caster<Args>>...>::value;
+
     static constexpr auto arg_names = concat(type_descr(make_caster<Args>::name)...);
 
     bool load_args(function_call &call) {
@@ -219,15 +219,9 @@ inline bool register_instance_impl(void *ptr, instance *self) {
     return true; // unused, but gives the same signature as the deregister func
 }
 inline bool deregister_instance_impl(void *ptr, instance *self) {
-    auto &registered_instances = get_internals().registered_instances;
-    auto range = registered_instances.equal_range(ptr);
-    for (auto it = range.first; it != range.second; ++it) {
-        if (Py_TYPE(self) == Py_TYPE(it->second)) {
-            registered_instances.erase(it);
-            return true;
-        }
-    }
-    return false;
+    return get_internals().registered_instances.erase_if(ptr, [self](instance *inst) {
+        return Py_TYPE(self) == Py_TYPE(inst);
+    });
 }
 
 inline void register_instance(instance *self, void *valptr, const type_info *tinfo) {
@@ -265,6 +259,75 @@ inline PyObject *make_new_instance(PyTypeObject *type) {
     return self;
 }
 
+/// The allocator behind `py::instance_pool`: `tp_alloc`/`tp_free` for one class_, keeping freed
+/// instances on a free list chained through their first word.  Only ever touched with the GIL held.
+/// pybind11 subclasses inherit these slots and share the list; a subclass whose instances aren't
+/// a plain `instance` (one with a `__dict__`) falls through to the default allocator.
+template <typename T> struct instance_free_list {
+    static void *head;
+    static size_t size, limit;
+
+    static bool poolable(PyTypeObject *type) {
+        return !PyType_IS_GC(type) && type->tp_basicsize == static_cast<ssize_t>(sizeof(instance));
+    }
+
+    static PyObject *alloc(PyTypeObject *type, ssize_t nitems) {
+        if (nitems != 0 || !poolable(type))
+            return PyType_GenericAlloc(type, nitems);
+        void *block = head;
+        if (block) {
+            head = *static_cast<void **>(block);
+            --size;
+        } else if (!(block = PyObject_Malloc(sizeof(instance)))) {
+            return PyErr_NoMemory();
+        }
+        std::memset(block, 0, sizeof(instance));
+#if PY_VERSION_HEX < 0x03080000
+        if (type->tp_flags & Py_TPFLAGS_HEAPTYPE)
+            Py_INCREF(type);
+#endif
+        return PyObject_Init(static_cast<PyObject *>(block), type);
+    }
+
+    // called by pybind11_object_dealloc before it drops the type reference, so Py_TYPE is valid
+    static void free(void *self) {
+        auto type = Py_TYPE(static_cast<PyObject *>(self));
+        if (PyType_IS_GC(type)) {
+            PyObject_GC_Del(self);
+        } else if (size >= limit || !poolable(type)) {
+            PyObject_Free(self);
+        } else {
+            *static_cast<void **>(self) = head;
+            head = self;
+            ++size;
+        }
+    }
+
+    /// Hands every kept instance back to the allocator, and the ones freed from now on too;
+    /// class_ registers it with atexit, so nothing is held past interpreter shutdown
+    static void clear() {
+        limit = 0;
+        while (head) {
+            void *next = *static_cast<void **>(head);
+            PyObject_Free(head);
+            head = next;
+        }
+        size = 0;
+    }
+
+    static void install(PyTypeObject *type, size_t max_free) {
+        if (!poolable(type))
+            pybind11_fail(std::string(type->tp_name) + ": instance_pool can't be combined with dynamic_attr");
+        limit = max_free;
+        type->tp_alloc = alloc;
+        type->tp_free = free;
+    }
+};
+
+template <typename T> void *instance_free_list<T>::head = nullptr;
+template <typename T> size_t instance_free_list<T>::size = 0;
+template <typename T> size_t instance_free_list<T>::limit = 0;
+
 /// Instance creation function for all pybind11 types. It only allocates space for the
 /// C++ object, but doesn't call the constructor -- an `__init__` function must do that.
 extern "C" inline PyObject *pybind11_object_new(PyTypeObject *type, PyObject *, PyObject *) {
@@ -447,6 +510,8 @@ inline void enable_dynamic_attributes(PyHeapTypeObject *heap_type) {
                                                "conjunction with PyPy!");
 #endif
     type->tp_flags |= Py_TPFLAGS_HAVE_GC;
+    // python only picks this itself when the base frees with PyObject_Free, not an instance_pool's
+    type->tp_free = PyObject_GC_Del;
     type->tp_dictoffset = type->tp_basicsize; // place dict at the end
     type->tp_basicsize += (ssize_t)sizeof(PyObject *); // and allocate enough space for it
     type->tp_traverse = pybind11_traverse;
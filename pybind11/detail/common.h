@@ -207,6 +207,10 @@ extern "C" {
 }
 #endif
 
+#if PY_VERSION_HEX >= 0x03070000
+#  define PYBIND11_VECTORCALL // bound functions take METH_FASTCALL arguments
+#endif
+
 #define PYBIND11_TRY_NEXT_OVERLOAD ((PyObject *) 1) // special failure return code
 #define PYBIND11_STRINGIFY(x) #x
 #define PYBIND11_TOSTRING(x) PYBIND11_STRINGIFY(x)
@@ -800,6 +804,91 @@ public:
     const std::vector<T> *operator->() const { return &v; }
 };
 
+// Vector of trivially copyable values that keeps the first N inline and only goes to the heap
+// beyond that; per-call scratch space such as function_call's arguments, so that an ordinary
+// call doesn't allocate.
+template <typename T, size_t N>
+class small_vector {
+public:
+    small_vector() = default;
+    small_vector(const small_vector &other) { *this = other; }
+    small_vector(small_vector &&other) noexcept { *this = std::move(other); }
+
+    small_vector &operator=(const small_vector &other) {
+        if (this != &other) {
+            size_ = 0;
+            reserve(other.size_);
+            for (size_t i = 0; i < other.size_; ++i)
+                data()[i] = other[i];
+            size_ = other.size_;
+        }
+        return *this;
+    }
+
+    small_vector &operator=(small_vector &&other) noexcept {
+        if (this != &other) {
+            if (other.heap) {
+                heap = std::move(other.heap);
+                capacity_ = other.capacity_;
+            } else {
+                heap.reset();
+                capacity_ = N;
+                for (size_t i = 0; i < other.size_; ++i)
+                    local[i] = other.local[i];
+            }
+            size_ = other.size_;
+            other.size_ = 0;
+            other.capacity_ = N;
+        }
+        return *this;
+    }
+
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+    T *data() { return heap ? heap.get() : local; }
+    const T *data() const { return heap ? heap.get() : local; }
+    T *begin() { return data(); }
+    T *end() { return data() + size_; }
+    const T *begin() const { return data(); }
+    const T *end() const { return data() + size_; }
+    T &operator[](size_t i) { return data()[i]; }
+    const T &operator[](size_t i) const { return data()[i]; }
+
+    void reserve(size_t n) {
+        if (n <= capacity_)
+            return;
+        std::unique_ptr<T[]> grown(new T[n]);
+        for (size_t i = 0; i < size_; ++i)
+            grown[i] = data()[i];
+        heap = std::move(grown);
+        capacity_ = n;
+    }
+
+    void resize(size_t n, const T &value = T()) {
+        reserve(n);
+        for (size_t i = size_; i < n; ++i)
+            data()[i] = value;
+        size_ = n;
+    }
+
+    void push_back(const T &value) {
+        if (size_ == capacity_)
+            reserve(2 * capacity_);
+        data()[size_++] = value;
+    }
+
+    void swap(small_vector &other) noexcept {
+        small_vector tmp(std::move(other));
+        other = std::move(*this);
+        *this = std::move(tmp);
+    }
+
+private:
+    T local[N];
+    std::unique_ptr<T[]> heap;
+    size_t size_ = 0, capacity_ = N;
+};
+
 NAMESPACE_END(detail)
 
 
@@ -80,13 +80,112 @@ struct overload_hash {
     }
 };
 
+/// Open-addressing multimap from a C++ object's address to the Python instances wrapping it,
+/// consulted on every cast of a registered type and updated on every construction and
+/// destruction.  An address almost always has exactly one instance, so key and value sit
+/// side by side in one flat array and a lookup is usually a single probe.  Linear probing,
+/// at most half full; erase shifts later entries back instead of leaving tombstones.
+class instance_map {
+public:
+    instance_map() = default;
+    instance_map(const instance_map &) = delete;
+    instance_map &operator=(const instance_map &) = delete;
+    ~instance_map() { delete[] slots; }
+
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+
+    void emplace(const void *key, instance *value) {
+        if ((count + 1) * 2 > capacity)
+            rehash(capacity ? capacity * 2 : 16);
+        size_t i = home(key);
+        while (slots[i].key)
+            i = next(i);
+        slots[i].key = key;
+        slots[i].value = value;
+        ++count;
+    }
+
+    /// The first instance at `key` for which `pred` returns true, or nullptr
+    template <typename Pred> instance *find_if(const void *key, Pred &&pred) const {
+        if (!count)
+            return nullptr;
+        for (size_t i = home(key); slots[i].key; i = next(i)) {
+            if (slots[i].key == key && pred(slots[i].value))
+                return slots[i].value;
+        }
+        return nullptr;
+    }
+
+    /// Removes the first instance at `key` for which `pred` returns true
+    template <typename Pred> bool erase_if(const void *key, Pred &&pred) {
+        if (!count)
+            return false;
+        for (size_t i = home(key); slots[i].key; i = next(i)) {
+            if (slots[i].key == key && pred(slots[i].value)) {
+                erase_at(i);
+                return true;
+            }
+        }
+        return false;
+    }
+
+private:
+    struct slot {
+        const void *key = nullptr;
+        instance *value = nullptr;
+    };
+
+    slot *slots = nullptr;
+    size_t capacity = 0, count = 0;
+    unsigned shift = 64;
+
+    size_t next(size_t i) const { return (i + 1) & (capacity - 1); }
+
+    // Fibonacci hashing: the multiply mixes the address bits that vary into the top bits,
+    // which alignment would otherwise leave clustered
+    size_t home(const void *key) const {
+        return (size_t) (((uint64_t) (uintptr_t) key * 0x9E3779B97F4A7C15ull) >> shift);
+    }
+
+    void erase_at(size_t hole) {
+        for (size_t i = next(hole); slots[i].key; i = next(i)) {
+            // an entry can fill the hole unless its home lies cyclically in (hole, i]
+            size_t h = home(slots[i].key);
+            bool stays = hole <= i ? (hole < h && h <= i) : (hole < h || h <= i);
+            if (!stays) {
+                slots[hole] = slots[i];
+                hole = i;
+            }
+        }
+        slots[hole] = slot();
+        --count;
+    }
+
+    void rehash(size_t new_capacity) {
+        slot *old = slots;
+        size_t old_capacity = capacity;
+        slots = new slot[new_capacity];
+        capacity = new_capacity;
+        shift = 64;
+        for (size_t c = new_capacity; c > 1; c >>= 1)
+            --shift;
+        count = 0;
+        for (size_t i = 0; i < old_capacity; ++i) {
+            if (old[i].key)
+                emplace(old[i].key, old[i].value);
+        }
+        delete[] old;
+    }
+};
+
 /// Internal data structure used to track registered instances and types.
 /// Whenever binary incompatible changes are made to this structure,
 /// `PYBIND11_INTERNALS_VERSION` must be incremented.
 struct internals {
     type_map<type_info *> registered_types_cpp; // std::type_index -> pybind11's type information
     std::unordered_map<PyTypeObject *, std::vector<type_info *>> registered_types_py; // PyTypeObject* -> base type_info(s)
-    std::unordered_multimap<const void *, instance*> registered_instances; // void * -> instance*
+    instance_map registered_instances; // void * -> instance*
     std::unordered_set<std::pair<const PyObject *, const char *>, overload_hash> inactive_overload_cache;
     type_map<std::vector<bool (*)(PyObject *, void *&)>> direct_conversions;
     std::unordered_map<const PyObject *, std::vector<PyObject *>> patients;
@@ -129,8 +228,10 @@ struct type_info {
     bool module_local : 1;
 };
 
-/// Tracks the `internals` and `type_info` ABI version independent of the main library version
-#define PYBIND11_INTERNALS_VERSION 2
+/// Tracks the `internals` and `type_info` ABI version independent of the main library version.
+/// The "_pywinble" part keeps this copy, whose registered_instances is an instance_map, from
+/// sharing internals with an unmodified pybind11 module of the same version.
+#define PYBIND11_INTERNALS_VERSION 2_pywinble
 
 #if defined(WITH_THREAD)
 #  define PYBIND11_INTERNALS_KIND ""
@@ -183,7 +284,9 @@ PYBIND11_NOINLINE inline internals &get_internals() {
         auto *&internals_ptr = *internals_pp;
         internals_ptr = new internals();
 #if defined(WITH_THREAD)
+    #if PY_VERSION_HEX < 0x03090000
         PyEval_InitThreads();
+    #endif
         PyThreadState *tstate = PyThreadState_Get();
         #if PY_VERSION_HEX >= 0x03070000
             internals_ptr->tstate = PyThread_tss_alloc();
@@ -15,6 +15,114 @@
 NAMESPACE_BEGIN(PYBIND11_NAMESPACE)
 NAMESPACE_BEGIN(detail)
 
+/* The Python callable inside a std::function.  Copies and the final release can happen on
+   threads that don't hold the GIL, so both take it.  From Python 3.8 the callable's
+   vectorcall entry point is looked up once here rather than on every call. */
+struct func_handle {
+    function f;
+#if PY_VERSION_HEX >= 0x03080000
+    vectorcallfunc vectorcall = nullptr;
+#endif
+
+    explicit func_handle(function f_) : f(std::move(f_)) {
+#if PY_VERSION_HEX >= 0x03090000
+        vectorcall = PyVectorcall_Function(f.ptr());
+#elif PY_VERSION_HEX >= 0x03080000
+        vectorcall = _PyVectorcall_Function(f.ptr());
+#endif
+    }
+
+    func_handle(const func_handle &other) {
+        gil_scoped_acquire acq;
+        f = other.f;
+#if PY_VERSION_HEX >= 0x03080000
+        vectorcall = other.vectorcall;
+#endif
+    }
+
+    func_handle(func_handle &&) = default;
+
+    ~func_handle() {
+        if (!f)
+            return;
+        // a std::function that outlived the interpreter: nothing left to release into
+        if (!Py_IsInitialized()) {
+            f.release();
+            return;
+        }
+        gil_scoped_acquire acq;
+        function kill_f(std::move(f));
+    }
+};
+
+/* What a std::function made from a Python callable runs: arguments are converted onto the
+   stack and passed by vectorcall, the GIL is only taken when the caller doesn't hold it
+   already, and a void function never converts the result. */
+template <typename Return, typename... Args>
+struct func_wrapper {
+    func_handle hfunc;
+
+    explicit func_wrapper(func_handle &&hf) : hfunc(std::move(hf)) {}
+
+    Return operator()(Args... args) const {
+        if (PyGILState_Check())
+            return call(std::forward<Args>(args)...);
+        gil_scoped_acquire acq;
+        return call(std::forward<Args>(args)...);
+    }
+
+private:
+    Return call(Args... args) const {
+        // one spare slot, so that a function without arguments still has an array
+        object values[] = {reinterpret_steal<object>(make_caster<Args>::cast(
+            std::forward<Args>(args), return_value_policy::automatic_reference, nullptr))..., object()};
+        constexpr size_t n = sizeof...(Args);
+        for (size_t i = 0; i < n; ++i) {
+            if (!values[i]) {
+#if defined(NDEBUG)
+                throw cast_error("Unable to convert call argument to Python object (compile in debug mode for details)");
+#else
+                std::array<std::string, n + 1> names {{type_id<Args>()..., std::string()}};
+                throw cast_error("Unable to convert call argument '" + std::to_string(i) +
+                                 "' of type '" + names[i] + "' to Python object");
+#endif
+            }
+        }
+#if PY_VERSION_HEX >= 0x03080000
+        // slot 0 is scratch space the callee may use to prepend self
+        PyObject *argv[n + 1];
+        argv[0] = nullptr;
+        for (size_t i = 0; i < n; ++i)
+            argv[i + 1] = values[i].ptr();
+        size_t nargsf = n | PY_VECTORCALL_ARGUMENTS_OFFSET;
+#  if PY_VERSION_HEX >= 0x03090000
+        PyObject *result = hfunc.vectorcall ? hfunc.vectorcall(hfunc.f.ptr(), argv + 1, nargsf, nullptr)
+                                            : PyObject_Vectorcall(hfunc.f.ptr(), argv + 1, nargsf, nullptr);
+#  else
+        PyObject *result = hfunc.vectorcall ? hfunc.vectorcall(hfunc.f.ptr(), argv + 1, nargsf, nullptr)
+                                            : _PyObject_Vectorcall(hfunc.f.ptr(), argv + 1, nargsf, nullptr);
+#  endif
+#else
+        tuple argtuple(n);
+        for (size_t i = 0; i < n; ++i)
+            PyTuple_SET_ITEM(argtuple.ptr(), (ssize_t) i, values[i].release().ptr());
+        PyObject *result = PyObject_Call(hfunc.f.ptr(), argtuple.ptr(), nullptr);
+#endif
+        if (!result)
+            throw error_already_set();
+        return finish(reinterpret_steal<object>(result));
+    }
+
+    template <typename R = Return>
+    static enable_if_t<std::is_void<R>::value, R> finish(object &&) {}
+
+    template <typename R = Return>
+    static enable_if_t<!std::is_void<R>::value, R> finish(object &&retval) {
+        /* Visual studio 2015 parser issue: need parentheses around this expression */
+        return (retval.template cast<R>());
+    }
+};
+
 template <typename Return, typename... Args>
 struct type_caster<std::function<Return(Args...)>> {
     using type = std::function<Return(Args...)>;
@@ -54,12 +162,7 @@ public:
             }
         }
 
-        value = [func](Args... args) -> Return {
-            gil_scoped_acquire acq;
-            object retval(func(std::forward<Args>(args)...));
-            /* Visual studio 2015 parser issue: need parentheses around this expression */
-            return (retval.template cast<Return>());
-        };
+        value = func_wrapper<Return, Args...>(func_handle(std::move(func)));
         return true;
     }
 
@@ -172,6 +172,7 @@ protected:
 
         if (cast_in::has_args) rec->has_args = true;
         if (cast_in::has_kwargs) rec->has_kwargs = true;
+        if (cast_in::loads_by_type) rec->loads_by_type = true;
 
         /* Stash some additional information used by an important optimization in 'functional.h' */
         using FunctionType = Return (*)(Args...);
@@ -306,8 +307,13 @@ protected:
             rec->def = new PyMethodDef();
             std::memset(rec->def, 0, sizeof(PyMethodDef));
             rec->def->ml_name = rec->name;
+#if defined(PYBIND11_VECTORCALL)
+            rec->def->ml_meth = reinterpret_cast<PyCFunction>(reinterpret_cast<void (*) (void)>(*vectorcall_dispatcher));
+            rec->def->ml_flags = METH_FASTCALL | METH_KEYWORDS;
+#else
             rec->def->ml_meth = reinterpret_cast<PyCFunction>(reinterpret_cast<void (*) (void)>(*dispatcher));
             rec->def->ml_flags = METH_VARARGS | METH_KEYWORDS;
+#endif
 
             capsule rec_capsule(rec, [](void *ptr) {
                 destruct((detail::function_record *) ptr);
@@ -330,6 +336,7 @@ protected:
             m_ptr = rec->sibling.ptr();
             inc_ref();
             chain_start = chain;
+            chain->cache.reset();
             if (chain->is_method != rec->is_method)
                 pybind11_fail("overloading a method with both static and instance methods is not supported; "
                     #if defined(NDEBUG)
@@ -415,6 +422,172 @@ protected:
         }
     }
 
+    static void append_note_if_missing_header_is_suspected(std::string &msg) {
+        if (msg.find("std::") != std::string::npos) {
+            msg += "\n\n"
+                   "Did you forget to `#include <pybind11/stl.h>`? Or <pybind11/complex.h>,\n"
+                   "<pybind11/functional.h>, <pybind11/chrono.h>, etc. Some automatic\n"
+                   "conversions are optional and require extra headers to be included\n"
+                   "when compiling your pybind11 module.";
+        }
+    }
+
+    static PyObject *return_value_error(const detail::function_record &func) {
+        std::string msg = "Unable to convert function return value to a "
+                          "Python type! The signature was\n\t";
+        msg += func.signature;
+        append_note_if_missing_header_is_suspected(msg);
+        PyErr_SetString(PyExc_TypeError, msg.c_str());
+        return nullptr;
+    }
+
+    /* When an exception is caught, give each registered exception
+       translator a chance to translate it to a Python exception
+       in reverse order of registration.
+
+       A translator may choose to do one of the following:
+
+        - catch the exception and call PyErr_SetString or PyErr_SetObject
+          to set a standard (or custom) Python exception, or
+        - do nothing and let the exception fall through to the next translator, or
+        - delegate translation to the next translator by throwing a new type of exception. */
+    static PyObject *translate_exception(std::exception_ptr last_exception) {
+        auto &registered_exception_translators = detail::get_internals().registered_exception_translators;
+        for (auto& translator : registered_exception_translators) {
+            try {
+                translator(last_exception);
+            } catch (...) {
+                last_exception = std::current_exception();
+                continue;
+            }
+            return nullptr;
+        }
+        PyErr_SetString(PyExc_SystemError, "Exception escaped from default exception translator!");
+        return nullptr;
+    }
+
+#if defined(PYBIND11_VECTORCALL)
+    /// METH_FASTCALL entry point: a single overload, or the one that took the same argument
+    /// types last time, is called straight from the argument array; anything else is packed
+    /// into a tuple and dict for dispatcher()
+    static PyObject *vectorcall_dispatcher(PyObject *self, PyObject *const *args_in, Py_ssize_t nargs,
+                                           PyObject *kwnames) {
+        auto func = (detail::function_record *) PyCapsule_GetPointer(self, nullptr);
+        const size_t n_kwargs = kwnames ? (size_t) PyTuple_GET_SIZE(kwnames) : 0;
+
+        detail::function_record *direct = nullptr;
+        bool convert = true;
+        if (!func->next) {
+            if (!func->is_constructor && !func->has_args && !func->has_kwargs)
+                direct = func;
+        } else if (func->cache && n_kwargs == 0) {
+            if (auto hit = func->cache->find(args_in, (size_t) nargs)) {
+                direct = hit->overload;
+                convert = hit->convert;
+            }
+        }
+
+        if (direct) {
+            try {
+                PyObject *result = fast_dispatch(*direct, args_in, (size_t) nargs, kwnames, convert);
+                if (result != PYBIND11_TRY_NEXT_OVERLOAD)
+                    return result;
+            } catch (error_already_set &e) {
+                e.restore();
+                return nullptr;
+            } catch (...) {
+                return translate_exception(std::current_exception());
+            }
+        }
+
+        // overloads, constructors, *args/**kwargs, and the error report for
+        // arguments the fast path couldn't load
+        tuple args((size_t) nargs);
+        for (size_t i = 0; i < (size_t) nargs; ++i)
+            PyTuple_SET_ITEM(args.ptr(), i, handle(args_in[i]).inc_ref().ptr());
+        dict kwargs;
+        for (size_t i = 0; i < n_kwargs; ++i) {
+            if (PyDict_SetItem(kwargs.ptr(), PyTuple_GET_ITEM(kwnames, i), args_in[nargs + i]) != 0)
+                return nullptr;
+        }
+        return dispatcher(self, args.ptr(), n_kwargs ? kwargs.ptr() : nullptr);
+    }
+
+    /// Loads the arguments of one overload from positionals, keywords and defaults and calls
+    /// it, with conversions if `convert`.  PYBIND11_TRY_NEXT_OVERLOAD when they don't fit,
+    /// before or instead of the call, so the caller can retry through dispatcher() and
+    /// report the mismatch the usual way
+    static PyObject *fast_dispatch(detail::function_record &func, PyObject *const *args_in, size_t n_args_in,
+                                   PyObject *kwnames, bool convert) {
+        using namespace detail;
+        const size_t nargs = func.nargs;
+        if (n_args_in > nargs)
+            return PYBIND11_TRY_NEXT_OVERLOAD;
+
+        function_call call(func, n_args_in > 0 ? args_in[0] : nullptr);
+        call.args.resize(nargs);
+        call.args_convert.resize(nargs);
+        for (size_t i = 0; i < n_args_in; ++i) {
+            const argument_record *arg_rec = i < func.args.size() ? &func.args[i] : nullptr;
+            if (arg_rec && !arg_rec->none && args_in[i] == Py_None)
+                return PYBIND11_TRY_NEXT_OVERLOAD;
+            call.args[i] = args_in[i];
+        }
+
+        const size_t n_kwargs = kwnames ? (size_t) PyTuple_GET_SIZE(kwnames) : 0;
+        for (size_t k = 0; k < n_kwargs; ++k) {
+            PyObject *name = PyTuple_GET_ITEM(kwnames, k);
+            size_t i = n_args_in;
+            while (i < func.args.size() &&
+                   !(func.args[i].name && PyUnicode_CompareWithASCIIString(name, func.args[i].name) == 0))
+                ++i;
+            // unknown, or also given positionally
+            if (i == func.args.size() || call.args[i])
+                return PYBIND11_TRY_NEXT_OVERLOAD;
+            call.args[i] = args_in[n_args_in + k];
+        }
+
+        for (size_t i = 0; i < nargs; ++i) {
+            const argument_record *arg_rec = i < func.args.size() ? &func.args[i] : nullptr;
+            if (!call.args[i]) {
+                if (!arg_rec || !arg_rec->value)
+                    return PYBIND11_TRY_NEXT_OVERLOAD;
+                call.args[i] = arg_rec->value;
+            }
+            call.args_convert[i] = convert && (arg_rec ? arg_rec->convert : true);
+        }
+
+        handle result;
+        try {
+            loader_life_support guard{};
+            result = func.impl(call);
+        } catch (reference_cast_error &) {
+            result = PYBIND11_TRY_NEXT_OVERLOAD;
+        }
+        if (!result)
+            return return_value_error(func);
+        return result.ptr();
+    }
+
+    /// Whether every overload resolution tries before `winner` turned down arguments of these
+    /// types because of the types, so the next call with the same types may go straight to it.
+    /// Before a no-convert win that is the overloads ahead of it.  A conversion win comes after
+    /// every overload's no-convert pass, and the conversion passes ahead of it aren't decided by
+    /// type, so it must be the first overload and they must all load by type.
+    static bool passed_over_by_type(const detail::function_record *overloads, const detail::function_record *winner,
+                                    bool convert) {
+        if (convert && winner != overloads)
+            return false;
+        for (auto it = overloads; it != nullptr; it = it->next) {
+            if (it == winner && !convert)
+                return true;
+            if (!it->loads_by_type)
+                return false;
+        }
+        return true;
+    }
+#endif
+
     /// Main dispatch logic for calls to functions bound using pybind11
     static PyObject *dispatcher(PyObject *self, PyObject *args_in, PyObject *kwargs_in) {
         using namespace detail;
@@ -428,6 +601,7 @@ protected:
 
         handle parent = n_args_in > 0 ? PyTuple_GET_ITEM(args_in, 0) : nullptr,
                result = PYBIND11_TRY_NEXT_OVERLOAD;
+        function_record *winner = nullptr;
 
         auto self_value_and_holder = value_and_holder();
         if (overloads->is_constructor) {
@@ -456,6 +630,9 @@ protected:
             // However, if there are no overloads, we can just skip the no-convert pass entirely
             const bool overloaded = it != nullptr && it->next != nullptr;
 
+            // The overload that took the call, and whether it needed the conversion pass
+            bool winner_convert = false;
+
             for (; it != nullptr; it = it->next) {
 
                 /* For each overload:
@@ -604,7 +781,7 @@ protected:
                     pybind11_fail("Internal error: function call dispatcher inserted wrong number of arguments!");
                 #endif
 
-                std::vector<bool> second_pass_convert;
+                decltype(call.args_convert) second_pass_convert;
                 if (overloaded) {
                     // We're in the first no-convert pass, so swap out the conversion flags for a
                     // set of all-false flags.  If the call fails, we'll swap the flags back in for
@@ -621,8 +798,10 @@ protected:
                     result = PYBIND11_TRY_NEXT_OVERLOAD;
                 }
 
-                if (result.ptr() != PYBIND11_TRY_NEXT_OVERLOAD)
+                if (result.ptr() != PYBIND11_TRY_NEXT_OVERLOAD) {
+                    winner = it;
                     break;
+                }
 
                 if (overloaded) {
                     // The (overloaded) call failed; if the call has at least one argument that
@@ -650,50 +829,31 @@ protected:
                         result = PYBIND11_TRY_NEXT_OVERLOAD;
                     }
 
-                    if (result.ptr() != PYBIND11_TRY_NEXT_OVERLOAD)
+                    if (result.ptr() != PYBIND11_TRY_NEXT_OVERLOAD) {
+                        winner = const_cast<function_record *>(&call.func);
+                        winner_convert = true;
                         break;
+                    }
                 }
             }
+
+#if defined(PYBIND11_VECTORCALL)
+            // Positional calls to overloads vectorcall_dispatcher() can load directly
+            if (overloaded && winner && !winner->is_constructor && !winner->has_args && !winner->has_kwargs &&
+                    (!kwargs_in || PyDict_GET_SIZE(kwargs_in) == 0) &&
+                    passed_over_by_type(overloads, winner, winner_convert)) {
+                if (!overloads->cache)
+                    overloads->cache.reset(new overload_cache());
+                overloads->cache->remember(&PyTuple_GET_ITEM(args_in, 0), n_args_in, winner, winner_convert);
+            }
+#endif
         } catch (error_already_set &e) {
             e.restore();
             return nullptr;
         } catch (...) {
-            /* When an exception is caught, give each registered exception
-               translator a chance to translate it to a Python exception
-               in reverse order of registration.
-
-               A translator may choose to do one of the following:
-
-                - catch the exception and call PyErr_SetString or PyErr_SetObject
-                  to set a standard (or custom) Python exception, or
-                - do nothing and let the exception fall through to the next translator, or
-                - delegate translation to the next translator by throwing a new type of exception. */
-
-            auto last_exception = std::current_exception();
-            auto &registered_exception_translators = get_internals().registered_exception_translators;
-            for (auto& translator : registered_exception_translators) {
-                try {
-                    translator(last_exception);
-                } catch (...) {
-                    last_exception = std::current_exception();
-                    continue;
-                }
-                return nullptr;
-            }
-            PyErr_SetString(PyExc_SystemError, "Exception escaped from default exception translator!");
-            return nullptr;
+            return translate_exception(std::current_exception());
         }
 
-        auto append_note_if_missing_header_is_suspected = [](std::string &msg) {
-            if (msg.find("std::") != std::string::npos) {
-                msg += "\n\n"
-                       "Did you forget to `#include <pybind11/stl.h>`? Or <pybind11/complex.h>,\n"
-                       "<pybind11/functional.h>, <pybind11/chrono.h>, etc. Some automatic\n"
-                       "conversions are optional and require extra headers to be included\n"
-                       "when compiling your pybind11 module.";
-            }
-        };
-
         if (result.ptr() == PYBIND11_TRY_NEXT_OVERLOAD) {
             if (overloads->is_operator)
                 return handle(Py_NotImplemented).inc_ref().ptr();
@@ -755,12 +915,7 @@ protected:
             PyErr_SetString(PyExc_TypeError, msg.c_str());
             return nullptr;
         } else if (!result) {
-            std::string msg = "Unable to convert function return value to a "
-                              "Python type! The signature was\n\t";
-            msg += it->signature;
-            append_note_if_missing_header_is_suspected(msg);
-            PyErr_SetString(PyExc_TypeError, msg.c_str());
-            return nullptr;
+            return return_value_error(*winner);
         } else {
             if (overloads->is_constructor && !self_value_and_holder.holder_constructed()) {
                 auto *pi = reinterpret_cast<instance *>(parent.ptr());
@@ -1064,6 +1219,11 @@ public:
 
         generic_type::initialize(record);
 
+        if (record.pool_size) {
+            instance_free_list<type>::install((PyTypeObject *) m_ptr, record.pool_size);
+            module::import("atexit").attr("register")(cpp_function(&instance_free_list<type>::clear));
+        }
+
         if (has_alias) {
             auto &instances = record.module_local ? registered_local_types_cpp() : get_internals().registered_types_cpp;
             instances[std::type_index(typeid(type_alias))] = instances[std::type_index(typeid(type))];
@@ -1768,22 +1928,73 @@ void print(Args &&...args) {
  * example which uses features 2 and 3 to migrate the Python thread of
  * execution to another thread (to run the event loop on the original thread,
  * in this case).
+ *
+ * A thread state created for a foreign thread is kept for the life of that
+ * thread rather than rebuilt on every acquire, since callbacks from a thread
+ * pool would otherwise pay for PyThreadState_New and _Clear each time.
  */
 
+NAMESPACE_BEGIN(detail)
+// Py_IsInitialized() stays true for the length of Py_FinalizeEx
+inline bool interpreter_finalizing() {
+#if defined(PYPY_VERSION)
+    return false;
+#elif PY_VERSION_HEX >= 0x030D0000
+    return Py_IsFinalizing() != 0;
+#elif PY_VERSION_HEX >= 0x03070000
+    return _Py_IsFinalizing() != 0;
+#else
+    return false;
+#endif
+}
+
+// Owns the thread state gil_scoped_acquire created for this thread, and
+// deletes it when the thread exits if the interpreter is still running.
+// During finalization it is left alone: taking the GIL there can block or
+// end the thread, and the interpreter frees its thread states itself.
+struct cached_thread_state {
+    PyThreadState *tstate = nullptr;
+
+    ~cached_thread_state() {
+        if (!tstate || !Py_IsInitialized() || interpreter_finalizing())
+            return;
+        auto &internals = get_internals();
+        // moved to another thread, or the interpreter was restarted since
+        if (PYBIND11_TLS_GET_VALUE(internals.tstate) != tstate)
+            return;
+        PyEval_RestoreThread(tstate);
+        PyThreadState_Clear(tstate);
+        PyThreadState_DeleteCurrent();
+        PYBIND11_TLS_DELETE_VALUE(internals.tstate);
+    }
+
+    static cached_thread_state &get() {
+        static thread_local cached_thread_state cache;
+        return cache;
+    }
+};
+NAMESPACE_END(detail)
+
 class gil_scoped_acquire {
 public:
     PYBIND11_NOINLINE gil_scoped_acquire() {
         auto const &internals = detail::get_internals();
         tstate = (PyThreadState *) PYBIND11_TLS_GET_VALUE(internals.tstate);
 
+        // a thread Python already has a state for, such as one started by threading
+        if (!tstate)
+            tstate = PyGILState_GetThisThreadState();
+
         if (!tstate) {
             tstate = PyThreadState_New(internals.istate);
             #if !defined(NDEBUG)
                 if (!tstate)
                     pybind11_fail("scoped_acquire: could not create thread state!");
             #endif
-            tstate->gilstate_counter = 0;
+            // the cache's own reference: nothing, PyGILState_Release included, deletes it
+            tstate->gilstate_counter = 1;
             PYBIND11_TLS_REPLACE_VALUE(internals.tstate, tstate);
+            detail::cached_thread_state::get().tstate = tstate;
         } else {
             release = detail::get_thread_state_unchecked() != tstate;
         }
@@ -1812,19 +2023,9 @@ public:
         #if !defined(NDEBUG)
             if (detail::get_thread_state_unchecked() != tstate)
                 pybind11_fail("scoped_acquire::dec_ref(): thread state must be current!");
-            if (tstate->gilstate_counter < 0)
+            if (tstate->gilstate_counter < 1)
                 pybind11_fail("scoped_acquire::dec_ref(): reference count underflow!");
         #endif
-        if (tstate->gilstate_counter == 0) {
-            #if !defined(NDEBUG)
-                if (!release)
-                    pybind11_fail("scoped_acquire::dec_ref(): internal error!");
-            #endif
-            PyThreadState_Clear(tstate);
-            PyThreadState_DeleteCurrent();
-            PYBIND11_TLS_DELETE_VALUE(detail::get_internals().tstate);
-            release = false;
-        }
     }
 
     PYBIND11_NOINLINE ~gil_scoped_acquire() {
@@ -1913,7 +2114,27 @@ inline function get_type_overload(const void *this_ptr, const detail::type_info
 
     /* Don't call dispatch code if invoked from overridden function.
        Unfortunately this doesn't work on PyPy. */
-#if !defined(PYPY_VERSION)
+#if !defined(PYPY_VERSION) && PY_VERSION_HEX >= 0x03090000
+    PyFrameObject *frame = PyThreadState_GetFrame(PyThreadState_Get());
+    if (frame) {
+        PyCodeObject *f_code = PyFrame_GetCode(frame);
+        if ((std::string) str(f_code->co_name) == name && f_code->co_argcount > 0) {
+            PyObject *locals = PyEval_GetLocals();
+            object co_varnames = reinterpret_steal<object>(PyObject_GetAttrString((PyObject *) f_code, "co_varnames"));
+            if (locals && co_varnames) {
+                PyObject *self_caller = PyDict_GetItem(locals, PyTuple_GET_ITEM(co_varnames.ptr(), 0));
+                if (self_caller == self.ptr()) {
+                    Py_DECREF(f_code);
+                    Py_DECREF(frame);
+                    return function();
+                }
+            }
+            PyErr_Clear();
+        }
+        Py_DECREF(f_code);
+        Py_DECREF(frame);
+    }
+#elif !defined(PYPY_VERSION)
     PyFrameObject *frame = PyThreadState_Get()->frame;
     if (frame && (std::string) str(frame->f_code->co_name) == name &&
         frame->f_code->co_argcount > 0) {
@@ -105,6 +105,7 @@ template <typename Type, typename Key, typename Value> struct map_caster {
             return false;
         auto d = reinterpret_borrow<dict>(src);
         value.clear();
+        reserve_maybe(d, &value);
         for (auto it : d) {
             key_conv kconv;
             value_conv vconv;
@@ -116,6 +117,15 @@ template <typename Type, typename Key, typename Value> struct map_caster {
         return true;
     }
 
+private:
+    // hash maps are sized once instead of rehashing as they fill
+    template <typename T = Type,
+              enable_if_t<std::is_same<decltype(std::declval<T>().reserve(0)), void>::value, int> = 0>
+    void reserve_maybe(dict d, Type *) { value.reserve(d.size()); }
+    void reserve_maybe(dict, void *) { }
+
+public:
+
     template <typename T>
     static handle cast(T &&src, return_value_policy policy, handle parent) {
         dict d;
@@ -248,6 +258,102 @@ template <typename Key, typename Value, typename Compare, typename Alloc> struct
 template <typename Key, typename Value, typename Hash, typename Equal, typename Alloc> struct type_caster<std::unordered_map<Key, Value, Hash, Equal, Alloc>>
   : map_caster<std::unordered_map<Key, Value, Hash, Equal, Alloc>, Key, Value> { };
 
+NAMESPACE_END(detail)
+
+/// A dict argument read in place: items are converted to Key and Value as they are iterated,
+/// instead of being copied into a std::map first.  Loading it only type-checks items whose
+/// Key or Value is a Python type (str, dict, ...) or a nested dict_view, so a mismatch there
+/// fails overload resolution as usual; an item of a C++ type that doesn't convert throws
+/// cast_error when iteration reaches it.  Use handle for items the caller converts itself.
+template <typename Key, typename Value>
+class dict_view {
+public:
+    class iterator {
+    public:
+        iterator(handle d, ssize_t pos) : d(d), pos(pos) { next(); }
+
+        std::pair<Key, Value> operator*() const {
+            return std::pair<Key, Value>(pybind11::cast<Key>(key), pybind11::cast<Value>(value));
+        }
+
+        iterator &operator++() { next(); return *this; }
+        bool operator==(const iterator &other) const { return pos == other.pos; }
+        bool operator!=(const iterator &other) const { return pos != other.pos; }
+
+    private:
+        handle d;
+        ssize_t pos;
+        handle key, value;
+
+        void next() {
+            PyObject *k, *v;
+            if (pos >= 0 && PyDict_Next(d.ptr(), &pos, &k, &v)) {
+                key = k;
+                value = v;
+            } else {
+                pos = -1;
+            }
+        }
+    };
+
+    dict_view() = default;
+    explicit dict_view(dict d) : d(std::move(d)) { }
+
+    iterator begin() const { return iterator(d, d ? 0 : -1); }
+    iterator end() const { return iterator(d, -1); }
+    size_t size() const { return d ? (size_t) PyDict_Size(d.ptr()) : 0; }
+    bool empty() const { return size() == 0; }
+
+    /// The dict itself
+    handle source() const { return d; }
+
+private:
+    // not a dict: a default-constructed one would allocate an empty dict per load
+    object d;
+};
+
+NAMESPACE_BEGIN(detail)
+
+// What loading a dict_view checks of its items without converting them
+template <typename T, typename SFINAE = void> struct dict_view_check {
+    static bool check(handle) { return true; }
+};
+template <typename T> struct dict_view_check<T, enable_if_t<
+        std::is_base_of<object, T>::value && !std::is_same<object, T>::value>> {
+    static bool check(handle src) { return isinstance<T>(src); }
+};
+template <typename Key, typename Value> struct dict_view_check<dict_view<Key, Value>> {
+    static bool check(handle src) {
+        if (!PyDict_Check(src.ptr()))
+            return false;
+        PyObject *k, *v;
+        ssize_t pos = 0;
+        while (PyDict_Next(src.ptr(), &pos, &k, &v)) {
+            if (!dict_view_check<Key>::check(k) || !dict_view_check<Value>::check(v))
+                return false;
+        }
+        return true;
+    }
+};
+
+template <typename Key, typename Value> struct type_caster<dict_view<Key, Value>> {
+    using view_type = dict_view<Key, Value>;
+
+    bool load(handle src, bool) {
+        if (!dict_view_check<view_type>::check(src))
+            return false;
+        value = view_type(reinterpret_borrow<dict>(src));
+        return true;
+    }
+
+    static handle cast(const view_type &src, return_value_policy, handle) {
+        return src.source().inc_ref();
+    }
+
+    PYBIND11_TYPE_CASTER(view_type,
+                         _("Dict[") + make_caster<Key>::name + _(", ") + make_caster<Value>::name + _("]"));
+};
+
 // This type caster is intended to be used for std::optional and std::experimental::optional
 template<typename T> struct optional_caster {
     using value_conv = make_caster<typename T::value_type>;
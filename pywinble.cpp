@@ -1,394 +1,416 @@
-#define PY_SSIZE_T_CLEAN
+// Portable core of the module: device tables, metrics, tracing and the
+// simulated fleet.  The radio itself comes from a platform backend, see
+// bind_backend().
 
-#pragma comment(lib, "windowsapp")
+#include "pywinble.h"
 
-#include <Python.h>
-#include "pybind11/pybind11.h"
-#include "pybind11/stl.h"
+#include <string.h>
 
-namespace py = pybind11;
+#include <chrono>
+#include <thread>
 
-#include <memory>
-#include <iostream>
+#include "simfleet.h"
 
-#include <atlbase.h>
-
-#include "winrt/Windows.Foundation.h"
-#include "winrt/Windows.Storage.Streams.h"
-#include "winrt/Windows.Devices.Bluetooth.h"
-#include "winrt/Windows.Devices.Enumeration.h"
-#include "winrt/Windows.Devices.Bluetooth.Advertisement.h"
-#include "winrt/Windows.Devices.Bluetooth.GenericAttributeProfile.h"
-
-//#include <collection.h>
 using namespace std;
-using namespace winrt::Windows::Foundation;
-using namespace winrt::Windows::Devices;
-using namespace winrt::Windows::Storage::Streams;
-using namespace winrt::Windows::Devices::Bluetooth;
-using namespace winrt::Windows::Devices::Bluetooth::GenericAttributeProfile;
-using namespace winrt::Windows::Devices::Enumeration;
-
-
-// ################ GENERIC WINRT
-//
-std::string w2a(const winrt::hstring& hs) {
-    // # can be used in an exception
-    USES_CONVERSION;
-    return std::string(W2A(hs.c_str()));
-}
-
-bool winrt_ok() {
-    static bool did = false;
-    static bool ok = false;
-
-    if (did)
-        return ok;
-
-    winrt::hstring errMsg;
-
-    {
-        USES_CONVERSION;
-        try {
-            winrt::init_apartment();
-            // start the GIL in the correct thread
-            did = true;
-            ok = true;
-        } catch (const winrt::hresult_error &e) {
-            PyErr_SetString(PyExc_TypeError, w2a(e.message()).c_str());
-        }
 
-        return ok;
+py::dict PyVar(const DeviceTable::Row &row) {
+    py::dict dict;
+    dict["address"] = format_address(row.address);
+    // None until the device is seen with a signal strength
+    if (row.rssi == DeviceTable::noReading) {
+        dict["rssi"] = py::none();
+        dict["rssi_smoothed"] = py::none();
+        dict["distance"] = py::none();
+    } else {
+        dict["rssi"] = row.rssi;
+        dict["rssi_smoothed"] = row.smoothed;
+        dict["distance"] = row.distance;
     }
+    dict["last_seen"] = row.lastSeen / 1e9;
+    dict["name"] = row.name;
+    dict["version"] = row.version;
+    return dict;
 }
 
-// ################ GENERIC PY
-
-// allow other threads to call callbacks
-class gil_lock
-{
-public:
-  gil_lock()  { state_ = PyGILState_Ensure(); }
-  ~gil_lock() { PyGILState_Release(state_);   }
-private:
-  PyGILState_STATE state_;
-};
-
-PyObject *PyVar(int var) {
-    return PyLong_FromLong(var);
-}
-
-PyObject *PyVar(const winrt::hstring &var) {
-#if PY_MAJOR_VERSION > 2
-    return PyUnicode_FromWideChar(var.c_str(), var.size());
-#else
-    // todo : support unicode in py 2
-    USES_CONVERSION;
-    return PyString_FromString(W2A(var.c_str()));
-#endif
+py::dict PyVar(const metrics::HistogramData &hist) {
+    py::dict dict;
+    dict["count"] = hist.count;
+    dict["sum"] = hist.sum / 1e9;
+    dict["min"] = hist.count ? hist.min / 1e9 : 0.0;
+    dict["max"] = hist.max / 1e9;
+    dict["p50"] = hist.quantile(0.5) / 1e9;
+    dict["p90"] = hist.quantile(0.9) / 1e9;
+    dict["p99"] = hist.quantile(0.99) / 1e9;
+    dict["p999"] = hist.quantile(0.999) / 1e9;
+    return dict;
 }
 
-#if PY_MAJOR_VERSION <= 2
-    #define PyUnicode_FromString PyString_FromString
-#endif
-
-#if PY_MAJOR_VERSION <= 2
-    #define PyUnicode_AsUTF8 PyString_AsString
-#endif
-
-#define Py_RETURN_ERROR(type, msg) { PyErr_SetString(type, msg); throw pybind11::error_already_set(); }
-
-PyObject *PyVar(const std::string &var) {
-    return PyUnicode_FromString(var.c_str());
+py::dict pywinble_metrics() {
+    auto snap = metrics::snapshot();
+    py::dict counters, gauges, histograms;
+    for (int i = 0; i < metrics::CounterCount; ++i)
+        counters[metrics::info((metrics::Counter) i).name] = snap.counters[i];
+    for (int i = 0; i < metrics::GaugeCount; ++i)
+        gauges[metrics::info((metrics::Gauge) i).name] = snap.gauges[i];
+    for (int i = 0; i < metrics::HistogramCount; ++i)
+        histograms[metrics::info((metrics::Histogram) i).name] = PyVar(snap.histograms[i]);
+    py::dict dict;
+    dict["counters"] = counters;
+    dict["gauges"] = gauges;
+    dict["histograms"] = histograms;
+    return dict;
 }
 
-std::string hexlify(uint64_t v, bool add_colons = false) {
-    std::string ret;
-    ret.resize(33);
-    int len = sprintf(&ret[0], "%" PRIx64, v);
-    ret.resize(len);
-    if (! add_colons || len <= 2) 
-        return ret;
-    std::string ret2;
-    ret2.resize(len + (len / 2 - 1));
-    for (int i = 0, j = 0; i < len; ++i, ++j) {
-        ret2[j]=ret[i];
-        if (i % 2 && i < (len-1))
-            ret2[++j] = ':';
+py::dict PyHistogram(const metrics::HistogramData &hist) {
+    py::dict dict = PyVar(hist);
+    py::list buckets;
+    for (int b = 0; b < metrics::bucketCount; ++b) {
+        if (hist.buckets[b])
+            buckets.append(py::make_tuple(metrics::bucket_limit(b) / 1e9, hist.buckets[b]));
     }
-    return ret2;
+    dict["buckets"] = buckets;
+    return dict;
 }
 
-// ################ BLUTOOTH
-BluetoothAdapter bluetooth_adapter = nullptr;
-Advertisement::BluetoothLEAdvertisementPublisher bleAdPub = nullptr;
-
-static PyObject* on_adstatus_callback = NULL;
-
-void call_on_adstatus_callback(const Advertisement::BluetoothLEAdvertisementPublisher &pub, const Advertisement::BluetoothLEAdvertisementPublisherStatusChangedEventArgs &status) {
-    if (on_adstatus_callback) {
-        py::gil_scoped_acquire acquire;
-        int err = (int) status.Error();
-        int stat = (int) status.Status();
-        PyObject *result = PyObject_CallFunction(on_adstatus_callback, "ii", (int)status.Error(), (int)status.Status());
-        Py_XDECREF(result);
-    }
+void pywinble_gil_profile(bool enable, uint32_t sampleEvery) {
+    if (enable && !sampleEvery)
+        Py_RETURN_ERROR(PyExc_ValueError, "sample_every must be at least 1");
+    gilprof::Profiler::get().configure(enable ? sampleEvery : 0);
 }
 
-py::dict pywinble_info() {
-    USES_CONVERSION;
-
-    if (!bluetooth_adapter) {
-        bluetooth_adapter = BluetoothAdapter::GetDefaultAsync().get();
-        if (!bluetooth_adapter)
-            throw std::exception("Adapter discovery error");
-    }
-
-
+py::dict pywinble_gil_profile_dump() {
+    auto snap = gilprof::Profiler::get().snapshot();
     py::dict dict;
-
-    #define ADD_DICT(key, var) dict[key]=var
-    #define ADD_DICT_O(ob, var) dict[#var]=ob.var()
-
-    ADD_DICT("BluetoothAddress", hexlify(bluetooth_adapter.BluetoothAddress(), true));
-    ADD_DICT("DeviceId", W2A(bluetooth_adapter.DeviceId().c_str()));
-
-    ADD_DICT_O(bluetooth_adapter, IsLowEnergySupported);
-    ADD_DICT_O(bluetooth_adapter, IsClassicSupported);
-    ADD_DICT_O(bluetooth_adapter, IsPeripheralRoleSupported);
-    ADD_DICT_O(bluetooth_adapter, IsAdvertisementOffloadSupported);
-    ADD_DICT_O(bluetooth_adapter, AreLowEnergySecureConnectionsSupported);
-
+    for (int i = 0; i < gilprof::SiteCount; ++i) {
+        py::dict site;
+        site["acquisitions"] = snap.acquisitions[i];
+        site["sampled"] = snap.wait[i].count;
+        site["wait"] = PyHistogram(snap.wait[i]);
+        site["hold"] = PyHistogram(snap.hold[i]);
+        dict[gilprof::site_name((gilprof::Site) i)] = site;
+    }
     return dict;
 }
 
-static PyObject* pywinble_advertise(PyObject *self, PyObject *args, PyObject *kws) {
-    PyObject *adstatus_callback = NULL;
-
-    static char *kwlist[] = {"data", "on_status" , NULL};
-    const char *cdat;
-
-    if (!PyArg_ParseTupleAndKeywords(args, kws, "s|O", kwlist, &cdat, &adstatus_callback, &cdat, &adstatus_callback))
-        return NULL;
-
-    if (adstatus_callback) {
-        if (!PyCallable_Check(adstatus_callback)) {
-            Py_RETURN_ERROR(PyExc_TypeError, "parameter must be callable");
-        }
-        Py_XINCREF(adstatus_callback);
-        Py_XDECREF(on_adstatus_callback);
-        on_adstatus_callback = adstatus_callback;
-    }
-
-    if (bleAdPub) {
-        bleAdPub.Stop();
-        bleAdPub = nullptr;
-    }
-
-    bleAdPub = Bluetooth::Advertisement::BluetoothLEAdvertisementPublisher();
-    if (!bleAdPub) {
-        Py_RETURN_ERROR(PyExc_RuntimeError, "Pub create failed");
-    }
-
-    auto advertisement = bleAdPub.Advertisement();
+void pywinble_metrics_export(const std::string &path) {
+    if (!metrics::export_prometheus(path, metrics::snapshot()))
+        Py_RETURN_ERROR(PyExc_OSError, "Could not write metrics file");
+}
 
-    Advertisement::BluetoothLEManufacturerData mandat;
-    mandat.CompanyId(0xFFFE);
-    auto writer = DataWriter();
-    USES_CONVERSION;
-    writer.WriteString(A2W(cdat));
-    mandat.Data(writer.DetachBuffer());
-    advertisement.ManufacturerData().Append(mandat);
+void pywinble_trace_start(const std::string &path, uint64_t records) {
+    std::string error;
+    if (!records)
+        Py_RETURN_ERROR(PyExc_ValueError, "records must be at least 1");
+    if (!tracer::Tracer::get().start(path, records, error))
+        Py_RETURN_ERROR(PyExc_OSError, error.c_str());
+}
 
-    try {
-    	bleAdPub.Start();
-    } catch (const winrt::hresult_error &e) {
-        Py_RETURN_ERROR(PyExc_RuntimeError, w2a(e.message()).c_str());
-    }
+void pywinble_trace_stop() {
+    tracer::Tracer::get().stop();
+}
 
-    if (on_adstatus_callback) {
-        bleAdPub.StatusChanged(call_on_adstatus_callback);
-    }
+// ################ SIMULATED FLEET
 
-    Py_RETURN_NONE;
+py::dict PyVar(const simfleet::StreamReport &stream, double seconds) {
+    py::dict dict;
+    dict["produced"] = stream.produced;
+    dict["delivered"] = stream.delivered;
+    dict["dropped"] = stream.dropped;
+    dict["drop_rate"] = stream.produced ? (double) stream.dropped / stream.produced : 0.0;
+    dict["rate"] = seconds > 0 ? stream.delivered / seconds : 0.0;
+    dict["latency"] = PyVar(stream.latency);
+    dict["callback"] = PyVar(stream.callback);
+    return dict;
 }
 
-class BLEProvider {
+// load generator for code built on the module: a simulated radio delivers
+// advertisements to watcher callbacks and gatt writes to a provider callback,
+// on their own threads, the way the winrt backends do
+class SimulatedFleet : public lifecycle::Resource {
     public:
-        GattServiceProvider provider;
-
-        BLEProvider(GattServiceProvider ref) : provider(ref) {
-            if (!provider) 
-                throw std::exception("empty provider error");
-        }
-
-        ~BLEProvider() {
-            provider.StopAdvertising();
+        SimulatedFleet(const simfleet::Config &config, py::object onAdvertisement, py::object onWrite)
+                : onAdvertisement(onAdvertisement), onWrite(onWrite) {
+            for (auto cb : {onAdvertisement, onWrite}) {
+                if (!cb.is_none() && !PyCallable_Check(cb.ptr()))
+                    Py_RETURN_ERROR(PyExc_TypeError, "callback must be callable");
+            }
+            for (int i = 0; i < (int) WatchEvent::Count; ++i)
+                eventNames[i] = py::str(watch_event_name((WatchEvent) i));
+            for (uint32_t i = 0; i < (config.characteristics ? config.characteristics : 1); ++i) {
+                Guid uuid = {0x0000ff00u + i, 0x0000, 0x1000, {0x80, 0x00, 0x00, 0x80, 0x5f, 0x9b, 0x34, 0xfb}};
+                characteristicIds.push_back(py::str(format_guid(uuid)));
+            }
+            fleet.reset(new simfleet::Fleet(config, [this](simfleet::Stream stream, size_t sink, const simfleet::Event &event,
+                    DeviceTable *table, bool added, uint64_t &entered) {
+                deliver(stream, sink, event, table, added, entered);
+            }));
         }
 
-        wstring getUUID() {
-            wstring out;
-            auto uuid = provider.Service().Uuid();
-            out.resize(64);
-            int len = StringFromGUID2(uuid, &out[0], (int) out.size());
-            out.resize(len);
-            return out;
+        ~SimulatedFleet() {
+            // delivery threads need the gil to finish
+            py::gil_scoped_release release;
+            fleet.reset();
         }
 
-        GattLocalService Service() {
-            return provider.Service();
+        void start() {
+            bool open, started = false;
+            {
+                py::gil_scoped_release release;
+                lock_guard<mutex> lock(mtx);
+                open = !closed;
+                if (open)
+                    started = fleet->start();
+            }
+            if (!open)
+                Py_RETURN_ERROR(PyExc_RuntimeError, "Fleet is closed");
+            if (!started)
+                Py_RETURN_ERROR(PyExc_RuntimeError, "Fleet is already running");
         }
 
-        void StartAdvertising() {
-            auto cparam = GattServiceProviderAdvertisingParameters();
-            cparam.IsDiscoverable(true);
-            provider.StartAdvertising(cparam);
+        void stop() {
+            if (delivering() == this)
+                Py_RETURN_ERROR(PyExc_RuntimeError, "Fleet can't be stopped from its own callback");
+            py::gil_scoped_release release;
+            fleet->stop();
         }
 
-        void StopAdvertising() {
-            provider.StopAdvertising();
+        bool running() {
+            py::gil_scoped_release release;
+            return fleet->running();
         }
 
-};
-
-
-unique_ptr<BLEProvider> pywinble_provide(const wchar_t * uuid_str, map<string, map<string, py::handle>> characteristics) {
-    USES_CONVERSION;
-
-    GUID uuid;
-    IIDFromString(uuid_str, &uuid);
-
-    GattServiceProviderResult result = GattServiceProvider::CreateAsync(uuid).get();
-
-    if (result.Error() != BluetoothError::Success)
-        Py_RETURN_ERROR(PyExc_RuntimeError, "Bluetooth error");
-
-    auto ble = make_unique<BLEProvider>(result.ServiceProvider());
-    
-    for (auto item : characteristics) {
-        auto key = item.first;
-        auto value = item.second;
-
-        if (key.empty()) {
-            Py_RETURN_ERROR(PyExc_TypeError, "Invalid characteristic dict {uuid:{key:v},...}");
-        }
-
-        IIDFromString(A2W(key.c_str()), &uuid);
-        GattLocalCharacteristicParameters cParams;
-
-        for (auto item : value) {
-            auto ckey = item.first;
-            auto cvalue = item.second;
-
-            if (ckey.empty()) {
-                Py_RETURN_ERROR(PyExc_TypeError, "Invalid characteristic dict {uuid:{key:v},...}");
+        // stops delivery and waits for the callbacks in flight; past the
+        // deadline they are left to finish and the destructor joins them
+        bool close(uint64_t deadlineNs) override {
+            if (delivering() == this)
+                return false;
+            bool stopped;
+            {
+                py::gil_scoped_release release;
+                lock_guard<mutex> lock(mtx);
+                closed = true;
+                stopped = fleet->stop(deadlineNs);
             }
-
-            if (ckey == "flags") {
-                cParams.CharacteristicProperties((GattCharacteristicProperties)PyLong_AsLong(cvalue.ptr()));
-            } else if (ckey == "description") {
-                py::str cv = py::str(cvalue);
-                cParams.UserDescription(A2W(string(cv).c_str()));
+            if (stopped) {
+                onAdvertisement = EventCallback();
+                onWrite = EventCallback();
             }
+            return stopped;
         }
 
-        auto result = ble->Service().CreateCharacteristicAsync(uuid, cParams).get();
-
-        if (result.Error() != BluetoothError::Success)
-            Py_RETURN_ERROR(PyExc_RuntimeError, "Bluetooth error");
-    }
-
-    return ble;
-}
-
-typedef function< void(string, map<string, map<string, py::handle > >) > *watch_cb_type;
-
-class BLEWatcher {
-    public:
-        DeviceWatcher watcher;
-        watch_cb_type callback;
-
-        BLEWatcher(std::vector<std::string> props,  watch_cb_type callback) : watcher(
-            DeviceInformation::CreateWatcher(
-                    BluetoothLEDevice::GetDeviceSelectorFromPairingState(false),
-                    props,
-                    DeviceInformationKind::AssociationEndpoint)) {
-            watcher.Added(bind(&BLEWatcher::onAdded, this));
-            watcher.Removed(bind(&BLEWatcher::onRemoved, this));
-            watcher.Updated(bind(&BLEWatcher::onUpdated, this));
-            watcher.EnumerationCompleted(bind(&BLEWatcher::onEnumerationCompleted, this));
-            watcher.Stopped(bind(&BLEWatcher::onStopped, this));
-        }
-
-        void onCb(const char *type, const DeviceInformation &devinfo) {
-
-        }
-
-        void onAdded(const DeviceWatcher &watcher, const DeviceInformation &devinfo) {
-            onCb("added", devinfo);
-        }
-
-        void onUpdated(const DeviceWatcher &watcher, const DeviceInformation &devinfo) {
-            onCb("updated", devinfo);
-        }
-
-        void onRemoved(const DeviceWatcher &watcher, const DeviceInformation &devinfo) {
-            onCb("removed", devinfo);
+        // start, wait, stop and report; Ctrl-C stops the run early
+        py::dict run(double seconds) {
+            start();
+            uint64_t end = deadline_after(seconds);
+            for (;;) {
+                uint64_t now = steady_now();
+                if (now >= end)
+                    break;
+                {
+                    py::gil_scoped_release release;
+                    uint64_t wait = end - now < 50000000 ? end - now : 50000000;
+                    std::this_thread::sleep_for(std::chrono::nanoseconds(wait));
+                }
+                if (PyErr_CheckSignals()) {
+                    stop();
+                    throw py::error_already_set();
+                }
+            }
+            stop();
+            return report();
         }
 
-        void onEnumerationCompleted(const DeviceWatcher &watcher, const DeviceInformation &devinfo) {
-            onCb("completed", devinfo);
+        py::dict report() {
+            simfleet::Report rep;
+            {
+                py::gil_scoped_release release;
+                rep = fleet->report();
+            }
+            py::dict dict;
+            dict["seconds"] = rep.seconds;
+            dict["devices"] = rep.devices;
+            dict["advertisement"] = PyVar(rep.streams[simfleet::Advertisement], rep.seconds);
+            dict["write"] = PyVar(rep.streams[simfleet::Write], rep.seconds);
+            return dict;
         }
 
-        void onStopped(const DeviceWatcher &watcher, const DeviceInformation &devinfo) {
-            onCb("stopped", devinfo);
-        }
-    
-        void start() {
-            watcher.Start();
+    private:
+        unique_ptr<simfleet::Fleet> fleet;
+        EventCallback onAdvertisement, onWrite;
+        // orders start() against close()
+        mutex mtx;
+        bool closed = false;
+
+        // the fleet whose callback this thread is in, if any
+        static const SimulatedFleet *&delivering() {
+            static thread_local const SimulatedFleet *fleet = nullptr;
+            return fleet;
         }
-        void stop() {
-            watcher.Stop();
-        }
-
-        ~BLEWatcher() {
-            watcher.Stop();
+        py::object eventNames[(int) WatchEvent::Count];
+        std::vector<py::object> characteristicIds;
+
+        void deliver(simfleet::Stream stream, size_t, const simfleet::Event &event,
+                DeviceTable *table, bool added, uint64_t &entered) {
+            const EventCallback &callback = stream == simfleet::Advertisement ? onAdvertisement : onWrite;
+            if (!callback)
+                return;
+
+            tracer::Span span(stream == simfleet::Advertisement ? tracer::FleetAdvertisement : tracer::FleetWrite, event.device);
+            gil_lock gil(gilprof::SimulatedFleet);
+            delivering() = this;
+            if (stream == simfleet::Advertisement) {
+                // same shape as a watcher event: callback(event, id, properties)
+                std::string address = format_address(event.device);
+                py::str id("BluetoothLE#BluetoothLE00:00:00:00:00:00-" + address);
+                py::dict props;
+                props["System.Devices.Aep.DeviceAddress"] = address;
+                props["System.Devices.Aep.SignalStrength"] = py::reinterpret_steal<py::object>(pycall::int_object(event.rssi));
+                DeviceTable::Row row;
+                if (table->get(event.device, row)) {
+                    props["rssi"] = row.smoothed;
+                    props["distance"] = row.distance;
+                }
+                entered = steady_now();
+                callback(eventNames[(int) (added ? WatchEvent::Added : WatchEvent::Updated)], id, props);
+            } else {
+                // callback(characteristic uuid, client, value)
+                py::int_ client(event.device);
+                py::bytes value((const char *) event.payload, event.length);
+                entered = steady_now();
+                callback(characteristicIds[event.characteristic], client, value);
+            }
+            delivering() = nullptr;
         }
 };
 
-
-unique_ptr<BLEWatcher> pywinble_watch(vector<string> props, watch_cb_type callback) {
-    auto ble = make_unique<BLEWatcher>(props, callback);
-    return ble;
+shared_ptr<SimulatedFleet> pywinble_bench_fleet(ModuleState &state, uint32_t advertisers, double advertiseHz, uint32_t clients, double writeHz,
+        uint32_t characteristics, uint32_t payloadSize, uint32_t watchers, size_t queue, uint32_t producers,
+        const std::string &rssiFilter, py::object onAdvertisement, py::object onWrite) {
+    simfleet::Config config;
+    if (advertiseHz < 0 || writeHz < 0)
+        Py_RETURN_ERROR(PyExc_ValueError, "rates must not be negative");
+    if (!queue || !producers || !characteristics)
+        Py_RETURN_ERROR(PyExc_ValueError, "queue, producers and characteristics must be at least 1");
+    if (payloadSize > simfleet::Config::maxPayload)
+        Py_RETURN_ERROR(PyExc_ValueError, "payload_size is at most 244");
+    if (!parse_rssi_filter(rssiFilter, 0, config.filter))
+        Py_RETURN_ERROR(PyExc_ValueError, "rssi_filter must be none, ema, median or kalman");
+    config.advertisers = advertisers;
+    config.advertiseHz = advertiseHz;
+    config.clients = clients;
+    config.writeHz = writeHz;
+    config.characteristics = characteristics;
+    config.payloadSize = payloadSize;
+    config.watchers = watchers;
+    config.queueCapacity = queue;
+    config.producers = producers;
+    return lifecycle::track(state.resources, make_shared<SimulatedFleet>(config, onAdvertisement, onWrite));
 }
 
-class cleanup_module {
-    public:
-    ~cleanup_module() {
-        if (bleAdPub) {
-            bleAdPub.Stop();
-        }
-    }
-};
-auto __guard = cleanup_module();
-
-PYBIND11_MODULE(pywinble, m) {
-    winrt_ok();
-
-    py::class_<BLEProvider>(m, "BLEProvider")
-        .def_property_readonly("uuid", &BLEProvider::getUUID)
-        .def("start", &BLEProvider::StartAdvertising)
-        .def("stop", &BLEProvider::StopAdvertising);
-
-    py::class_<BLEWatcher>(m, "BLEWatcher")
-        .def("start", &BLEWatcher::start)
-        .def("stop", &BLEWatcher::stop);
+// ################ SHUTDOWN
 
-    m.def("advertise", pywinble_advertise);
+// closes every live provider, watcher and fleet, then the advertisement
+bool pywinble_shutdown(ModuleState &state, double timeout) {
+    uint64_t deadline = deadline_after(timeout);
+    bool clean = true;
+    for (auto &resource : state.resources.live())
+        clean = resource->close(deadline) && clean;
+    return backend_shutdown(state, deadline) && clean;
+}
 
-    m.def("provide", pywinble_provide);
+PYBIND11_MODULE(pywinble, m) {
+#if PY_VERSION_HEX >= 0x03090000
+    // module state is per instance, but pybind11's type registry is still
+    // process-wide, so a second interpreter would share the first one's types.
+    // Once the main interpreter has it, python hands other interpreters a copy
+    // without running this again
+    if (PyInterpreterState_Get() != PyInterpreterState_Main())
+        Py_RETURN_ERROR(PyExc_ImportError, "pywinble does not support sub-interpreters");
+#endif
+    py::class_<DeviceTableView>(m, "DeviceTable")
+        .def("__getitem__", &DeviceTableView::getItem)
+        .def("__contains__", &DeviceTableView::contains)
+        .def("__len__", [](DeviceTableView &self) { return self.table->size(); })
+        .def("__iter__", [](DeviceTableView &self) { return self.keys().attr("__iter__")(); })
+        .def("get", &DeviceTableView::get, py::arg("key"), py::arg("default") = py::none())
+        .def("keys", &DeviceTableView::keys)
+        .def("values", &DeviceTableView::values)
+        .def("items", &DeviceTableView::items)
+        .def_property_readonly("version", [](DeviceTableView &self) { return self.table->version(); })
+        .def("changes_since", &DeviceTableView::changesSince,
+            "(version, {address: row}, [removed addresses]) for rows touched after version; "
+            "removed is None when that history is gone and the caller should resync from rows");
+    // same Mapping as collections.abc, but already loaded at interpreter startup,
+    // where importing collections would add a few ms to every import of pywinble
+    py::module::import("_collections_abc").attr("Mapping").attr("register")(m.attr("DeviceTable"));
+
+    auto state = make_shared<ModuleState>();
+    bind_backend(m, state);
+
+    m.def("metrics", pywinble_metrics,
+        "Snapshot of counters, gauges and latency histograms (seconds)");
+
+    m.def("metrics_export", pywinble_metrics_export, py::arg("path"),
+        "Write the metrics snapshot to path in Prometheus text format");
+
+    m.def("gil_profile", pywinble_gil_profile, py::arg("enable") = true, py::arg("sample_every") = 1,
+        "Time one in sample_every GIL acquisitions per thread, per call site");
+
+    m.def("gil_profile_dump", pywinble_gil_profile_dump,
+        "Per call site: acquisitions, and wait/hold histograms (seconds) of the sampled ones");
+
+    m.def("trace_start", pywinble_trace_start, py::arg("path"), py::arg("records") = 1 << 20,
+        "Trace events into a ring of the last `records` (rounded up to a power of two) "
+        "32-byte records, memory-mapped at path; tools/trace_to_chrome.py decodes it");
+
+    m.def("trace_stop", pywinble_trace_stop);
+
+    m.def("shutdown", [state](double timeout) { return pywinble_shutdown(*state, timeout); },
+        py::arg("timeout") = default_close_timeout,
+        "Stop advertising and close every provider, watcher and fleet, waiting up to timeout "
+        "seconds in all for callbacks in flight and worker threads; False if something was "
+        "still running by then.  Runs at interpreter exit as well");
+
+    // PYWINBLE_TRACE=path traces from import onwards, PYWINBLE_TRACE_RECORDS sizes the ring
+    if (const char *path = getenv("PYWINBLE_TRACE")) {
+        const char *records = getenv("PYWINBLE_TRACE_RECORDS");
+        pywinble_trace_start(path, records ? strtoull(records, NULL, 10) : 1 << 20);
+    }
 
-    m.def("info", pywinble_info);
+    // PYWINBLE_PREWARM=1 resolves the adapter in the background from import onwards
+    if (const char *prewarm = getenv("PYWINBLE_PREWARM")) {
+        if (*prewarm && strcmp(prewarm, "0"))
+            m.attr("prewarm")();
+    }
 
-    m.def("watch", pywinble_watch);
+    auto bench = m.def_submodule("bench", "Simulated peer fleet for load testing code built on pywinble");
+    py::class_<SimulatedFleet, shared_ptr<SimulatedFleet>> fleet(bench, "Fleet");
+    fleet
+        .def_property_readonly("running", &SimulatedFleet::running)
+        .def("start", &SimulatedFleet::start)
+        .def("stop", &SimulatedFleet::stop, "Stop the radio and delivery; events still queued count as dropped")
+        .def("run", &SimulatedFleet::run, py::arg("seconds"),
+            "Start, run for seconds, stop and return the report")
+        .def("report", &SimulatedFleet::report,
+            "Per stream: produced, delivered, dropped, drop_rate, rate (events/s), and latency "
+            "(scheduled radio event to callback entry) and callback histograms (seconds)");
+    def_close(fleet);
+    bench.def("fleet", [state](uint32_t advertisers, double advertiseHz, uint32_t clients, double writeHz,
+            uint32_t characteristics, uint32_t payloadSize, uint32_t watchers, size_t queue, uint32_t producers,
+            const std::string &rssiFilter, py::object onAdvertisement, py::object onWrite) {
+            return pywinble_bench_fleet(*state, advertisers, advertiseHz, clients, writeHz, characteristics,
+                payloadSize, watchers, queue, producers, rssiFilter, onAdvertisement, onWrite);
+        },
+        py::arg("advertisers") = 100, py::arg("advertise_hz") = 10.0,
+        py::arg("clients") = 0, py::arg("write_hz") = 10.0,
+        py::arg("characteristics") = 1, py::arg("payload_size") = 20,
+        py::arg("watchers") = 1, py::arg("queue") = 4096, py::arg("producers") = 1,
+        py::arg("rssi_filter") = "none",
+        py::arg("on_advertisement") = py::none(), py::arg("on_write") = py::none(),
+        "on_advertisement(event, id, properties) is called per watcher like a watch() callback, "
+        "on_write(characteristic, client, value) for each gatt write to the provider");
+    py::module::import("sys").attr("modules")["pywinble.bench"] = bench;
+
+    // before finalization, while callback threads can still take the GIL
+    py::module::import("atexit").attr("register")(m.attr("shutdown"));
 }
@@ -0,0 +1,309 @@
+#pragma once
+
+// Glue shared by the module's translation units: the python side of the core
+// and the interface a platform backend (winrt, sim) implements.
+
+#ifndef PY_SSIZE_T_CLEAN
+#define PY_SSIZE_T_CLEAN
+#endif
+
+#include <Python.h>
+#include "pybind11/pybind11.h"
+#include "pybind11/stl.h"
+
+namespace py = pybind11;
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "callback.h"
+#include "characteristics.h"
+#include "devtable.h"
+#include "gilprof.h"
+#include "lifecycle.h"
+#include "metrics.h"
+#include "rssi.h"
+#include "tracer.h"
+#include "util.h"
+
+#if PY_MAJOR_VERSION <= 2
+    #define PyUnicode_FromString PyString_FromString
+#endif
+
+#if PY_MAJOR_VERSION <= 2
+    #define PyUnicode_AsUTF8 PyString_AsString
+#endif
+
+#define Py_RETURN_ERROR(type, msg) { PyErr_SetString(type, msg); throw pybind11::error_already_set(); }
+
+inline PyObject *PyVar(int var) {
+    return PyLong_FromLong(var);
+}
+
+inline PyObject *PyVar(const std::string &var) {
+    return PyUnicode_FromString(var.c_str());
+}
+
+// the GIL for a callback, profiled per call site.  Every callback site takes
+// it this way; a callback thread keeps its Python thread state between calls
+// (see gil_scoped_acquire) instead of building one per PyGILState_Ensure.
+class gil_lock
+{
+public:
+  gil_lock(gilprof::Site site) : site_(site), start_(begin()) {
+    acquired_ = steady_now();
+    metrics::record(metrics::GilWaitTime, acquired_ - start_);
+    if (sampled_)
+      shard_->wait[site_].record(acquired_ - start_);
+    tracer::emit(tracer::GilWait, site_, start_, acquired_ - start_, 0);
+  }
+  ~gil_lock() {
+    if (sampled_)
+      shard_->hold[site_].record(steady_now() - acquired_);
+  }
+private:
+  gilprof::Site site_;
+  gilprof::Shard *shard_;
+  bool sampled_;
+  uint64_t start_;
+  // after start_, so the wait is timed from before the acquire
+  py::gil_scoped_acquire acquire_;
+  uint64_t acquired_;
+
+  uint64_t begin() {
+    auto &prof = gilprof::Profiler::get();
+    shard_ = &prof.local();
+    sampled_ = prof.begin(*shard_, site_);
+    return steady_now();
+  }
+};
+
+enum class WatchEvent {
+    Added,
+    Updated,
+    Removed,
+    Completed,
+    Stopped,
+    Lost,
+    Count
+};
+
+inline const char *watch_event_name(WatchEvent event) {
+    switch (event) {
+        case WatchEvent::Added: return "added";
+        case WatchEvent::Updated: return "updated";
+        case WatchEvent::Removed: return "removed";
+        case WatchEvent::Completed: return "completed";
+        case WatchEvent::Stopped: return "stopped";
+        case WatchEvent::Lost: return "lost";
+        default: return "unknown";
+    }
+}
+
+// callback(event, id, properties) for watcher events
+typedef pycall::Invoker<py::handle, py::handle, py::handle> EventCallback;
+// on_status(error, status) for advertising
+typedef pycall::Invoker<int, int> StatusCallback;
+
+py::dict PyVar(const DeviceTable::Row &row);
+
+py::dict PyVar(const metrics::HistogramData &hist);
+
+// read-only collections.abc.Mapping over a DeviceTable, keyed by address string
+class DeviceTableView {
+    public:
+        std::shared_ptr<DeviceTable> table;
+
+        DeviceTableView(std::shared_ptr<DeviceTable> table) : table(table) {}
+
+        py::dict getItem(const std::string &key) {
+            uint64_t address;
+            DeviceTable::Row row;
+            if (!parse_address(key.c_str(), address) || !table->get(address, row))
+                throw py::key_error(key);
+            return PyVar(row);
+        }
+
+        py::object get(const std::string &key, py::object fallback) {
+            uint64_t address;
+            DeviceTable::Row row;
+            if (!parse_address(key.c_str(), address) || !table->get(address, row))
+                return fallback;
+            return PyVar(row);
+        }
+
+        bool contains(const std::string &key) {
+            uint64_t address;
+            return parse_address(key.c_str(), address) && table->contains(address);
+        }
+
+        py::list keys() {
+            py::list out;
+            for (auto address : table->keys())
+                out.append(format_address(address));
+            return out;
+        }
+
+        py::list values() {
+            py::list out;
+            for (auto &row : table->rows())
+                out.append(PyVar(row));
+            return out;
+        }
+
+        py::list items() {
+            py::list out;
+            for (auto &row : table->rows())
+                out.append(py::make_tuple(format_address(row.address), PyVar(row)));
+            return out;
+        }
+
+        py::tuple changesSince(uint64_t since) {
+            std::vector<DeviceTable::Row> changed;
+            std::vector<uint64_t> gone;
+            uint64_t current;
+            bool complete = table->changesSince(since, changed, gone, current);
+            py::dict rows;
+            for (auto &row : changed)
+                rows[py::str(format_address(row.address))] = PyVar(row);
+            if (!complete)
+                return py::make_tuple(current, rows, py::none());
+            py::list removed;
+            for (auto address : gone)
+                removed.append(format_address(address));
+            return py::make_tuple(current, rows, removed);
+        }
+};
+
+// mirrors DeviceWatcherStatus, plus the paused flag kept by the backend watcher
+enum class WatcherState {
+    Created,
+    Started,
+    Enumerated,
+    Stopping,
+    Stopped,
+    Aborted,
+};
+
+inline const char *watcher_state_name(WatcherState state) {
+    switch (state) {
+        case WatcherState::Created: return "created";
+        case WatcherState::Started: return "started";
+        case WatcherState::Enumerated: return "enumerated";
+        case WatcherState::Stopping: return "stopping";
+        case WatcherState::Stopped: return "stopped";
+        case WatcherState::Aborted: return "aborted";
+    }
+    return "unknown";
+}
+
+// ################ TEARDOWN
+
+const double default_close_timeout = 5.0;
+
+// inf or a huge timeout saturates at the furthest deadline a steady_clock
+// time point can hold, see lifecycle::time_point
+inline uint64_t deadline_after(double seconds) {
+    if (!(seconds >= 0))
+        Py_RETURN_ERROR(PyExc_ValueError, "timeout must not be negative");
+    uint64_t now = steady_now(), limit = (uint64_t) INT64_MAX - now;
+    if (seconds * 1e9 >= (double) limit)
+        return now + limit;
+    return now + (uint64_t) (seconds * 1e9);
+}
+
+// close(timeout) on a lifecycle::Resource, and with-statement support
+template <class Class>
+void def_close(Class &cls) {
+    typedef typename Class::type T;
+    cls.def("close", [](T &self, double timeout) { return self.close(deadline_after(timeout)); },
+            py::arg("timeout") = default_close_timeout,
+            "Stop, wait for callbacks in flight and join threads; False if that took longer than timeout")
+        .def("__enter__", [](py::object self) { return self; })
+        .def("__exit__", [](T &self, py::args) { self.close(deadline_after(default_close_timeout)); });
+}
+
+// ################ MODULE STATE
+
+// the adapter, publisher and status callback; defined by the backend
+struct BackendState;
+
+// what one module instance owns, instead of process globals.  The bound
+// functions hold it by shared_ptr, native callbacks by weak_ptr.  Metrics,
+// the GIL profile and the tracer stay process-wide on purpose.
+struct ModuleState {
+    lifecycle::Registry resources;
+    std::shared_ptr<BackendState> backend;
+};
+
+// the python api every backend provides.  Provider needs getUUID,
+// StartAdvertising and StopAdvertising; Watcher needs getState, isPaused,
+// size, getDevices, start, stop, pause and resume.  Both are
+// lifecycle::Resources, tracked by the factories in state.resources.
+// Backends initialize lazily on first use; prewarm starts that work without
+// waiting for it.
+template <class Provider, class Watcher>
+void def_backend(py::module &m, const std::shared_ptr<ModuleState> &state,
+        void (*advertise)(ModuleState &state, const std::string &data, py::object onStatus),
+        std::shared_ptr<Provider> (*provide)(ModuleState &state, const std::string &uuid, characteristic_map characteristics),
+        py::dict (*info)(ModuleState &state),
+        void (*prewarm)(ModuleState &state),
+        std::shared_ptr<Watcher> (*watch)(ModuleState &state, std::vector<std::string> props, py::object callback,
+                double ttl, size_t maxDevices, const RssiFilter &filter)) {
+    py::class_<Provider, std::shared_ptr<Provider>> provider(m, "BLEProvider");
+    provider
+        .def_property_readonly("uuid", &Provider::getUUID)
+        .def("start", &Provider::StartAdvertising)
+        .def("stop", &Provider::StopAdvertising);
+    def_close(provider);
+
+    py::class_<Watcher, std::shared_ptr<Watcher>> watcher(m, "BLEWatcher");
+    watcher
+        .def_property_readonly("state", &Watcher::getState)
+        .def_property_readonly("paused", &Watcher::isPaused)
+        .def("__len__", &Watcher::size)
+        .def_property_readonly("devices", &Watcher::getDevices)
+        .def("start", &Watcher::start)
+        .def("stop", &Watcher::stop)
+        .def("pause", &Watcher::pause)
+        .def("resume", &Watcher::resume);
+    def_close(watcher);
+
+    m.def("advertise", [state, advertise](const std::string &data, py::object onStatus) {
+        advertise(*state, data, onStatus);
+    }, py::arg("data"), py::arg("on_status") = py::none());
+
+    m.def("provide", [state, provide](const std::string &uuid, characteristic_map characteristics) {
+        return provide(*state, uuid, characteristics);
+    });
+
+    m.def("info", [state, info]() { return info(*state); });
+
+    m.def("prewarm", [state, prewarm]() { prewarm(*state); },
+        "Start resolving the adapter in the background and return at once, "
+        "so the first info() doesn't have to wait for it");
+
+    m.def("watch", [state, watch](std::vector<std::string> props, py::object callback, double ttl, size_t maxDevices,
+            const std::string &rssiFilter, double rssiParam, double txPower, double pathLossExponent) {
+        RssiFilter filter;
+        if (!parse_rssi_filter(rssiFilter, rssiParam, filter))
+            Py_RETURN_ERROR(PyExc_ValueError, "rssi_filter must be none, ema, median or kalman with a valid rssi_param");
+        if (pathLossExponent <= 0)
+            Py_RETURN_ERROR(PyExc_ValueError, "path_loss_exponent must be positive");
+        filter.txPower = (float) txPower;
+        filter.pathLossExponent = (float) pathLossExponent;
+        return watch(*state, props, callback, ttl, maxDevices, filter);
+    }, py::arg("props"), py::arg("callback") = py::none(),
+        py::arg("ttl") = 0.0, py::arg("max_devices") = 0,
+        py::arg("rssi_filter") = "none", py::arg("rssi_param") = 0.0,
+        py::arg("tx_power") = -59.0, py::arg("path_loss_exponent") = 2.0);
+}
+
+// defined by the backend compiled in: winrt_backend.cpp or sim_backend.cpp;
+// sets state->backend
+void bind_backend(py::module &m, const std::shared_ptr<ModuleState> &state);
+
+// stops advertising and lets go of the status callback; with the GIL held
+bool backend_shutdown(ModuleState &state, uint64_t deadlineNs);
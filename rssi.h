@@ -0,0 +1,111 @@
+#pragma once
+
+// RSSI smoothing and path-loss distance for DeviceTable rows.
+//
+// Filters keep their state in plain float/int16 arrays owned by the table, so
+// the batch kernels below are straight loops over contiguous memory that the
+// compiler can vectorize.
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <string>
+
+enum class RssiFilterKind {
+    None,
+    Ema,
+    Median,
+    Kalman,
+};
+
+struct RssiFilter {
+    RssiFilterKind kind = RssiFilterKind::None;
+    float alpha = 0.25f;            // ema weight of the newest sample
+    int window = 5;                 // median-of-N
+    float processNoise = 0.05f;     // kalman q, how fast the true rssi drifts
+    float measureNoise = 9.0f;      // kalman r, variance of one reading (~3dBm sd)
+    float txPower = -59.0f;         // expected rssi at one meter
+    float pathLossExponent = 2.0f;  // 2 in free space, 2.5-4 indoors
+
+    static const int maxWindow = 15;
+};
+
+// "none", "ema", "median" or "kalman"; param tunes the chosen filter
+// (ema alpha, median window, kalman process noise), 0 keeps the default
+inline bool parse_rssi_filter(const std::string &name, double param, RssiFilter &filter) {
+    if (name.empty() || name == "none") {
+        filter.kind = RssiFilterKind::None;
+    } else if (name == "ema") {
+        filter.kind = RssiFilterKind::Ema;
+        if (param) {
+            if (param <= 0 || param > 1)
+                return false;
+            filter.alpha = (float) param;
+        }
+    } else if (name == "median") {
+        filter.kind = RssiFilterKind::Median;
+        if (param) {
+            if (param < 1 || param > RssiFilter::maxWindow)
+                return false;
+            filter.window = (int) param;
+        }
+    } else if (name == "kalman") {
+        filter.kind = RssiFilterKind::Kalman;
+        if (param) {
+            if (param < 0)
+                return false;
+            filter.processNoise = (float) param;
+        }
+    } else {
+        return false;
+    }
+    return true;
+}
+
+inline void ema_batch(float *state, const float *samples, size_t n, float alpha) {
+    for (size_t i = 0; i < n; ++i)
+        state[i] += alpha * (samples[i] - state[i]);
+}
+
+// static-model 1-D kalman: predict p += q, then correct towards the sample
+inline void kalman_batch(float *x, float *p, const float *samples, size_t n, float q, float r) {
+    for (size_t i = 0; i < n; ++i) {
+        float pp = p[i] + q;
+        float k = pp / (pp + r);
+        x[i] += k * (samples[i] - x[i]);
+        p[i] = (1.0f - k) * pp;
+    }
+}
+
+// 10 ^ ((txPower - rssi) / (10 * n)), written as exp2 so it vectorizes
+inline void distance_batch(const float *rssi, float *meters, size_t n, float txPower, float exponent) {
+    const float k = 3.321928095f / (10.0f * exponent);  // log2(10) / 10n
+    for (size_t i = 0; i < n; ++i)
+        meters[i] = exp2f((txPower - rssi[i]) * k);
+}
+
+inline float path_loss_distance(float rssi, float txPower, float exponent) {
+    float meters;
+    distance_batch(&rssi, &meters, 1, txPower, exponent);
+    return meters;
+}
+
+// pushes a sample into a row's last `window` readings and returns their median
+inline float median_push(int16_t *ring, uint8_t &count, int window, int16_t sample) {
+    if (count < window) {
+        ring[count++] = sample;
+    } else {
+        memmove(ring, ring + 1, (window - 1) * sizeof(int16_t));
+        ring[window - 1] = sample;
+    }
+    // insertion sort, the window is tiny
+    int16_t sorted[RssiFilter::maxWindow];
+    for (int i = 0; i < count; ++i) {
+        int j = i;
+        for (; j > 0 && sorted[j - 1] > ring[i]; --j)
+            sorted[j] = sorted[j - 1];
+        sorted[j] = ring[i];
+    }
+    return count & 1 ? sorted[count / 2] : (sorted[count / 2 - 1] + sorted[count / 2]) / 2.0f;
+}
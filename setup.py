@@ -1,9 +1,42 @@
 # -*- encoding: utf-8 -*-
 
-try:
-    from setuptools import setup, Extension
-except ImportError:
-    from distutils.core import setup, Extension
+# The extension is built by CMake (see CMakeLists.txt).  Extra configure
+# arguments, e.g. -DPYWINBLE_LTO=ON or -DPYWINBLE_PGO=USE, can be passed
+# through the PYWINBLE_CMAKE_ARGS environment variable.
+
+import os
+import shlex
+import subprocess
+import sys
+
+from setuptools import setup, Extension
+from setuptools.command.build_ext import build_ext
+
+
+class CMakeExtension(Extension):
+    def __init__(self, name):
+        Extension.__init__(self, name, sources=[])
+
+
+class CMakeBuild(build_ext):
+    def build_extension(self, ext):
+        here = os.path.dirname(os.path.abspath(__file__))
+        out = os.path.dirname(os.path.abspath(self.get_ext_fullpath(ext.name)))
+        config = "Debug" if self.debug else "Release"
+        args = [
+            "-DCMAKE_BUILD_TYPE=" + config,
+            "-DCMAKE_LIBRARY_OUTPUT_DIRECTORY=" + out,
+            "-DCMAKE_LIBRARY_OUTPUT_DIRECTORY_" + config.upper() + "=" + out,
+            "-DPython3_EXECUTABLE=" + sys.executable,
+            "-DPYWINBLE_BENCH=OFF",
+            "-DPYWINBLE_TESTS=OFF",
+        ]
+        args += shlex.split(os.environ.get("PYWINBLE_CMAKE_ARGS", ""))
+        os.makedirs(self.build_temp, exist_ok=True)
+        subprocess.check_call(["cmake", "-S", here, "-B", self.build_temp] + args)
+        subprocess.check_call(["cmake", "--build", self.build_temp, "--config", config,
+                               "--parallel", str(os.cpu_count() or 1)])
+
 
 setup(
     name='pywinble',
@@ -13,8 +46,6 @@ setup(
     author_email='erik@getvida.io',
     url='https://github.com/vidaid/pywinble',
     license='MIT',
-    ext_modules=[Extension('pywinble', ['pywinble.cpp'],
-        extra_compile_args = ["/std:c++17",],
-
-        )],
+    ext_modules=[CMakeExtension('pywinble')],
+    cmdclass={'build_ext': CMakeBuild},
 )
@@ -0,0 +1,617 @@
+// Simulated backend for platforms without winrt.  The adapter, advertising
+// and gatt provider are bookkeeping only; watchers see a fixed population of
+// simulated devices advertising on a background thread, with the same events,
+// states and device table as the winrt watcher.
+//
+//   PYWINBLE_SIM_DEVICES     simulated devices in range, default 16
+//   PYWINBLE_SIM_HZ          advertisements per device per second, default 4
+//   PYWINBLE_SIM_ADAPTER_MS  time the adapter lookup takes, default 0
+
+#include "pywinble.h"
+
+#include <stdlib.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <unordered_set>
+
+#include "characteristics.h"
+
+using namespace std;
+
+// ################ SIMULATED ADAPTER
+
+static const uint64_t SIM_ADAPTER_ADDRESS = 0xc0ffee000001ull;
+static const uint64_t SIM_DEVICE_BASE = 0xd1ce00000000ull;
+
+// winrt's BluetoothError::Success and BluetoothLEAdvertisementPublisherStatus::Started
+static const int SIM_AD_SUCCESS = 0;
+static const int SIM_AD_STARTED = 2;
+
+static double env_number(const char *name, double fallback) {
+    const char *value = getenv(name);
+    return value && *value ? atof(value) : fallback;
+}
+
+// mtx guards the rest and is never held while taking the GIL
+struct BackendState {
+    std::mutex mtx;
+    py::object onStatus;
+    bool advertising = false;
+    // like GetDefaultAsync, the lookup runs on first use, or in the
+    // background after prewarm()
+    std::shared_future<void> adapterLookup;
+};
+
+static std::shared_future<void> begin_adapter_lookup(BackendState &backend) {
+    std::lock_guard<std::mutex> lock(backend.mtx);
+    if (!backend.adapterLookup.valid()) {
+        metrics::count(metrics::AdapterLookups);
+        double ms = env_number("PYWINBLE_SIM_ADAPTER_MS", 0);
+        backend.adapterLookup = std::async(std::launch::async, [ms] {
+            metrics::Timer timer(metrics::AdapterLookupTime);
+            std::this_thread::sleep_for(std::chrono::duration<double, std::milli>(ms));
+        }).share();
+    }
+    return backend.adapterLookup;
+}
+
+void pywinble_prewarm(ModuleState &state) {
+    begin_adapter_lookup(*state.backend);
+}
+
+py::dict pywinble_info(ModuleState &state) {
+    auto lookup = begin_adapter_lookup(*state.backend);
+    if (lookup.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+        py::gil_scoped_release release;
+        lookup.wait();
+    }
+
+    py::dict dict;
+    dict["BluetoothAddress"] = hexlify(SIM_ADAPTER_ADDRESS, true);
+    dict["DeviceId"] = "SIM";
+    dict["IsLowEnergySupported"] = true;
+    dict["IsClassicSupported"] = false;
+    dict["IsPeripheralRoleSupported"] = true;
+    dict["IsAdvertisementOffloadSupported"] = false;
+    dict["AreLowEnergySecureConnectionsSupported"] = true;
+    return dict;
+}
+
+void pywinble_advertise(ModuleState &state, const std::string &, py::object onStatus) {
+    if (!onStatus.is_none() && !PyCallable_Check(onStatus.ptr()))
+        Py_RETURN_ERROR(PyExc_TypeError, "parameter must be callable");
+
+    BackendState &backend = *state.backend;
+    py::object callback;
+    bool restarted;
+    {
+        lock_guard<mutex> lock(backend.mtx);
+        // the old callback is released after the lock, with onStatus
+        if (!onStatus.is_none())
+            std::swap(backend.onStatus, onStatus);
+        restarted = backend.advertising;
+        backend.advertising = true;
+        callback = backend.onStatus;
+    }
+    if (restarted)
+        metrics::count(metrics::AdvertisementsStopped);
+    metrics::count(metrics::AdvertisementsStarted);
+    tracer::instant(tracer::Advertise);
+
+    // the radio comes up at once, reported the way winrt's StatusChanged does
+    if (callback) {
+        tracer::Span span(tracer::AdStatusCallback, SIM_AD_STARTED, SIM_AD_SUCCESS);
+        gil_lock acquire(gilprof::AdStatusCallback);
+        metrics::Timer timer(metrics::CallbackTime);
+        StatusCallback notify(callback);
+        notify(SIM_AD_SUCCESS, SIM_AD_STARTED);
+    }
+}
+
+// ################ SIMULATED PROVIDER
+
+class BLEProvider : public lifecycle::Resource {
+    public:
+        BLEProvider(const Guid &uuid, std::vector<CharacteristicSpec> specs) : uuid(uuid), characteristics(std::move(specs)) {
+            metrics::gauge_add(metrics::ActiveProviders, 1);
+        }
+
+        ~BLEProvider() {
+            metrics::gauge_add(metrics::ActiveProviders, -1);
+        }
+
+        bool close(uint64_t) override {
+            lock_guard<mutex> lock(mtx);
+            if (advertising)
+                stopLocked();
+            closed = true;
+            return true;
+        }
+
+        std::string getUUID() {
+            return format_guid(uuid);
+        }
+
+        void StartAdvertising() {
+            lock_guard<mutex> lock(mtx);
+            if (closed)
+                Py_RETURN_ERROR(PyExc_RuntimeError, "Provider is closed");
+            tracer::Span span(tracer::ProviderStart, tracer::guid_id(uuid));
+            metrics::Timer timer(metrics::AdvertisementStartTime);
+            metrics::count(metrics::AdvertisementsStarted);
+            advertising = true;
+        }
+
+        void StopAdvertising() {
+            lock_guard<mutex> lock(mtx);
+            stopLocked();
+        }
+
+    private:
+        Guid uuid;
+        std::vector<CharacteristicSpec> characteristics;
+        mutex mtx;
+        bool advertising = false;
+        bool closed = false;
+
+        void stopLocked() {
+            tracer::Span span(tracer::ProviderStop, tracer::guid_id(uuid));
+            metrics::Timer timer(metrics::AdvertisementStopTime);
+            metrics::count(metrics::AdvertisementsStopped);
+            advertising = false;
+        }
+};
+
+shared_ptr<BLEProvider> pywinble_provide(ModuleState &state, const std::string &uuid_str, characteristic_map characteristics) {
+    Guid uuid;
+    if (!parse_guid(uuid_str.c_str(), uuid))
+        Py_RETURN_ERROR(PyExc_ValueError, "Invalid service uuid");
+
+    auto specs = parse_characteristics(characteristics);
+
+    {
+        tracer::Span span(tracer::ProviderCreate, tracer::guid_id(uuid));
+        metrics::Timer timer(metrics::ProviderCreateTime);
+    }
+    metrics::count(metrics::ProvidersCreated);
+    for (auto &spec : specs) {
+        tracer::Span span(tracer::CharacteristicCreate, tracer::guid_id(spec.uuid));
+        metrics::Timer timer(metrics::CharacteristicCreateTime);
+        metrics::count(metrics::CharacteristicsCreated);
+    }
+
+    return lifecycle::track(state.resources, make_shared<BLEProvider>(uuid, std::move(specs)));
+}
+
+// ################ SIMULATED WATCHER
+
+class BLEWatcher : public lifecycle::Resource, public enable_shared_from_this<BLEWatcher> {
+    public:
+        BLEWatcher(std::vector<std::string>, py::object callback, double ttl, size_t maxDevices,
+                const RssiFilter &filter) : callback(callback) {
+            if (!callback.is_none() && !PyCallable_Check(callback.ptr()))
+                Py_RETURN_ERROR(PyExc_TypeError, "callback must be callable");
+            if (ttl < 0)
+                Py_RETURN_ERROR(PyExc_ValueError, "ttl must not be negative");
+            devices->setExpiry((uint64_t) (ttl * 1e9), maxDevices);
+            devices->setFilter(filter);
+            for (int i = 0; i < (int) WatchEvent::Count; ++i)
+                eventNames[i] = py::str(watch_event_name((WatchEvent) i));
+            population = (uint32_t) env_number("PYWINBLE_SIM_DEVICES", 16);
+            double hz = env_number("PYWINBLE_SIM_HZ", 4);
+            if (!population || hz <= 0)
+                Py_RETURN_ERROR(PyExc_ValueError, "PYWINBLE_SIM_DEVICES and PYWINBLE_SIM_HZ must be positive");
+            intervalNs = (uint64_t) (1e9 / (population * hz));
+            // last: the destructor that takes it back doesn't run if we throw
+            metrics::gauge_add(metrics::ActiveWatchers, 1);
+        }
+
+        void start() {
+            lock_guard<mutex> lock(mtx);
+            if (closed)
+                Py_RETURN_ERROR(PyExc_RuntimeError, "Watcher is closed");
+            paused = false;
+            resumePending = false;
+            switch (state) {
+                case WatcherState::Started:
+                case WatcherState::Enumerated:
+                    return;
+                case WatcherState::Stopping:
+                    Py_RETURN_ERROR(PyExc_RuntimeError, "Watcher is stopping");
+                default:
+                    known.clear();
+                    devices->clear();
+                    syncTracked();
+                    resyncing = false;
+                    launch();
+            }
+        }
+
+        void stop() {
+            {
+                lock_guard<mutex> lock(mtx);
+                paused = false;
+                resumePending = false;
+                if (state != WatcherState::Started && state != WatcherState::Enumerated)
+                    return;
+                state = WatcherState::Stopping;
+            }
+            halt();
+        }
+
+        // stops the simulated scan but keeps the device cache for resume()
+        void pause() {
+            {
+                lock_guard<mutex> lock(mtx);
+                if (state != WatcherState::Started && state != WatcherState::Enumerated)
+                    return;
+                paused = true;
+                state = WatcherState::Stopping;
+            }
+            halt();
+        }
+
+        void resume() {
+            lock_guard<mutex> lock(mtx);
+            if (closed)
+                Py_RETURN_ERROR(PyExc_RuntimeError, "Watcher is closed");
+            if (!paused)
+                return;
+            paused = false;
+            // paused from a callback, the scan is still winding down; finish() restarts it
+            if (state == WatcherState::Stopping) {
+                resumePending = true;
+                return;
+            }
+            resyncing = true;
+            launch();
+        }
+
+        std::string getState() {
+            lock_guard<mutex> lock(mtx);
+            return watcher_state_name(state);
+        }
+
+        bool isPaused() {
+            lock_guard<mutex> lock(mtx);
+            return paused;
+        }
+
+        size_t size() {
+            lock_guard<mutex> lock(mtx);
+            return known.size();
+        }
+
+        DeviceTableView getDevices() {
+            return DeviceTableView(devices);
+        }
+
+        // stops the scan, waits for the scan thread and its last callbacks,
+        // then lets go of the python callback
+        bool close(uint64_t deadlineNs) override {
+            shared_ptr<Worker> current;
+            std::thread scan;
+            {
+                lock_guard<mutex> lock(mtx);
+                closed = true;
+                paused = false;
+                resumePending = false;
+                if (state == WatcherState::Started || state == WatcherState::Enumerated)
+                    state = WatcherState::Stopping;
+                current = worker;
+                if (thread.joinable() && thread.get_id() != this_thread::get_id())
+                    scan = std::move(thread);
+            }
+            signal(current);
+            bool drained = true;
+            {
+                py::gil_scoped_release release;
+                if (scan.joinable()) {
+                    unique_lock<mutex> lock(current->mtx);
+                    drained = current->wake.wait_until(lock, lifecycle::time_point(deadlineNs), [&] { return current->done; });
+                }
+                // past the deadline the thread is left to finish on its own, it
+                // only holds a weak reference
+                if (drained && scan.joinable())
+                    scan.join();
+                else if (scan.joinable())
+                    scan.detach();
+                drained = gate.close(deadlineNs) && drained;
+            }
+            if (drained)
+                callback = EventCallback();
+            return drained;
+        }
+
+        ~BLEWatcher() {
+            signal(worker);
+            if (thread.joinable()) {
+                // the last reference can go inside our own callback
+                if (thread.get_id() == this_thread::get_id()) {
+                    thread.detach();
+                } else if (PyGILState_Check()) {
+                    py::gil_scoped_release release;
+                    thread.join();
+                } else {
+                    thread.join();
+                }
+            }
+            metrics::gauge_add(metrics::ActiveWatchers, -1);
+            metrics::gauge_add(metrics::TrackedDevices, -tracked);
+            // during finalization taking the GIL can hang, so the references are leaked
+            if (Py_IsInitialized() && !py::detail::interpreter_finalizing()) {
+                gil_lock gil(gilprof::WatcherTeardown);
+                callback = EventCallback();
+                for (auto &name : eventNames)
+                    name = py::object();
+            } else {
+                callback.leak();
+                for (auto &name : eventNames)
+                    name.release();
+            }
+        }
+
+    private:
+        // one per scan, so a scan that is winding down can't touch the next one
+        struct Worker {
+            mutex mtx;
+            condition_variable wake;
+            bool stop = false;
+            bool done = false;
+        };
+
+        EventCallback callback;
+        lifecycle::Gate gate;
+        py::object eventNames[(int) WatchEvent::Count];
+
+        mutex mtx;
+        WatcherState state = WatcherState::Created;
+        bool closed = false;
+        bool paused = false;
+        bool resumePending = false;
+        bool resyncing = false;
+        unordered_set<uint64_t> known;
+        shared_ptr<DeviceTable> devices = make_shared<DeviceTable>();
+        shared_ptr<Worker> worker;
+        std::thread thread;
+        uint32_t population;
+        uint64_t intervalNs;
+        int64_t tracked = 0;
+
+        static void signal(const shared_ptr<Worker> &worker) {
+            if (!worker)
+                return;
+            {
+                lock_guard<mutex> lock(worker->mtx);
+                worker->stop = true;
+            }
+            worker->wake.notify_all();
+        }
+
+        // with mtx held
+        void launch() {
+            // a scan stopped from its own callback is still unwinding; it only
+            // touches its own Worker and a weak reference, so let it finish alone
+            if (thread.joinable())
+                thread.detach();
+            worker = make_shared<Worker>();
+            state = WatcherState::Started;
+            thread = std::thread(&BLEWatcher::run, weak_ptr<BLEWatcher>(shared_from_this()), worker, intervalNs, sweepPeriod());
+        }
+
+        // stops the scan; called from python, so the GIL is let go while the
+        // scan thread finishes whatever callback it is in
+        void halt() {
+            shared_ptr<Worker> current;
+            std::thread scan;
+            {
+                lock_guard<mutex> lock(mtx);
+                current = worker;
+                if (thread.joinable() && thread.get_id() != this_thread::get_id())
+                    scan = std::move(thread);
+            }
+            signal(current);
+            if (!scan.joinable())
+                return;
+            py::gil_scoped_release release;
+            scan.join();
+        }
+
+        uint64_t sweepPeriod() {
+            if (!devices->getTtl() && !devices->getCapacity())
+                return 0;
+            // sweep four times per ttl, or once a second to flush cap evictions
+            uint64_t period = devices->getTtl() ? devices->getTtl() / 4 : 1000000000ull;
+            return period < 100000000ull ? 100000000ull : period;
+        }
+
+        // the scan thread; holds the watcher only while working on it
+        static void run(weak_ptr<BLEWatcher> weak, shared_ptr<Worker> worker, uint64_t intervalNs, uint64_t sweepNs) {
+            scan(weak, worker.get(), intervalNs, sweepNs);
+            {
+                lock_guard<mutex> lock(worker->mtx);
+                worker->done = true;
+            }
+            worker->wake.notify_all();
+        }
+
+        static void scan(const weak_ptr<BLEWatcher> &weak, Worker *worker, uint64_t intervalNs, uint64_t sweepNs) {
+            uint64_t start = steady_now();
+            uint64_t nextSweep = sweepNs ? start + sweepNs : TimingWheel::never;
+            for (uint64_t n = 0;; ++n) {
+                uint64_t due = start + n * intervalNs;
+                {
+                    unique_lock<mutex> lock(worker->mtx);
+                    auto until = chrono::duration_cast<chrono::steady_clock::duration>(chrono::nanoseconds(due < nextSweep ? due : nextSweep));
+                    worker->wake.wait_until(lock, chrono::steady_clock::time_point(until), [&] { return worker->stop; });
+                    if (worker->stop)
+                        break;
+                }
+                auto self = weak.lock();
+                if (!self)
+                    return;
+                uint64_t now = steady_now();
+                if (now >= nextSweep) {
+                    self->expireDevices(worker);
+                    nextSweep = now + sweepNs;
+                }
+                if (now >= due)
+                    self->sight(worker, n);
+                else
+                    --n;
+            }
+            if (auto self = weak.lock())
+                self->finish(worker);
+        }
+
+        void sight(const Worker *current, uint64_t n) {
+            uint32_t index = (uint32_t) (n % population);
+            uint64_t address = SIM_DEVICE_BASE | (index + 1);
+            // each device sits at a fixed distance, readings scatter a few dBm around it
+            int16_t rssi = (int16_t) (-60 - (int) ((index * 2654435761u) >> 27) - (int) ((n * 40503u) % 9) + 4);
+            WatchEvent type;
+            bool notify, completed = false;
+            {
+                lock_guard<mutex> lock(mtx);
+                if (current != worker.get())
+                    return;
+                metrics::count(metrics::WatcherEventsReceived);
+                std::string name = "sim-" + std::to_string(index + 1);
+                devices->upsert(address, rssi, steady_now(), &name);
+                syncTracked();
+                bool added = known.insert(address).second;
+                type = added ? WatchEvent::Added : WatchEvent::Updated;
+                // re-enumeration after resume: known devices are refreshed silently
+                notify = added || !resyncing;
+                if (n + 1 == population) {
+                    if (state == WatcherState::Started)
+                        state = WatcherState::Enumerated;
+                    completed = !resyncing;
+                    resyncing = false;
+                }
+            }
+            if (notify)
+                onCb(type, address);
+            if (completed)
+                onCb(WatchEvent::Completed);
+        }
+
+        // reports devices aged out by ttl or evicted by the size cap, under one GIL hold
+        void expireDevices(const Worker *current) {
+            std::vector<uint64_t> lost;
+            {
+                lock_guard<mutex> lock(mtx);
+                if (current != worker.get() || resyncing)
+                    return;
+                if (!devices->expire(steady_now(), lost))
+                    return;
+                syncTracked();
+                for (auto address : lost)
+                    known.erase(address);
+            }
+            lifecycle::Gate::Pass pass(gate);
+            if (!pass)
+                return;
+            tracer::Span span(tracer::WatcherExpiry, lost.size());
+            unique_ptr<gil_lock> gil;
+            if (callback)
+                gil.reset(new gil_lock(gilprof::WatcherExpiry));
+            for (auto address : lost)
+                onCb(WatchEvent::Lost, address);
+        }
+
+        void finish(const Worker *current) {
+            bool notify;
+            {
+                lock_guard<mutex> lock(mtx);
+                if (current != worker.get())
+                    return;
+                state = WatcherState::Stopped;
+                notify = !paused && !resumePending;
+                if (resumePending) {
+                    resumePending = false;
+                    resyncing = true;
+                    launch();
+                }
+            }
+            if (notify)
+                onCb(WatchEvent::Stopped);
+        }
+
+        void syncTracked() {
+            int64_t now = (int64_t) devices->size();
+            metrics::gauge_add(metrics::TrackedDevices, now - tracked);
+            tracked = now;
+        }
+
+        // callback(event, id, properties), shaped like the winrt watcher's
+        void onCb(WatchEvent type, uint64_t address = 0) {
+            static_assert(tracer::WatcherLost - tracer::WatcherAdded == (int) WatchEvent::Lost, "trace kinds follow WatchEvent");
+            tracer::Span span((tracer::Kind) (tracer::WatcherAdded + (int) type), address);
+
+            // close() drops the callback once nothing is inside this gate
+            lifecycle::Gate::Pass pass(gate);
+            if (!pass || !callback)
+                return;
+
+            gil_lock gil(gilprof::WatcherEvent);
+            metrics::Timer timer(metrics::CallbackTime);
+            try {
+                callPython(type, address);
+            } catch (py::error_already_set &e) {
+                metrics::count(metrics::CallbackErrors);
+                e.restore();
+                PyErr_WriteUnraisable(callback.function().ptr());
+            }
+            metrics::count(metrics::WatcherEventsDelivered);
+        }
+
+        void callPython(WatchEvent type, uint64_t address) {
+            py::object id = py::none();
+            py::dict props;
+            if (address) {
+                std::string text = format_address(address);
+                id = py::str("BluetoothLE#BluetoothLE" + hexlify(SIM_ADAPTER_ADDRESS, true) + "-" + text);
+                props["System.Devices.Aep.DeviceAddress"] = text;
+                DeviceTable::Row row;
+                if (devices->get(address, row)) {
+                    props["System.Devices.Aep.SignalStrength"] = py::reinterpret_steal<py::object>(pycall::int_object(row.rssi));
+                    props["System.ItemNameDisplay"] = row.name;
+                    props["rssi"] = row.smoothed;
+                    props["distance"] = row.distance;
+                }
+            }
+            callback(eventNames[(int) type], id, props);
+        }
+};
+
+shared_ptr<BLEWatcher> pywinble_watch(ModuleState &state, vector<string> props, py::object callback, double ttl,
+        size_t maxDevices, const RssiFilter &filter) {
+    return lifecycle::track(state.resources, make_shared<BLEWatcher>(props, callback, ttl, maxDevices, filter));
+}
+
+bool backend_shutdown(ModuleState &state, uint64_t) {
+    BackendState &backend = *state.backend;
+    py::object callback;
+    bool stopped;
+    {
+        lock_guard<mutex> lock(backend.mtx);
+        stopped = backend.advertising;
+        backend.advertising = false;
+        std::swap(callback, backend.onStatus);
+    }
+    if (stopped)
+        metrics::count(metrics::AdvertisementsStopped);
+    return true;
+}
+
+void bind_backend(py::module &m, const std::shared_ptr<ModuleState> &state) {
+    state->backend = make_shared<BackendState>();
+    def_backend<BLEProvider, BLEWatcher>(m, state, pywinble_advertise, pywinble_provide, pywinble_info, pywinble_prewarm,
+        pywinble_watch);
+    m.attr("backend") = "sim";
+}
@@ -0,0 +1,376 @@
+#pragma once
+
+// Simulated peer fleet for load testing code built on the module.
+//
+// Producer threads play the radio: `advertisers` devices advertising at
+// advertiseHz each, and `clients` GATT clients writing to the provider at
+// writeHz each.  Every advertisement is seen by every simulated watcher and
+// writes go to the one simulated provider.  Each watcher and the provider has
+// a bounded queue and a delivery thread of its own, like the winrt callback
+// threads; an event that finds its queue full is dropped and counted.
+//
+// Latency runs from when the radio was scheduled to produce an event to when
+// the sink enters its callback, so a producer that falls behind shows up as
+// latency instead of quietly lowering the offered load.
+
+#include <stdint.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "devtable.h"
+#include "lifecycle.h"
+#include "metrics.h"
+#include "util.h"
+
+namespace simfleet {
+
+enum Stream {
+    Advertisement,
+    Write,
+    StreamCount
+};
+
+struct Config {
+    uint32_t advertisers = 100;
+    double advertiseHz = 10;
+    uint32_t clients = 0;
+    double writeHz = 10;
+    uint32_t characteristics = 1;
+    uint32_t payloadSize = 20;      // default att mtu of 23 less the header
+    uint32_t watchers = 1;
+    size_t queueCapacity = 4096;
+    uint32_t producers = 1;
+    RssiFilter filter;
+
+    static const uint32_t maxPayload = 244;     // le data length extension
+};
+
+struct Event {
+    uint64_t dueNs;
+    uint64_t device;            // advertiser address, or client index for writes
+    uint32_t seq;
+    int16_t rssi;
+    uint16_t characteristic;
+    uint8_t length;
+    uint8_t payload[Config::maxPayload];
+};
+
+// table is the watcher's device table, already holding the sighting, and added
+// says the row is new; writes get null and false.  deliver sets enteredNs when
+// it hands the event to its callback.
+typedef std::function<void(Stream stream, size_t sink, const Event &event, DeviceTable *table, bool added, uint64_t &enteredNs)> Deliver;
+
+class EventQueue {
+    public:
+        EventQueue(size_t capacity) : ring(capacity ? capacity : 1) {}
+
+        bool push(const Event &event) {
+            {
+                std::lock_guard<std::mutex> lock(mtx);
+                if (closed || count == ring.size())
+                    return false;
+                ring[(head + count) % ring.size()] = event;
+                ++count;
+            }
+            ready.notify_one();
+            return true;
+        }
+
+        // waits for events, takes up to max; false once closed, whatever is
+        // left stays for discard()
+        bool pop(std::vector<Event> &out, size_t max) {
+            std::unique_lock<std::mutex> lock(mtx);
+            ready.wait(lock, [this] { return count || closed; });
+            if (closed)
+                return false;
+            size_t n = count < max ? count : max;
+            for (size_t i = 0; i < n; ++i) {
+                out.push_back(ring[head]);
+                head = (head + 1) % ring.size();
+            }
+            count -= n;
+            return true;
+        }
+
+        // refuses new events; whatever is still queued is returned by discard()
+        void close() {
+            {
+                std::lock_guard<std::mutex> lock(mtx);
+                closed = true;
+            }
+            ready.notify_all();
+        }
+
+        size_t discard() {
+            std::lock_guard<std::mutex> lock(mtx);
+            size_t n = count;
+            head = count = 0;
+            return n;
+        }
+
+    private:
+        std::mutex mtx;
+        std::condition_variable ready;
+        std::vector<Event> ring;
+        size_t head = 0, count = 0;
+        bool closed = false;
+};
+
+struct StreamReport {
+    uint64_t produced = 0;
+    uint64_t delivered = 0;
+    uint64_t dropped = 0;
+    metrics::HistogramData latency;     // scheduled radio event to callback entry
+    metrics::HistogramData callback;    // time spent in the callback
+};
+
+struct Report {
+    double seconds = 0;
+    size_t devices = 0;                 // rows in the first watcher's table
+    StreamReport streams[StreamCount];
+};
+
+class Fleet {
+    public:
+        Fleet(const Config &config, Deliver deliver) : config(config), deliver(deliver) {
+            if (!this->config.producers)
+                this->config.producers = 1;
+            if (this->config.payloadSize > Config::maxPayload)
+                this->config.payloadSize = Config::maxPayload;
+        }
+
+        ~Fleet() {
+            stop();
+        }
+
+        Fleet(const Fleet &) = delete;
+        Fleet &operator=(const Fleet &) = delete;
+
+        // false when already running
+        bool start() {
+            std::lock_guard<std::mutex> lock(control);
+            if (running_)
+                return false;
+            // every run starts from empty tables and counters
+            sinks.clear();
+            for (uint32_t i = 0; i < config.watchers; ++i) {
+                auto table = std::make_shared<DeviceTable>();
+                table->setFilter(config.filter);
+                sinks.emplace_back(new Sink(Advertisement, config.queueCapacity, table));
+            }
+            if (config.clients)
+                sinks.emplace_back(new Sink(Write, config.queueCapacity, nullptr));
+            stopping = false;
+            draining = sinks.size();
+            startNs = steady_now();
+            stopNs = 0;
+            for (size_t i = 0; i < sinks.size(); ++i)
+                threads.emplace_back(&Fleet::drain, this, i);
+            for (uint32_t i = 0; i < config.producers; ++i)
+                threads.emplace_back(&Fleet::produce, this, i);
+            running_ = true;
+            return true;
+        }
+
+        // stops the radio and delivery: events still queued, and any the
+        // producers offer until they notice, count as dropped.  A callback in
+        // flight is the only one left to finish; false if one still hadn't by
+        // deadlineNs, and the fleet keeps running until a later stop() joins it.
+        bool stop(uint64_t deadlineNs = UINT64_MAX) {
+            std::lock_guard<std::mutex> lock(control);
+            if (!running_)
+                return true;
+            if (!stopping) {
+                stopping = true;
+                for (auto &sink : sinks)
+                    sink->queue->close();
+                for (size_t i = sinks.size(); i < threads.size(); ++i)
+                    threads[i].join();
+                stopNs = steady_now();
+            }
+            {
+                std::unique_lock<std::mutex> wait(drainMtx);
+                auto idle = [this] { return !draining; };
+                if (deadlineNs == UINT64_MAX)
+                    drained.wait(wait, idle);
+                else if (!drained.wait_until(wait, lifecycle::time_point(deadlineNs), idle))
+                    return false;
+            }
+            for (size_t i = 0; i < sinks.size(); ++i)
+                threads[i].join();
+            threads.clear();
+            running_ = false;
+            return true;
+        }
+
+        bool running() {
+            std::lock_guard<std::mutex> lock(control);
+            return running_;
+        }
+
+        const Config &getConfig() const {
+            return config;
+        }
+
+        // watcher's device table from the latest run, or null
+        std::shared_ptr<DeviceTable> table(size_t watcher) {
+            std::lock_guard<std::mutex> lock(control);
+            return watcher < sinks.size() ? sinks[watcher]->table : nullptr;
+        }
+
+        // safe to call while running
+        Report report() {
+            Report out;
+            std::lock_guard<std::mutex> lock(control);
+            uint64_t end = stopNs ? stopNs : steady_now();
+            out.seconds = startNs ? (end - startNs) / 1e9 : 0;
+            for (auto &sink : sinks) {
+                StreamReport &stream = out.streams[sink->stream];
+                stream.produced += sink->produced.load(std::memory_order_relaxed);
+                stream.delivered += sink->delivered.load(std::memory_order_relaxed);
+                stream.dropped += sink->dropped.load(std::memory_order_relaxed);
+                sink->latency.addTo(stream.latency);
+                sink->callback.addTo(stream.callback);
+            }
+            if (!sinks.empty() && sinks[0]->table)
+                out.devices = sinks[0]->table->size();
+            return out;
+        }
+
+    private:
+        struct Sink {
+            Stream stream;
+            std::unique_ptr<EventQueue> queue;
+            std::shared_ptr<DeviceTable> table;
+            std::atomic<uint64_t> produced, delivered, dropped;
+            metrics::AtomicHistogram latency, callback;
+
+            Sink(Stream stream, size_t capacity, std::shared_ptr<DeviceTable> table)
+                : stream(stream), queue(new EventQueue(capacity)), table(table) {
+                produced.store(0, std::memory_order_relaxed);
+                delivered.store(0, std::memory_order_relaxed);
+                dropped.store(0, std::memory_order_relaxed);
+            }
+        };
+
+        Config config;
+        Deliver deliver;
+        std::vector<std::unique_ptr<Sink>> sinks;
+        std::vector<std::thread> threads;       // delivery threads first, then producers
+        std::mutex control;
+        std::atomic<bool> stopping{false};
+        bool running_ = false;
+        // delivery threads yet to finish, so stop() can give up on them
+        std::mutex drainMtx;
+        std::condition_variable drained;
+        size_t draining = 0;
+        uint64_t startNs = 0, stopNs = 0;
+
+        void offer(Sink &sink, const Event &event) {
+            sink.produced.fetch_add(1, std::memory_order_relaxed);
+            if (!sink.queue->push(event))
+                sink.dropped.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        // producer `index` owns every producers'th advertiser and client,
+        // each stream evenly spaced at its share of the total rate
+        void produce(uint32_t index) {
+            uint32_t step = config.producers;
+            uint32_t advertisers = config.advertisers / step + (index < config.advertisers % step);
+            uint32_t clients = config.clients / step + (index < config.clients % step);
+            double advRate = config.advertiseHz > 0 ? advertisers * config.advertiseHz : 0;
+            double writeRate = config.writeHz > 0 ? clients * config.writeHz : 0;
+            uint64_t advInterval = advRate > 0 ? (uint64_t) (1e9 / advRate) : 0;
+            uint64_t writeInterval = writeRate > 0 ? (uint64_t) (1e9 / writeRate) : 0;
+            uint64_t never = TimingWheel::never;
+            uint64_t nextAdv = advInterval ? startNs + index * advInterval / step : never;
+            uint64_t nextWrite = writeInterval ? startNs + index * writeInterval / step : never;
+            uint64_t advCount = 0, writeCount = 0;
+
+            std::mt19937 rng(index + 1);
+            Event event;
+            while (!stopping.load(std::memory_order_relaxed)) {
+                uint64_t due = nextAdv < nextWrite ? nextAdv : nextWrite;
+                if (due == never)
+                    break;
+                uint64_t now = steady_now();
+                if (due > now) {
+                    // short sleeps keep stop() prompt
+                    uint64_t wait = due - now < 1000000 ? due - now : 1000000;
+                    std::this_thread::sleep_for(std::chrono::nanoseconds(wait));
+                    continue;
+                }
+                event.dueNs = due;
+                if (due == nextAdv) {
+                    uint32_t device = index + (uint32_t) (advCount % advertisers) * step;
+                    event.device = 0xC0FFEE000000ull | device;
+                    event.seq = (uint32_t) (advCount / advertisers);
+                    // each device has a fixed distance, readings scatter a few dBm around it
+                    event.rssi = (int16_t) (-40 - (int) ((device * 2654435761u) >> 27) - (int) (rng() % 9) + 4);
+                    event.characteristic = 0;
+                    event.length = 0;
+                    for (auto &sink : sinks) {
+                        if (sink->stream == Advertisement)
+                            offer(*sink, event);
+                    }
+                    ++advCount;
+                    nextAdv = startNs + (uint64_t) (advCount * 1e9 / advRate) + index * advInterval / step;
+                } else {
+                    uint32_t client = index + (uint32_t) (writeCount % clients) * step;
+                    event.device = client;
+                    event.seq = (uint32_t) (writeCount / clients);
+                    event.rssi = 0;
+                    event.characteristic = (uint16_t) (event.seq % (config.characteristics ? config.characteristics : 1));
+                    event.length = (uint8_t) config.payloadSize;
+                    for (uint32_t i = 0; i < config.payloadSize; ++i)
+                        event.payload[i] = (uint8_t) (event.seq + i);
+                    offer(*sinks.back(), event);
+                    ++writeCount;
+                    nextWrite = startNs + (uint64_t) (writeCount * 1e9 / writeRate) + index * writeInterval / step;
+                }
+            }
+        }
+
+        void drain(size_t index) {
+            Sink &sink = *sinks[index];
+            std::vector<Event> batch;
+            while (sink.queue->pop(batch, 64)) {
+                for (size_t i = 0; i < batch.size(); ++i) {
+                    if (stopping.load(std::memory_order_relaxed)) {
+                        sink.dropped.fetch_add(batch.size() - i, std::memory_order_relaxed);
+                        break;
+                    }
+                    const Event &event = batch[i];
+                    bool added = false;
+                    if (sink.table) {
+                        added = !sink.table->contains(event.device);
+                        sink.table->upsert(event.device, event.rssi, steady_now());
+                    }
+                    uint64_t entered = 0;
+                    deliver(sink.stream, index, event, sink.table.get(), added, entered);
+                    uint64_t done = steady_now();
+                    if (!entered)
+                        entered = done;
+                    sink.latency.record(entered > event.dueNs ? entered - event.dueNs : 0);
+                    sink.callback.record(done - entered);
+                    metrics::bump(sink.delivered, 1);
+                }
+                batch.clear();
+            }
+            sink.dropped.fetch_add(sink.queue->discard(), std::memory_order_relaxed);
+            {
+                std::lock_guard<std::mutex> lock(drainMtx);
+                --draining;
+            }
+            drained.notify_all();
+        }
+};
+
+}
@@ -0,0 +1,113 @@
+#pragma once
+
+// Minimal test runner for the module's header-only parts, so the tests build
+// anywhere without extra packages:
+//
+//   TEST(upsert_then_get) {
+//       DeviceTable table(0);
+//       table.upsert(1, -60, 0);
+//       CHECK_EQ(table.size(), 1u);
+//   }
+//
+//   CHECK_MAIN()
+//
+// A failed check prints where and what, and the test carries on; the binary
+// exits non-zero if any check failed.  An argument runs only the tests whose
+// name contains it.
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace check {
+
+typedef void (*Function)();
+
+struct Test {
+    const char *name;
+    Function fn;
+};
+
+inline std::vector<Test> &registry() {
+    static std::vector<Test> tests;
+    return tests;
+}
+
+inline int add(const char *name, Function fn) {
+    registry().push_back(Test{name, fn});
+    return 0;
+}
+
+inline int &failures() {
+    static int count = 0;
+    return count;
+}
+
+template <typename T>
+std::string show(const T &value) {
+    std::ostringstream out;
+    out << value;
+    return out.str();
+}
+
+inline std::string show(uint8_t value) {
+    return std::to_string((unsigned) value);
+}
+
+inline std::string show(int8_t value) {
+    return std::to_string((int) value);
+}
+
+inline bool fail(const char *file, int line, const std::string &what) {
+    fprintf(stderr, "%s:%d: %s\n", file, line, what.c_str());
+    ++failures();
+    return false;
+}
+
+template <typename A, typename B>
+bool equal(const A &a, const B &b, const char *expr, const char *file, int line) {
+    if (a == b)
+        return true;
+    return fail(file, line, std::string(expr) + ": " + show(a) + " != " + show(b));
+}
+
+inline bool near(double a, double b, double tolerance, const char *expr, const char *file, int line) {
+    if (fabs(a - b) <= tolerance)
+        return true;
+    return fail(file, line, std::string(expr) + ": " + show(a) + " not within " + show(tolerance) + " of " + show(b));
+}
+
+inline int run(int argc, char **argv) {
+    const char *filter = argc > 1 ? argv[1] : "";
+    int ran = 0, failed = 0;
+    for (auto &t : registry()) {
+        if (!strstr(t.name, filter))
+            continue;
+        int before = failures();
+        t.fn();
+        ++ran;
+        if (failures() != before) {
+            printf("FAIL %s\n", t.name);
+            ++failed;
+        }
+    }
+    printf("%d tests, %d failed\n", ran, failed);
+    return failed || !ran ? 1 : 0;
+}
+
+}
+
+#define TEST(name) \
+    static void test_##name(); \
+    static int check_registered_##name = check::add(#name, test_##name); \
+    static void test_##name()
+
+#define CHECK(cond) ((cond) || check::fail(__FILE__, __LINE__, "CHECK(" #cond ")"))
+#define CHECK_EQ(a, b) check::equal((a), (b), #a " == " #b, __FILE__, __LINE__)
+#define CHECK_NEAR(a, b, tolerance) check::near((a), (b), (tolerance), #a " ~ " #b, __FILE__, __LINE__)
+
+#define CHECK_MAIN() int main(int argc, char **argv) { return check::run(argc, argv); }
@@ -0,0 +1,31 @@
+// Overloads whose acceptance depends on the value as well as the type, for
+// test_overloads.py: which one runs must not depend on earlier calls.
+
+#include <Python.h>
+#include "pybind11/pybind11.h"
+
+#include <stdint.h>
+
+namespace py = pybind11;
+
+struct Widget {};
+struct Gadget {};
+
+PYBIND11_MODULE(overloads, m) {
+    py::class_<Widget>(m, "Widget").def(py::init<>());
+    py::class_<Gadget>(m, "Gadget").def(py::init<>());
+
+    // a large int overflows int32 and only the conversion pass takes it
+    m.def("f", [](int32_t) { return "int32"; });
+    m.def("f", [](double) { return "double"; });
+
+    // a large int overflows int32 and int64 takes it without conversion
+    m.def("g", [](int32_t) { return "int32"; });
+    m.def("g", [](int64_t) { return "int64"; });
+
+    // registered classes are told apart by type alone
+    m.def("k", [](const Widget &) { return "widget"; });
+    m.def("k", [](const Gadget &) { return "gadget"; });
+    m.def("k", [](int32_t) { return "int32"; });
+    m.def("k", [](double) { return "double"; });
+}
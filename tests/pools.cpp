@@ -0,0 +1,23 @@
+// A class with py::instance_pool and one without, for test_pools.py.
+
+#include <Python.h>
+#include "pybind11/pybind11.h"
+
+namespace py = pybind11;
+
+struct Pooled { int value = 0; };
+struct Plain { int value = 0; };
+struct Dynamic {};
+
+PYBIND11_MODULE(pools, m) {
+    py::class_<Pooled>(m, "Pooled", py::instance_pool(4))
+        .def(py::init<>())
+        .def_readwrite("value", &Pooled::value);
+    py::class_<Plain>(m, "Plain")
+        .def(py::init<>())
+        .def_readwrite("value", &Plain::value);
+
+    m.def("pooled_with_dynamic_attr", [](py::module scope) {
+        py::class_<Dynamic>(scope, "Dynamic", py::instance_pool(), py::dynamic_attr());
+    });
+}
@@ -0,0 +1,342 @@
+// DeviceTable: the address index, rows and generation diffs.  Every call takes
+// an explicit `now`, so nothing here depends on the clock.
+
+#include "devtable.h"
+
+#include <algorithm>
+
+#include "check.h"
+
+static const uint64_t base = 0xd1ce00000000ull;
+
+static std::vector<uint64_t> sorted(std::vector<uint64_t> v) {
+    std::sort(v.begin(), v.end());
+    return v;
+}
+
+TEST(address_text) {
+    CHECK_EQ(format_address(0xaabbccddeeffull), "aa:bb:cc:dd:ee:ff");
+    CHECK_EQ(format_address(1), "00:00:00:00:00:01");
+    uint64_t addr = 0;
+    CHECK(parse_address("AA-bb-cc-dd-ee-ff", addr));
+    CHECK_EQ(addr, 0xaabbccddeeffull);
+    CHECK(parse_address("c0ffee000001", addr));
+    CHECK_EQ(addr, 0xc0ffee000001ull);
+    CHECK(!parse_address("", addr));
+    CHECK(!parse_address("aa:bb:cc:dd:ee:ff:00", addr));
+    CHECK(!parse_address("aa:bb:zz", addr));
+}
+
+TEST(upsert_get_remove) {
+    DeviceTable table(0);
+    std::string name = "one";
+    table.upsert(base | 1, -60, 10, &name);
+    table.upsert(base | 2, -70, 20);
+
+    DeviceTable::Row row;
+    CHECK(table.get(base | 1, row));
+    CHECK_EQ(row.address, base | 1);
+    CHECK_EQ(row.rssi, -60);
+    CHECK_EQ(row.lastSeen, 10u);
+    CHECK_EQ(row.name, "one");
+
+    // a refresh without a name keeps the old one
+    table.upsert(base | 1, -65, 30);
+    CHECK(table.get(base | 1, row));
+    CHECK_EQ(row.rssi, -65);
+    CHECK_EQ(row.lastSeen, 30u);
+    CHECK_EQ(row.name, "one");
+
+    CHECK_EQ(table.size(), 2u);
+    CHECK(table.remove(base | 1));
+    CHECK(!table.remove(base | 1));
+    CHECK(!table.contains(base | 1));
+    CHECK(table.contains(base | 2));
+    CHECK_EQ(table.size(), 1u);
+}
+
+// enough rows to rehash several times, then swap-removes all through the table
+TEST(index_survives_growth_and_removal) {
+    DeviceTable table(0);
+    const uint64_t n = 5000;
+    for (uint64_t i = 0; i < n; ++i)
+        table.upsert(base | i, (int16_t) -(int) (i % 90), i);
+    CHECK_EQ(table.size(), n);
+
+    for (uint64_t i = 0; i < n; i += 2)
+        CHECK(table.remove(base | i));
+    CHECK_EQ(table.size(), n / 2);
+
+    bool ok = true;
+    for (uint64_t i = 0; i < n; ++i) {
+        DeviceTable::Row row;
+        bool found = table.get(base | i, row);
+        ok &= found == (i % 2 == 1);
+        if (found)
+            ok &= row.address == (base | i) && row.rssi == -(int) (i % 90) && row.lastSeen == i;
+    }
+    CHECK(ok);
+
+    std::vector<uint64_t> odd;
+    for (uint64_t i = 1; i < n; i += 2)
+        odd.push_back(base | i);
+    CHECK(sorted(table.keys()) == odd);
+}
+
+TEST(versions_stamp_changed_rows) {
+    DeviceTable table(0);
+    uint64_t v1 = table.upsert(base | 1, -60, 0);
+    uint64_t v2 = table.upsert(base | 2, -60, 0);
+    CHECK(v2 > v1);
+    CHECK_EQ(table.version(), v2);
+
+    std::vector<DeviceTable::Row> changed;
+    std::vector<uint64_t> gone;
+    uint64_t current;
+    CHECK(table.changesSince(v1, changed, gone, current));
+    CHECK_EQ(current, v2);
+    CHECK_EQ(changed.size(), 1u);
+    CHECK_EQ(changed[0].address, base | 2);
+    CHECK(gone.empty());
+
+    // nothing new since the current version
+    changed.clear();
+    CHECK(table.changesSince(current, changed, gone, current));
+    CHECK(changed.empty());
+}
+
+TEST(changes_report_removals) {
+    DeviceTable table(0);
+    for (uint64_t i = 1; i <= 3; ++i)
+        table.upsert(base | i, -60, 0);
+    uint64_t since = table.version();
+
+    table.remove(base | 1);
+    table.remove(base | 2);
+    // seen again after removal: reported as changed, not gone
+    table.upsert(base | 2, -61, 1);
+
+    std::vector<DeviceTable::Row> changed;
+    std::vector<uint64_t> gone;
+    uint64_t current;
+    CHECK(table.changesSince(since, changed, gone, current));
+    CHECK_EQ(changed.size(), 1u);
+    CHECK_EQ(changed[0].address, base | 2);
+    CHECK(gone == std::vector<uint64_t>{base | 1});
+}
+
+TEST(clear_reports_every_row_gone) {
+    DeviceTable table(0);
+    for (uint64_t i = 1; i <= 3; ++i)
+        table.upsert(base | i, -60, 0);
+    uint64_t since = table.version();
+    table.clear();
+    CHECK_EQ(table.size(), 0u);
+
+    std::vector<DeviceTable::Row> changed;
+    std::vector<uint64_t> gone;
+    uint64_t current;
+    CHECK(table.changesSince(since, changed, gone, current));
+    CHECK(changed.empty());
+    CHECK(sorted(gone) == (std::vector<uint64_t>{base | 1, base | 2, base | 3}));
+}
+
+// past maxRemovedLog removals the oldest are forgotten: a diff from before
+// them is incomplete and hands back every row, a later one still works
+TEST(changes_truncate_past_removed_log) {
+    DeviceTable table(0);
+    const uint64_t keep = 10, churn = DeviceTable::maxRemovedLog + 1;
+    for (uint64_t i = 0; i < keep; ++i)
+        table.upsert(base | i, -60, 0);
+    uint64_t start = table.version();
+
+    std::vector<uint64_t> afterHalf;
+    uint64_t half = 0;
+    for (uint64_t i = 0; i < churn; ++i) {
+        table.upsert(0x100000000ull | i, -60, 0);
+        table.remove(0x100000000ull | i);
+        if (i + 1 == churn - 16)
+            half = table.version();
+        else if (i + 1 > churn - 16)
+            afterHalf.push_back(0x100000000ull | i);
+    }
+
+    std::vector<DeviceTable::Row> changed;
+    std::vector<uint64_t> gone;
+    uint64_t current;
+    CHECK(!table.changesSince(start, changed, gone, current));
+    CHECK_EQ(changed.size(), keep);
+    CHECK(gone.empty());
+    CHECK_EQ(current, table.version());
+
+    changed.clear();
+    CHECK(table.changesSince(half, changed, gone, current));
+    CHECK(changed.empty());
+    CHECK(sorted(gone) == afterHalf);
+}
+
+TEST(batch_matches_single_upserts) {
+    RssiFilter filter;
+    CHECK(parse_rssi_filter("kalman", 0, filter));
+    DeviceTable single(0), batch(0);
+    single.setFilter(filter);
+    batch.setFilter(filter);
+
+    // repeats within one batch must see the earlier sighting's state
+    const uint64_t addresses[] = {base | 1, base | 2, base | 1, base | 3, base | 1, base | 2};
+    const int16_t rssis[] = {-60, -70, -64, -80, -58, -72};
+    for (int round = 0; round < 4; ++round) {
+        for (size_t i = 0; i < 6; ++i)
+            single.upsert(addresses[i], rssis[i], round);
+        batch.upsertBatch(addresses, rssis, 6, round);
+    }
+
+    auto a = single.rows(), b = batch.rows();
+    CHECK_EQ(a.size(), b.size());
+    for (size_t i = 0; i < a.size() && i < b.size(); ++i) {
+        CHECK_EQ(a[i].address, b[i].address);
+        CHECK_NEAR(a[i].smoothed, b[i].smoothed, 1e-4);
+        CHECK_NEAR(a[i].distance, b[i].distance, 1e-4);
+    }
+}
+
+// a sighting without a signal strength refreshes the row but isn't a reading
+TEST(no_reading_leaves_the_filter_alone) {
+    RssiFilter filter;
+    CHECK(parse_rssi_filter("ema", 0.5, filter));
+    DeviceTable table(0);
+    table.setFilter(filter);
+    std::string name = "quiet";
+    table.upsert(base | 1, DeviceTable::noReading, 10, &name);
+
+    DeviceTable::Row row;
+    CHECK(table.get(base | 1, row));
+    CHECK(row.rssi == DeviceTable::noReading);
+    CHECK(row.smoothed != row.smoothed);
+    CHECK(row.distance != row.distance);
+    CHECK_EQ(row.name, "quiet");
+    // a new filter doesn't make one up either
+    table.setFilter(filter);
+    CHECK(table.get(base | 1, row));
+    CHECK(row.distance != row.distance);
+
+    // the first reading starts the filter, a missing one after it changes nothing
+    table.upsert(base | 1, -60, 20);
+    table.upsert(base | 1, DeviceTable::noReading, 30);
+    CHECK(table.get(base | 1, row));
+    CHECK_EQ(row.rssi, -60);
+    CHECK_NEAR(row.smoothed, -60, 1e-6);
+    CHECK_EQ(row.lastSeen, 30u);
+    table.upsert(base | 1, -70, 40);
+    CHECK(table.get(base | 1, row));
+    CHECK_NEAR(row.smoothed, -65, 1e-6);
+
+    const uint64_t addresses[] = {base | 1, base | 2, base | 1};
+    const int16_t rssis[] = {DeviceTable::noReading, DeviceTable::noReading, -75};
+    table.upsertBatch(addresses, rssis, 3, 50);
+    CHECK(table.get(base | 1, row));
+    CHECK_NEAR(row.smoothed, -70, 1e-6);
+    CHECK(table.get(base | 2, row));
+    CHECK(row.smoothed != row.smoothed);
+}
+
+// ################ EXPIRY AND EVICTION
+
+static const uint64_t ms = 1000000;
+
+static std::vector<uint64_t> expire(DeviceTable &table, uint64_t now) {
+    std::vector<uint64_t> lost;
+    table.expire(now, lost);
+    return lost;
+}
+
+TEST(ttl_expires_rows_not_seen_since) {
+    DeviceTable table(0);
+    table.setExpiry(1000 * ms, 0, 0);
+    table.upsert(base | 1, -60, 0);
+    table.upsert(base | 2, -60, 500 * ms);
+    table.upsert(base | 3, -60, 100 * ms);
+    // refreshed: its deadline moves
+    table.upsert(base | 1, -60, 900 * ms);
+
+    // never early, at most one wheel tick (a sixteenth of the ttl) late
+    const uint64_t tick = 1000 * ms / 16;
+    CHECK(expire(table, 1100 * ms - 1).empty());
+    CHECK(expire(table, 1100 * ms + tick) == std::vector<uint64_t>{base | 3});
+    CHECK(expire(table, 1500 * ms - 1).empty());
+    CHECK(expire(table, 1500 * ms + tick) == std::vector<uint64_t>{base | 2});
+    CHECK(expire(table, 1900 * ms - 1).empty());
+    CHECK(expire(table, 1900 * ms + tick) == std::vector<uint64_t>{base | 1});
+    CHECK_EQ(table.size(), 0u);
+}
+
+TEST(ttl_set_later_applies_to_existing_rows) {
+    DeviceTable table(0);
+    table.upsert(base | 1, -60, 0);
+    CHECK(expire(table, 3600000 * ms).empty());
+    table.setExpiry(1000 * ms, 0, 3600000 * ms);
+    // last seen an hour ago: due at once
+    CHECK(expire(table, 3600100 * ms) == std::vector<uint64_t>{base | 1});
+}
+
+TEST(cap_evicts_least_recently_seen_first) {
+    DeviceTable table(0);
+    table.setExpiry(0, 3, 0);
+    table.upsert(base | 1, -60, 1);
+    table.upsert(base | 2, -60, 2);
+    table.upsert(base | 3, -60, 3);
+    table.upsert(base | 1, -60, 4);
+    table.upsert(base | 4, -60, 5);
+    table.upsert(base | 5, -60, 6);
+    CHECK_EQ(table.size(), 3u);
+    CHECK(sorted(table.keys()) == (std::vector<uint64_t>{base | 1, base | 4, base | 5}));
+    CHECK(expire(table, 7) == (std::vector<uint64_t>{base | 2, base | 3}));
+    CHECK(expire(table, 8).empty());
+}
+
+// evicted, then seen again before the sweep: still in the table, not lost
+TEST(evicted_then_seen_again_is_not_lost) {
+    DeviceTable table(0);
+    table.setExpiry(0, 2, 0);
+    table.upsert(base | 1, -60, 1);
+    table.upsert(base | 2, -60, 2);
+    table.upsert(base | 3, -60, 3);
+    table.upsert(base | 1, -60, 4);
+    CHECK(table.contains(base | 1));
+    CHECK(expire(table, 5) == std::vector<uint64_t>{base | 2});
+}
+
+TEST(evicted_twice_is_lost_once) {
+    DeviceTable table(0);
+    table.setExpiry(0, 1, 0);
+    table.upsert(base | 1, -60, 1);
+    table.upsert(base | 2, -60, 2);
+    table.upsert(base | 1, -60, 3);
+    table.upsert(base | 2, -60, 4);
+    CHECK(expire(table, 5) == std::vector<uint64_t>{base | 1});
+}
+
+TEST(batch_evicts_past_cap) {
+    DeviceTable table(0);
+    table.setExpiry(0, 2, 0);
+    const uint64_t addresses[] = {base | 1, base | 2, base | 3, base | 4};
+    const int16_t rssis[] = {-60, -60, -60, -60};
+    table.upsertBatch(addresses, rssis, 4, 1);
+    CHECK_EQ(table.size(), 2u);
+    CHECK(expire(table, 2) == (std::vector<uint64_t>{base | 1, base | 2}));
+}
+
+// rows are stored in insertion order, the cap must still go by last seen
+TEST(reconfigured_cap_keeps_lru_order) {
+    DeviceTable table(0);
+    table.upsert(base | 1, -60, 1);
+    table.upsert(base | 2, -60, 2);
+    table.upsert(base | 3, -60, 3);
+    table.upsert(base | 1, -60, 4);
+    table.setExpiry(0, 2, 5);
+    CHECK(expire(table, 6) == std::vector<uint64_t>{base | 2});
+    table.upsert(base | 4, -60, 7);
+    CHECK(expire(table, 8) == std::vector<uint64_t>{base | 3});
+}
+
+CHECK_MAIN()
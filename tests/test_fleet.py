@@ -0,0 +1,49 @@
+"""pywinble.bench.Fleet teardown: close() and shutdown() keep to their
+timeout and say whether delivery finished.  Run by ctest with the built
+module on PYTHONPATH."""
+
+import threading
+import time
+import unittest
+
+import pywinble
+from pywinble import bench
+
+
+class FleetTest(unittest.TestCase):
+    def test_backlog_is_dropped_not_delivered(self):
+        def slow(event, id, props):
+            time.sleep(0.001)
+
+        fleet = bench.fleet(advertisers=2000, advertise_hz=10, queue=4096, on_advertisement=slow)
+        fleet.start()
+        time.sleep(0.5)
+        start = time.monotonic()
+        self.assertTrue(fleet.close(5.0))
+        self.assertLess(time.monotonic() - start, 0.5)
+        adv = fleet.report()["advertisement"]
+        self.assertGreater(adv["dropped"], 0)
+        self.assertEqual(adv["delivered"] + adv["dropped"], adv["produced"])
+
+    def test_shutdown_gives_up_on_a_stuck_callback(self):
+        entered, release = threading.Event(), threading.Event()
+
+        def stuck(event, id, props):
+            entered.set()
+            release.wait(10)
+
+        fleet = bench.fleet(advertisers=10, advertise_hz=50, on_advertisement=stuck)
+        fleet.start()
+        self.assertTrue(entered.wait(5))
+        start = time.monotonic()
+        self.assertFalse(pywinble.shutdown(timeout=0.1))
+        self.assertLess(time.monotonic() - start, 1.0)
+
+        # once the callback returns a later close gets through
+        release.set()
+        self.assertTrue(fleet.close(5.0))
+        self.assertFalse(fleet.running)
+
+
+if __name__ == "__main__":
+    unittest.main()
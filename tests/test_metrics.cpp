@@ -0,0 +1,151 @@
+// Metrics: histogram bucket bounds and quantiles, per-thread shards folding
+// into snapshots, and the Prometheus text export.
+
+#include "metrics.h"
+
+#include <stdio.h>
+
+#include <thread>
+
+#include "check.h"
+
+using namespace metrics;
+
+TEST(small_values_are_exact) {
+    for (uint64_t v = 0; v < (1u << subBits); ++v) {
+        CHECK_EQ(bucket_of(v), (int) v);
+        CHECK_EQ(bucket_limit((int) v), v);
+    }
+}
+
+// each bucket's limit lands in it and the next value in the next bucket,
+// so the buckets tile the range with no gaps or overlaps
+TEST(buckets_are_contiguous) {
+    bool ok = true;
+    for (int b = 0; b + 1 < bucketCount; ++b) {
+        uint64_t limit = bucket_limit(b);
+        ok &= bucket_of(limit) == b && bucket_of(limit + 1) == b + 1;
+    }
+    CHECK(ok);
+}
+
+TEST(buckets_are_within_a_sixteenth) {
+    bool ok = true;
+    for (int b = 1 << subBits; b < bucketCount; ++b) {
+        uint64_t low = bucket_limit(b - 1) + 1, high = bucket_limit(b);
+        ok &= (high - low + 1) * 16 <= low;
+    }
+    CHECK(ok);
+}
+
+TEST(top_bucket_reaches_2_4_hours) {
+    CHECK_EQ(bucket_limit(bucketCount - 1), (1ull << 43) - 1);
+    CHECK_NEAR(bucket_limit(bucketCount - 1) / 3600e9, 2.44, 0.01);
+    // anything longer is clamped into it
+    CHECK_EQ(bucket_of(1ull << 43), bucketCount - 1);
+    CHECK_EQ(bucket_of(~(uint64_t) 0), bucketCount - 1);
+}
+
+TEST(quantiles) {
+    AtomicHistogram hist;
+    for (uint64_t v = 1; v <= 1000; ++v)
+        hist.record(v * 1000);
+    HistogramData data;
+    hist.addTo(data);
+    CHECK_EQ(data.count, 1000u);
+    CHECK_EQ(data.sum, 500500000u);
+    CHECK_EQ(data.min, 1000u);
+    CHECK_EQ(data.max, 1000000u);
+    // upper bounds of buckets, so at most a sixteenth over
+    CHECK(data.quantile(0.5) >= 500000 && data.quantile(0.5) <= 500000 * 17 / 16);
+    CHECK(data.quantile(0.99) >= 990000 && data.quantile(0.99) <= 1000000);
+    CHECK_EQ(data.quantile(1), 1000000u);
+    CHECK_EQ(data.quantile(0), bucket_limit(bucket_of(1000)));
+    CHECK_EQ(HistogramData().quantile(0.5), 0u);
+}
+
+// threads record into their own shards and exit; their totals must survive
+TEST(exited_threads_fold_into_snapshots) {
+    Snapshot before = snapshot();
+    const int threads = 8, each = 10000;
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; ++t) {
+        workers.emplace_back([] {
+            for (int i = 0; i < each; ++i) {
+                count(CallbackErrors);
+                record(CallbackTime, 100 + i);
+            }
+        });
+    }
+    for (auto &w : workers)
+        w.join();
+    count(CallbackErrors, 5);
+
+    Snapshot after = snapshot();
+    CHECK_EQ(after.counters[CallbackErrors] - before.counters[CallbackErrors], (uint64_t) threads * each + 5);
+    const HistogramData &hist = after.histograms[CallbackTime];
+    CHECK_EQ(hist.count - before.histograms[CallbackTime].count, (uint64_t) threads * each);
+    CHECK_EQ(hist.max, 100u + each - 1);
+}
+
+TEST(gauges_hold_levels) {
+    gauge_add(ActiveWatchers, 3);
+    gauge_add(ActiveWatchers, -2);
+    CHECK_EQ(snapshot().gauges[ActiveWatchers], 1);
+    gauge_add(ActiveWatchers, -1);
+    CHECK_EQ(snapshot().gauges[ActiveWatchers], 0);
+}
+
+static bool contains(const std::string &text, const std::string &line) {
+    return text.find(line) != std::string::npos;
+}
+
+TEST(prometheus_text) {
+    Snapshot snap;
+    snap.counters[AdapterLookups] = 3;
+    snap.gauges[TrackedDevices] = -2;
+    AtomicHistogram hist;
+    hist.record(1000);
+    hist.record(1000);
+    hist.record(2000000);
+    hist.addTo(snap.histograms[CallbackTime]);
+
+    std::string text = prometheus(snap, "t_");
+    CHECK(contains(text, "# TYPE t_adapter_lookups_total counter\nt_adapter_lookups_total 3\n"));
+    CHECK(contains(text, "# TYPE t_tracked_devices gauge\nt_tracked_devices -2\n"));
+    CHECK(contains(text, "# TYPE t_callback_seconds histogram\n"));
+    // only occupied buckets, cumulative, bounds in seconds
+    char line[128];
+    snprintf(line, sizeof(line), "t_callback_seconds_bucket{le=\"%.9g\"} 2\n", bucket_limit(bucket_of(1000)) / 1e9);
+    CHECK(contains(text, line));
+    snprintf(line, sizeof(line), "t_callback_seconds_bucket{le=\"%.9g\"} 3\n", bucket_limit(bucket_of(2000000)) / 1e9);
+    CHECK(contains(text, line));
+    CHECK(contains(text, "t_callback_seconds_bucket{le=\"+Inf\"} 3\nt_callback_seconds_sum 0.002002\n"
+            "t_callback_seconds_count 3\n"));
+    CHECK(contains(text, "t_gil_wait_seconds_bucket{le=\"+Inf\"} 0\n"));
+}
+
+TEST(prometheus_export_replaces_the_file) {
+    std::string path = "test_metrics.prom";
+    Snapshot snap;
+    snap.counters[ProvidersCreated] = 7;
+    CHECK(export_prometheus(path, snap));
+    snap.counters[ProvidersCreated] = 8;
+    CHECK(export_prometheus(path, snap));
+
+    std::string text;
+    if (FILE *f = fopen(path.c_str(), "rb")) {
+        char buf[4096];
+        size_t n;
+        while ((n = fread(buf, 1, sizeof(buf), f)))
+            text.append(buf, n);
+        fclose(f);
+    }
+    CHECK_EQ(text, prometheus(snap));
+    CHECK(!fopen((path + ".tmp").c_str(), "rb"));
+    remove(path.c_str());
+
+    CHECK(!export_prometheus("no/such/dir/metrics.prom", snap));
+}
+
+CHECK_MAIN()
@@ -0,0 +1,38 @@
+"""Overload resolution in the vendored pybind11: a call goes to the same
+overload whatever was called before it.  Run by ctest with the overloads
+test module on PYTHONPATH."""
+
+import unittest
+
+import overloads
+
+BIG = 2 ** 40
+
+
+class OverloadTest(unittest.TestCase):
+    def check(self, fn, calls):
+        # each call in order, then again in reverse, then interleaved
+        for sequence in (calls, calls[::-1], calls + calls[::-1] + calls):
+            for value, expected in sequence:
+                self.assertEqual(fn(value), expected, "%s(%r)" % (fn.__name__, value))
+
+    def test_value_picks_the_conversion_pass(self):
+        self.check(overloads.f, [(5, "int32"), (BIG, "double"), (2.5, "double")])
+
+    def test_value_picks_a_later_overload(self):
+        self.check(overloads.g, [(5, "int32"), (BIG, "int64")])
+
+    def test_classes_and_values(self):
+        widget, gadget = overloads.Widget(), overloads.Gadget()
+        self.check(overloads.k, [(widget, "widget"), (gadget, "gadget"), (5, "int32"),
+                                 (BIG, "double"), (2.5, "double")])
+
+    def test_bad_arguments_still_raise(self):
+        for _ in range(3):
+            self.assertEqual(overloads.f(5), "int32")
+            with self.assertRaises(TypeError):
+                overloads.f("5")
+
+
+if __name__ == "__main__":
+    unittest.main()
@@ -0,0 +1,53 @@
+"""py::instance_pool in the vendored pybind11: freed instances are reused,
+at most max_free of them are kept, and none are held past interpreter
+exit.  Run by ctest with the pools test module on PYTHONPATH."""
+
+import subprocess
+import sys
+import types
+import unittest
+
+import pools
+
+
+class PoolTest(unittest.TestCase):
+    def setUp(self):
+        # empty the free list whatever earlier tests left on it
+        self.held = [pools.Pooled() for _ in range(4)]
+
+    def test_freed_instance_is_reused_fresh(self):
+        a = pools.Pooled()
+        a.value = 7
+        address = id(a)
+        del a
+        b = pools.Pooled()
+        self.assertEqual(id(b), address)
+        self.assertEqual(b.value, 0)
+
+    def test_keeps_at_most_max_free(self):
+        live = [pools.Pooled() for _ in range(16)]
+        addresses = [id(p) for p in live]
+        # freed from the end, the first four freed are the ones kept
+        while live:
+            live.pop()
+        again = [pools.Pooled() for _ in range(4)]
+        self.assertEqual(sorted(id(p) for p in again), sorted(addresses[-4:]))
+
+    def test_unpooled_classes_are_unaffected(self):
+        plain = [pools.Plain() for _ in range(8)]
+        del plain
+        self.assertEqual(pools.Plain().value, 0)
+
+    def test_dynamic_attr_is_refused(self):
+        with self.assertRaises(RuntimeError):
+            pools.pooled_with_dynamic_attr(types.ModuleType("scratch"))
+
+    def test_exit_with_instances_kept(self):
+        code = "import pools\nkept = [pools.Pooled() for _ in range(8)]\ndel kept\nprint('ok')\n"
+        out = subprocess.run([sys.executable, "-c", code], capture_output=True, text=True, timeout=60)
+        self.assertEqual(out.returncode, 0, out.stderr)
+        self.assertEqual(out.stdout.strip(), "ok")
+
+
+if __name__ == "__main__":
+    unittest.main()
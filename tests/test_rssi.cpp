@@ -0,0 +1,132 @@
+// RSSI filters and the path-loss distance estimate, on their own and as the
+// device table runs them.
+
+#include "rssi.h"
+
+#include "devtable.h"
+
+#include "check.h"
+
+TEST(parse_filter) {
+    RssiFilter filter;
+    CHECK(parse_rssi_filter("", 0, filter));
+    CHECK(filter.kind == RssiFilterKind::None);
+    CHECK(parse_rssi_filter("ema", 0.5, filter));
+    CHECK(filter.kind == RssiFilterKind::Ema);
+    CHECK_NEAR(filter.alpha, 0.5, 1e-6);
+    CHECK(parse_rssi_filter("median", 7, filter));
+    CHECK_EQ(filter.window, 7);
+    CHECK(parse_rssi_filter("kalman", 0, filter));
+    CHECK(filter.kind == RssiFilterKind::Kalman);
+
+    CHECK(!parse_rssi_filter("ema", 1.5, filter));
+    CHECK(!parse_rssi_filter("median", RssiFilter::maxWindow + 1, filter));
+    CHECK(!parse_rssi_filter("kalman", -1, filter));
+    CHECK(!parse_rssi_filter("boxcar", 0, filter));
+}
+
+TEST(ema_converges_geometrically) {
+    float state = -90, sample = -60;
+    for (int i = 0; i < 10; ++i)
+        ema_batch(&state, &sample, 1, 0.25f);
+    // the gap shrinks by 1 - alpha per sample
+    CHECK_NEAR(state, -60 - 30 * pow(0.75, 10), 1e-3);
+    for (int i = 0; i < 100; ++i)
+        ema_batch(&state, &sample, 1, 0.25f);
+    CHECK_NEAR(state, -60, 1e-3);
+}
+
+TEST(kalman_converges_and_settles) {
+    float x = -90, p = 9, sample = -60;
+    float gap = 30;
+    bool shrinking = true;
+    for (int i = 0; i < 200; ++i) {
+        kalman_batch(&x, &p, &sample, 1, 0.05f, 9.0f);
+        shrinking &= fabsf(x - sample) <= gap;
+        gap = fabsf(x - sample);
+    }
+    CHECK(shrinking);
+    CHECK_NEAR(x, -60, 0.05);
+    // steady state of p = (1 - k)(p + q): p^2 + qp - qr = 0
+    double q = 0.05, r = 9;
+    CHECK_NEAR(p, (-q + sqrt(q * q + 4 * q * r)) / 2, 1e-3);
+}
+
+TEST(median_rejects_a_spike) {
+    int16_t ring[RssiFilter::maxWindow];
+    uint8_t count = 0;
+    CHECK_EQ(median_push(ring, count, 5, -60), -60);
+    // an even count averages the middle two
+    CHECK_EQ(median_push(ring, count, 5, -64), -62);
+    median_push(ring, count, 5, -62);
+    median_push(ring, count, 5, -61);
+    CHECK_EQ(median_push(ring, count, 5, -20), -61);
+    CHECK_EQ(count, 5);
+    // the window slides: the oldest readings drop out
+    median_push(ring, count, 5, -70);
+    median_push(ring, count, 5, -70);
+    CHECK_EQ(median_push(ring, count, 5, -70), -70);
+}
+
+TEST(distance_follows_path_loss) {
+    CHECK_NEAR(path_loss_distance(-59, -59, 2), 1, 1e-4);
+    CHECK_NEAR(path_loss_distance(-79, -59, 2), 10, 1e-3);
+    CHECK_NEAR(path_loss_distance(-99, -59, 2), 100, 1e-2);
+    CHECK_NEAR(path_loss_distance(-89, -59, 3), 10, 1e-3);
+    CHECK_NEAR(path_loss_distance(-49, -59, 2), pow(10, -0.5), 1e-4);
+
+    float rssi[] = {-59, -69, -79, -89, -99, -109, -119, -129, -139};
+    float meters[9];
+    distance_batch(rssi, meters, 9, -59, 2);
+    for (int i = 0; i < 9; ++i)
+        CHECK_NEAR(meters[i], pow(10, i / 2.0), pow(10, i / 2.0) * 1e-4);
+}
+
+// a device at a fixed distance whose readings scatter around its true rssi
+TEST(table_filters_converge_on_noisy_readings) {
+    const uint64_t address = 0xd1ce00000001ull;
+    const int16_t noise[] = {4, -3, 1, -4, 2, 0, -2, 3, -1, 0};
+    const char *kinds[] = {"ema", "median", "kalman"};
+    for (auto kind : kinds) {
+        RssiFilter filter;
+        CHECK(parse_rssi_filter(kind, 0, filter));
+        DeviceTable table(0);
+        table.setFilter(filter);
+        for (int i = 0; i < 200; ++i)
+            table.upsert(address, (int16_t) (-70 + noise[i % 10]), i);
+        DeviceTable::Row row;
+        CHECK(table.get(address, row));
+        CHECK_NEAR(row.smoothed, -70, 2.5);
+        CHECK_NEAR(row.distance, path_loss_distance(row.smoothed, filter.txPower, filter.pathLossExponent), 1e-4);
+        // 2.5dBm either side of -70 is a third of the distance either way
+        CHECK_NEAR(row.distance, path_loss_distance(-70, filter.txPower, filter.pathLossExponent), 1.2);
+    }
+}
+
+TEST(unfiltered_rows_track_the_last_reading) {
+    DeviceTable table(0);
+    table.upsert(1, -60, 0);
+    table.upsert(1, -79, 1);
+    DeviceTable::Row row;
+    CHECK(table.get(1, row));
+    CHECK_NEAR(row.smoothed, -79, 1e-6);
+    CHECK_NEAR(row.distance, 10, 1e-3);
+}
+
+// a new filter restarts every row from its last raw reading
+TEST(set_filter_restarts_rows) {
+    DeviceTable table(0);
+    table.upsert(1, -60, 0);
+    table.upsert(1, -80, 1);
+    RssiFilter filter;
+    CHECK(parse_rssi_filter("ema", 0.5, filter));
+    table.setFilter(filter);
+    DeviceTable::Row row;
+    CHECK(table.get(1, row));
+    CHECK_NEAR(row.smoothed, -80, 1e-6);
+    table.upsert(1, -60, 2);
+    CHECK(table.get(1, row));
+    CHECK_NEAR(row.smoothed, -70, 1e-6);
+}
+
+CHECK_MAIN()
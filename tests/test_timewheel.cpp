@@ -0,0 +1,102 @@
+// TimingWheel: expiry order and timing across the levels, rescheduling and
+// the recency list behind the device table's size cap.
+
+#include "timewheel.h"
+
+#include "check.h"
+
+typedef std::vector<uint64_t> Keys;
+
+static Keys advance(TimingWheel &wheel, uint64_t now) {
+    Keys expired;
+    wheel.advance(now, expired);
+    return expired;
+}
+
+TEST(expires_in_deadline_order_never_early) {
+    TimingWheel wheel(10, 0);
+    wheel.add(3, 35);
+    wheel.add(1, 15);
+    wheel.add(2, 25);
+    CHECK_EQ(wheel.size(), 3u);
+
+    // deadlines round up to the next tick, so expiry is up to a tick late
+    CHECK(advance(wheel, 19).empty());
+    CHECK(advance(wheel, 20) == Keys{1});
+    CHECK(advance(wheel, 29).empty());
+    CHECK(advance(wheel, 100) == (Keys{2, 3}));
+    CHECK_EQ(wheel.size(), 0u);
+}
+
+TEST(deadline_in_the_past_expires_next_tick) {
+    TimingWheel wheel(10, 1000);
+    wheel.add(1, 5);
+    CHECK(advance(wheel, 1009).empty());
+    CHECK(advance(wheel, 1010) == Keys{1});
+}
+
+// one deadline per level, and one past the top level's horizon
+TEST(cascades_through_every_level) {
+    TimingWheel wheel(1, 0);
+    const uint64_t deadlines[] = {50, 100, 5000, 300000, 20000000};
+    for (uint64_t key = 0; key < 5; ++key)
+        wheel.add(key, deadlines[key]);
+    for (uint64_t key = 0; key < 5; ++key) {
+        CHECK(advance(wheel, deadlines[key] - 1).empty());
+        CHECK(advance(wheel, deadlines[key]) == Keys{key});
+    }
+    CHECK_EQ(wheel.size(), 0u);
+}
+
+TEST(touch_reschedules) {
+    TimingWheel wheel(10, 0);
+    uint32_t a = wheel.add(1, 50);
+    wheel.add(2, 60);
+    wheel.touch(a, 150);
+    CHECK(advance(wheel, 100) == Keys{2});
+    CHECK(advance(wheel, 149).empty());
+    CHECK(advance(wheel, 150) == Keys{1});
+}
+
+TEST(never_only_tracks_recency) {
+    TimingWheel wheel(10, 0);
+    uint32_t a = wheel.add(1, TimingWheel::never);
+    CHECK(advance(wheel, 1000000000).empty());
+    CHECK_EQ(wheel.size(), 1u);
+    CHECK_EQ(wheel.oldest(), a);
+    // time jumped ahead with nothing scheduled: a new deadline counts from now
+    wheel.add(2, 1000000010);
+    CHECK(advance(wheel, 1000000009).empty());
+    CHECK(advance(wheel, 1000000010) == Keys{2});
+}
+
+TEST(oldest_follows_touches_and_removals) {
+    TimingWheel wheel(10, 0);
+    uint32_t a = wheel.add(1, TimingWheel::never);
+    uint32_t b = wheel.add(2, TimingWheel::never);
+    uint32_t c = wheel.add(3, TimingWheel::never);
+    CHECK_EQ(wheel.key(wheel.oldest()), 1u);
+    wheel.touch(a, TimingWheel::never);
+    CHECK_EQ(wheel.key(wheel.oldest()), 2u);
+    wheel.remove(b);
+    CHECK_EQ(wheel.key(wheel.oldest()), 3u);
+    wheel.remove(c);
+    CHECK_EQ(wheel.key(wheel.oldest()), 1u);
+    wheel.remove(a);
+    CHECK(wheel.oldest() == TimingWheel::nil);
+
+    // freed nodes are reused
+    uint32_t d = wheel.add(4, TimingWheel::never);
+    CHECK(d == a || d == b || d == c);
+    CHECK_EQ(wheel.size(), 1u);
+}
+
+TEST(expired_entries_leave_the_recency_list) {
+    TimingWheel wheel(10, 0);
+    wheel.add(1, 10);
+    wheel.add(2, TimingWheel::never);
+    CHECK(advance(wheel, 10) == Keys{1});
+    CHECK_EQ(wheel.key(wheel.oldest()), 2u);
+}
+
+CHECK_MAIN()
@@ -0,0 +1,79 @@
+"""Trace ring round trip: records the module writes, decoded by
+tools/trace_to_chrome.py.  Run by ctest with the built module on PYTHONPATH."""
+
+import json
+import os
+import subprocess
+import sys
+import tempfile
+import unittest
+
+TOOLS = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "tools")
+sys.path.insert(0, TOOLS)
+
+import pywinble
+import trace_to_chrome
+
+SERVICE = "eab08fe8-e7bd-4982-836e-8ec0839320ed"
+CHARACTERISTIC = "ec563d40-6a7c-4cd9-a1b9-c37882d66fa4"
+
+
+class TraceTest(unittest.TestCase):
+    def setUp(self):
+        self.tmp = tempfile.TemporaryDirectory()
+        self.path = os.path.join(self.tmp.name, "pywinble.trace")
+
+    def tearDown(self):
+        pywinble.trace_stop()
+        self.tmp.cleanup()
+
+    def record(self):
+        pywinble.trace_start(self.path, records=64)
+        pywinble.advertise("vida:trace", lambda error, status: None)
+        with pywinble.provide(SERVICE, {CHARACTERISTIC: {"flags": 4, "description": "trace"}}):
+            pass
+        pywinble.trace_stop()
+
+    def test_round_trip(self):
+        self.record()
+        trace = trace_to_chrome.decode(self.path)
+        self.assertEqual(trace["otherData"]["capacity"], 64)
+        self.assertEqual(trace["otherData"]["torn"], 0)
+        events = [e for e in trace["traceEvents"] if e["ph"] != "M"]
+        self.assertEqual(len(events), trace["otherData"]["records"])
+        by_name = {}
+        for event in events:
+            by_name.setdefault(event["name"], []).append(event)
+
+        self.assertIn("advertise", by_name)
+        # the gil_wait id is the call site, named from the file's own header
+        sites = [e["args"].get("site") for e in by_name["gil_wait"]]
+        self.assertIn("adstatus_callback", sites)
+        self.assertEqual(by_name["provider_create"][0]["args"]["id"], "eab08fe8-e7bd-4982")
+        self.assertEqual(by_name["characteristic_create"][0]["args"]["id"], "ec563d40-6a7c-4cd9")
+        self.assertEqual(by_name["provider_create"][0]["ph"], "X")
+        self.assertEqual(by_name["advertise"][0]["ph"], "i")
+        # in order, on the wall clock
+        stamps = [e["ts"] for e in events if e["ph"] == "i"]
+        self.assertEqual(stamps, sorted(stamps))
+
+    def test_command_line(self):
+        self.record()
+        out = os.path.join(self.tmp.name, "trace.json")
+        subprocess.check_call([sys.executable, os.path.join(TOOLS, "trace_to_chrome.py"), self.path, out],
+                              stderr=subprocess.DEVNULL)
+        with open(out) as f:
+            trace = json.load(f)
+        self.assertTrue(any(e["name"] == "advertise" for e in trace["traceEvents"]))
+
+    @unittest.skipUnless(os.path.exists("/proc/self/maps"), "needs /proc")
+    def test_restarts_unmap_old_rings(self):
+        for _ in range(50):
+            pywinble.trace_start(self.path, records=1 << 16)
+            pywinble.trace_stop()
+        with open("/proc/self/maps") as f:
+            self.assertNotIn(self.path, f.read())
+
+
+if __name__ == "__main__":
+    unittest.main()
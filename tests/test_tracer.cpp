@@ -0,0 +1,169 @@
+// Tracer: the ring file's layout as the decoder reads it, wrap-around, and
+// retiring rings on restart while other threads are tracing.
+
+#include "tracer.h"
+
+#include <stdio.h>
+
+#include <fstream>
+#include <thread>
+#include <vector>
+
+#include "check.h"
+
+static const std::string path = "test_tracer.trace";
+
+static std::vector<char> read_file(const std::string &name) {
+    std::vector<char> data;
+    if (FILE *f = fopen(name.c_str(), "rb")) {
+        char buf[65536];
+        size_t n;
+        while ((n = fread(buf, 1, sizeof(buf), f)))
+            data.insert(data.end(), buf, buf + n);
+        fclose(f);
+    }
+    return data;
+}
+
+static const tracer::Header &header_of(const std::vector<char> &data) {
+    return *reinterpret_cast<const tracer::Header *>(data.data());
+}
+
+static const tracer::Record &record_at(const std::vector<char> &data, uint64_t slot) {
+    const tracer::Header &header = header_of(data);
+    return reinterpret_cast<const tracer::Record *>(data.data() + tracer::headerSize)[slot & (header.capacity - 1)];
+}
+
+// mappings of the trace file in this process, where /proc says
+static int mappings_of(const std::string &name) {
+    int count = 0;
+    std::ifstream maps("/proc/self/maps");
+    std::string line;
+    while (std::getline(maps, line)) {
+        if (line.size() >= name.size() && line.compare(line.size() - name.size(), name.size(), name) == 0)
+            ++count;
+    }
+    return count;
+}
+
+TEST(header_and_records) {
+    std::string error;
+    CHECK(tracer::Tracer::get().start(path, 1000, error));
+    CHECK(tracer::enabled());
+    tracer::emit(tracer::GilWait, gilprof::WatcherExpiry, 123, 45, 0);
+    tracer::emit(tracer::WatcherAdded, 0xd1ce00000001ull, 200, 0, 7);
+    tracer::Tracer::get().stop();
+    CHECK(!tracer::enabled());
+    // nothing to write to once stopped
+    tracer::emit(tracer::WatcherAdded, 1, 300, 0, 0);
+
+    std::vector<char> data = read_file(path);
+    CHECK(data.size() == tracer::headerSize + 1024 * sizeof(tracer::Record));
+    if (data.size() < tracer::headerSize)
+        return;
+    const tracer::Header &header = header_of(data);
+    CHECK(!memcmp(header.magic, "PWBTRACE", 8));
+    CHECK_EQ(header.version, 2u);
+    CHECK_EQ(header.recordSize, 32u);
+    CHECK_EQ(header.capacity, 1024u);
+    CHECK_EQ(header.position.load(), 2u);
+    CHECK_EQ(header.kindCount, (uint32_t) tracer::KindCount);
+    CHECK_EQ(std::string(header.kinds[tracer::GilWait].name), "gil_wait");
+    CHECK_EQ(header.kinds[tracer::WatcherAdded].idType, 'a');
+    CHECK_EQ(header.siteCount, (uint32_t) gilprof::SiteCount);
+    CHECK_EQ(std::string(header.sites[gilprof::WatcherExpiry].name), "watcher_expiry");
+
+    const tracer::Record &gil = record_at(data, 0);
+    CHECK_EQ(gil.seq.load(), 1u);
+    CHECK_EQ(gil.kind, tracer::GilWait);
+    CHECK_EQ(gil.id, (uint64_t) gilprof::WatcherExpiry);
+    CHECK_EQ(gil.ts, 123u);
+    CHECK_EQ(gil.dur, 45u);
+    const tracer::Record &added = record_at(data, 1);
+    CHECK_EQ(added.seq.load(), 2u);
+    CHECK_EQ(added.id, 0xd1ce00000001ull);
+    CHECK_EQ(added.arg, 7);
+    CHECK_EQ(added.tid, tracer::thread_id());
+}
+
+TEST(ring_keeps_the_latest_records) {
+    std::string error;
+    CHECK(tracer::Tracer::get().start(path, 3, error));
+    for (uint64_t i = 0; i < 10; ++i)
+        tracer::emit(tracer::FleetWrite, i, i, 0, 0);
+    tracer::Tracer::get().stop();
+
+    std::vector<char> data = read_file(path);
+    if (data.size() < tracer::headerSize)
+        return;
+    CHECK_EQ(header_of(data).capacity, 4u);
+    CHECK_EQ(header_of(data).position.load(), 10u);
+    for (uint64_t slot = 6; slot < 10; ++slot) {
+        CHECK_EQ(record_at(data, slot).seq.load(), slot + 1);
+        CHECK_EQ(record_at(data, slot).id, slot);
+    }
+}
+
+TEST(start_reports_bad_paths) {
+    std::string error;
+    CHECK(!tracer::Tracer::get().start("no/such/dir/x.trace", 16, error));
+    CHECK_EQ(error, "Could not create trace file");
+    CHECK(!tracer::enabled());
+}
+
+#ifdef __linux__
+TEST(restarts_unmap_old_rings) {
+    std::string error;
+    for (int i = 0; i < 50; ++i) {
+        CHECK(tracer::Tracer::get().start(path, 1 << 16, error));
+        tracer::instant(tracer::Advertise);
+    }
+    CHECK_EQ(mappings_of(path), 1);
+    tracer::Tracer::get().stop();
+    CHECK_EQ(mappings_of(path), 0);
+}
+#endif
+
+// rings are swapped and unmapped underneath threads tracing flat out; a
+// writer left holding a freed ring would fault
+TEST(restarts_while_tracing) {
+    std::atomic<bool> done{false};
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t) {
+        threads.emplace_back([&done, t] {
+            while (!done.load(std::memory_order_relaxed)) {
+                tracer::Span span(tracer::FleetAdvertisement, t);
+                tracer::instant(tracer::FleetWrite, t);
+            }
+        });
+    }
+    std::string error;
+    for (int i = 0; i < 200; ++i) {
+        CHECK(tracer::Tracer::get().start(path, 256, error));
+        std::this_thread::yield();
+        if (i % 3 == 0)
+            tracer::Tracer::get().stop();
+    }
+    done = true;
+    for (auto &thread : threads)
+        thread.join();
+    tracer::Tracer::get().stop();
+
+    std::vector<char> data = read_file(path);
+    if (data.size() < tracer::headerSize)
+        return;
+    // every published record is whole
+    const tracer::Header &header = header_of(data);
+    uint64_t position = header.position.load();
+    uint64_t first = position > header.capacity ? position - header.capacity : 0;
+    bool ok = true;
+    for (uint64_t slot = first; slot < position; ++slot) {
+        const tracer::Record &r = record_at(data, slot);
+        if (r.seq.load() == (uint32_t) (slot + 1))
+            ok &= (r.kind == tracer::FleetAdvertisement || r.kind == tracer::FleetWrite) && r.id < 4;
+    }
+    CHECK(ok);
+    remove(path.c_str());
+}
+
+CHECK_MAIN()
@@ -0,0 +1,100 @@
+"""Watcher lifecycle against the sim backend.  Run by ctest with the built
+module on PYTHONPATH."""
+
+import os
+import threading
+import time
+import unittest
+
+os.environ.setdefault("PYWINBLE_SIM_DEVICES", "8")
+os.environ.setdefault("PYWINBLE_SIM_HZ", "50")
+
+import pywinble
+
+
+def gauge(name):
+    return pywinble.metrics()["gauges"][name]
+
+
+class WatcherTest(unittest.TestCase):
+    def test_failed_watch_leaves_no_gauge(self):
+        before = gauge("active_watchers")
+        hz = os.environ["PYWINBLE_SIM_HZ"]
+        os.environ["PYWINBLE_SIM_HZ"] = "-1"
+        try:
+            for _ in range(3):
+                with self.assertRaises(ValueError):
+                    pywinble.watch([], None)
+        finally:
+            os.environ["PYWINBLE_SIM_HZ"] = hz
+        self.assertEqual(gauge("active_watchers"), before)
+
+        watcher = pywinble.watch([], None)
+        self.assertEqual(gauge("active_watchers"), before + 1)
+        watcher.close()
+        del watcher
+        self.assertEqual(gauge("active_watchers"), before)
+
+    # close() from one of the watcher's own callbacks mustn't wait for itself;
+    # "lost" events come from the expiry sweep, a callback inside a callback
+    def close_from(self, event, **kwargs):
+        done = threading.Event()
+        result = []
+
+        def callback(name, id, props):
+            if name == event and not result:
+                start = time.monotonic()
+                result.append(watcher.close(1.0))
+                result.append(time.monotonic() - start)
+                done.set()
+
+        watcher = pywinble.watch([], callback, **kwargs)
+        watcher.start()
+        self.assertTrue(done.wait(10))
+        closed, elapsed = result
+        self.assertTrue(closed)
+        self.assertLess(elapsed, 0.5)
+        self.assertTrue(watcher.close())
+
+    def test_close_from_added(self):
+        self.close_from("added")
+
+    def test_close_from_lost(self):
+        self.close_from("lost", max_devices=2)
+
+    # the scan can't stop inside its own callback, so resume() lands while it
+    # is still stopping and has to restart it once the stop completes
+    def test_pause_and_resume_from_a_callback(self):
+        events = []
+        ids = set()
+
+        def callback(name, id, props):
+            events.append(name)
+            if name == "added":
+                ids.add(id)
+            if len(events) == 1:
+                watcher.pause()
+                watcher.resume()
+
+        watcher = pywinble.watch([], callback)
+        watcher.start()
+        deadline = time.monotonic() + 10
+        while len(ids) < 8 and time.monotonic() < deadline:
+            time.sleep(0.01)
+        self.assertEqual(len(ids), 8)
+        self.assertFalse(watcher.paused)
+        self.assertIn(watcher.state, ("started", "enumerated"))
+        self.assertNotIn("stopped", events)
+        self.assertTrue(watcher.close())
+
+    def test_close_without_a_limit(self):
+        watcher = pywinble.watch([], None)
+        watcher.start()
+        self.assertTrue(watcher.close(float("inf")))
+        self.assertTrue(watcher.close(1e300))
+        with self.assertRaises(ValueError):
+            watcher.close(float("nan"))
+
+
+if __name__ == "__main__":
+    unittest.main()
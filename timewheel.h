@@ -0,0 +1,222 @@
+#pragma once
+
+// Hierarchical timing wheel used to age devices out of a DeviceTable.
+//
+// Four levels of 64 slots; level 0 slots are one tick wide, each level above
+// is 64 times coarser.  Entries are re-bucketed into finer levels as time
+// reaches them, so scheduling, rescheduling and expiry are all O(1) apart
+// from the cascade.  Every entry is also on a recency list, which gives the
+// owner least-recently-touched eviction for a size cap.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+class TimingWheel {
+    public:
+        static const uint32_t nil = 0xffffffff;
+        static const uint64_t never = ~(uint64_t) 0;
+
+        static const uint64_t defaultTickNs = 100000000ull;
+
+        TimingWheel(uint64_t tickNs = defaultTickNs, uint64_t nowNs = 0) : tickNs(tickNs ? tickNs : 1), current(nowNs / this->tickNs) {
+            for (auto &slot : slots)
+                slot = nil;
+        }
+
+        uint64_t tick() const {
+            return tickNs;
+        }
+
+        size_t size() const {
+            return count;
+        }
+
+        uint64_t key(uint32_t node) const {
+            return nodes[node].key;
+        }
+
+        // new entry at the recent end; deadline `never` only tracks recency
+        uint32_t add(uint64_t key, uint64_t deadlineNs) {
+            uint32_t node;
+            if (freeList != nil) {
+                node = freeList;
+                freeList = nodes[node].next;
+            } else {
+                node = (uint32_t) nodes.size();
+                nodes.emplace_back();
+            }
+            Node &n = nodes[node];
+            n.key = key;
+            n.slot = nil;
+            n.prev = n.next = nil;
+            n.older = lruTail;
+            n.newer = nil;
+            if (lruTail != nil)
+                nodes[lruTail].newer = node;
+            else
+                lruHead = node;
+            lruTail = node;
+            ++count;
+            schedule(node, deadlineNs);
+            return node;
+        }
+
+        // reschedule and mark most recently used
+        void touch(uint32_t node, uint64_t deadlineNs) {
+            unschedule(node);
+            if (lruTail != node) {
+                unlinkRecency(node);
+                Node &n = nodes[node];
+                n.older = lruTail;
+                n.newer = nil;
+                nodes[lruTail].newer = node;
+                lruTail = node;
+            }
+            schedule(node, deadlineNs);
+        }
+
+        void remove(uint32_t node) {
+            unschedule(node);
+            unlinkRecency(node);
+            release(node);
+        }
+
+        // least recently touched entry, or nil
+        uint32_t oldest() const {
+            return lruHead;
+        }
+
+        // moves time forward, removing every entry whose deadline has passed
+        // and appending its key to `expired`
+        void advance(uint64_t nowNs, std::vector<uint64_t> &expired) {
+            uint64_t target = nowNs / tickNs;
+            if (!scheduled && current < target)
+                current = target;
+            while (current < target) {
+                ++current;
+                // when a coarser level's slot comes due, spread it over the finer ones
+                for (int level = 1; level < levels; ++level) {
+                    if (current & ((1ull << (bits * level)) - 1))
+                        break;
+                    uint32_t &head = slots[level * size_ + ((current >> (bits * level)) & mask)];
+                    uint32_t node = head;
+                    head = nil;
+                    while (node != nil) {
+                        uint32_t next = nodes[node].next;
+                        nodes[node].slot = nil;
+                        --scheduled;
+                        place(node);
+                        node = next;
+                    }
+                }
+                uint32_t &head = slots[current & mask];
+                uint32_t node = head;
+                head = nil;
+                while (node != nil) {
+                    uint32_t next = nodes[node].next;
+                    nodes[node].slot = nil;
+                    --scheduled;
+                    if (nodes[node].deadline <= current) {
+                        expired.push_back(nodes[node].key);
+                        unlinkRecency(node);
+                        release(node);
+                    } else {
+                        place(node);
+                    }
+                    node = next;
+                }
+            }
+        }
+
+    private:
+        static const int bits = 6;
+        static const int levels = 4;
+        static const uint32_t size_ = 1u << bits;
+        static const uint64_t mask = size_ - 1;
+
+        struct Node {
+            uint64_t key;
+            uint64_t deadline;      // in ticks
+            uint32_t slot;          // nil when not scheduled
+            uint32_t prev, next;    // slot list, next doubles as the free list link
+            uint32_t older, newer;  // recency list
+        };
+
+        uint64_t tickNs;
+        uint64_t current;
+        size_t count = 0;
+        size_t scheduled = 0;
+        std::vector<Node> nodes;
+        uint32_t freeList = nil;
+        uint32_t lruHead = nil, lruTail = nil;
+        uint32_t slots[levels * size_];
+
+        void schedule(uint32_t node, uint64_t deadlineNs) {
+            if (deadlineNs == never) {
+                nodes[node].deadline = never;
+                return;
+            }
+            uint64_t deadline = deadlineNs / tickNs;
+            // round up so an entry never expires before its deadline
+            if (deadline * tickNs < deadlineNs)
+                ++deadline;
+            nodes[node].deadline = deadline > current ? deadline : current + 1;
+            place(node);
+        }
+
+        void place(uint32_t node) {
+            uint64_t deadline = nodes[node].deadline;
+            uint64_t delta = deadline - current;
+            int level = 0;
+            while (level < levels - 1 && delta >= (1ull << (bits * (level + 1))))
+                ++level;
+            // past the top level's horizon park it in the furthest slot
+            uint64_t when = level == levels - 1 && delta >= (1ull << (bits * levels))
+                ? current + (1ull << (bits * levels)) - (1ull << (bits * level))
+                : deadline;
+            uint32_t slot = (uint32_t) (level * size_ + ((when >> (bits * level)) & mask));
+            Node &n = nodes[node];
+            if (n.slot == nil)
+                ++scheduled;
+            n.slot = slot;
+            n.prev = nil;
+            n.next = slots[slot];
+            if (n.next != nil)
+                nodes[n.next].prev = node;
+            slots[slot] = node;
+        }
+
+        void unschedule(uint32_t node) {
+            Node &n = nodes[node];
+            if (n.slot == nil)
+                return;
+            if (n.prev != nil)
+                nodes[n.prev].next = n.next;
+            else
+                slots[n.slot] = n.next;
+            if (n.next != nil)
+                nodes[n.next].prev = n.prev;
+            n.slot = nil;
+            --scheduled;
+        }
+
+        void unlinkRecency(uint32_t node) {
+            Node &n = nodes[node];
+            if (n.older != nil)
+                nodes[n.older].newer = n.newer;
+            else
+                lruHead = n.newer;
+            if (n.newer != nil)
+                nodes[n.newer].older = n.older;
+            else
+                lruTail = n.older;
+        }
+
+        void release(uint32_t node) {
+            nodes[node].next = freeList;
+            freeList = node;
+            --count;
+        }
+};
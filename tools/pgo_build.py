@@ -0,0 +1,134 @@
+"""Profile-guided build: compile instrumented, run bench/pgo_workload.py
+against the simulated backend, rebuild with the collected profile.
+
+    python tools/pgo_build.py [--out build/pgo] [--lto] [--compare] [--wheel]
+        [--seconds 2] [--repeat 3] [-- extra cmake args]
+
+Leaves the optimized module in <out>/use.  --compare also builds a plain
+Release module in <out>/baseline and prints both runs of the workload side
+by side, best of --repeat.  --wheel builds a wheel into dist/ from the same
+profile.  Profiles are collected with the sim backend; the core they
+exercise (dispatch, conversions, DeviceTable, metrics) is shared with the
+winrt backend, so on Windows pass -DPYWINBLE_BACKEND=sim for the collection
+run and build the wheel with the default backend.
+"""
+
+import argparse
+import glob
+import json
+import os
+import shlex
+import shutil
+import subprocess
+import sys
+
+ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+WORKLOAD = os.path.join(ROOT, "bench", "pgo_workload.py")
+
+
+def run(cmd, env=None):
+    print("+ " + " ".join(shlex.quote(c) for c in cmd), flush=True)
+    subprocess.check_call(cmd, env=env)
+
+
+def build(build_dir, cmake_args):
+    run(["cmake", "-S", ROOT, "-B", build_dir, "-DCMAKE_BUILD_TYPE=Release",
+         "-DPython3_EXECUTABLE=" + sys.executable, "-DPYWINBLE_BENCH=OFF", "-DPYWINBLE_TESTS=OFF"] + cmake_args)
+    run(["cmake", "--build", build_dir, "--config", "Release", "--parallel", str(os.cpu_count() or 1)])
+
+
+def module_dir(build_dir):
+    # multi-config generators put the module under the config name
+    for d in (os.path.join(build_dir, "Release"), build_dir):
+        if glob.glob(os.path.join(d, "pywinble*.so")) + glob.glob(os.path.join(d, "pywinble*.pyd")):
+            return d
+    raise RuntimeError("no pywinble module in " + build_dir)
+
+
+def workload(build_dir, seconds, out=None):
+    env = dict(os.environ, PYTHONPATH=module_dir(build_dir))
+    cmd = [sys.executable, WORKLOAD, "--seconds", str(seconds)]
+    if out:
+        cmd += ["--json", out]
+    run(cmd, env=env)
+    if out:
+        with open(out) as f:
+            return json.load(f)["results"]
+
+
+def compiler_id(build_dir):
+    with open(os.path.join(build_dir, "CMakeCache.txt")) as f:
+        for line in f:
+            if line.startswith("CMAKE_CXX_COMPILER_ID:"):
+                return line.split("=", 1)[1].strip()
+    return ""
+
+
+def merge_clang_profiles(profile_dir):
+    profdata = os.environ.get("LLVM_PROFDATA") or shutil.which("llvm-profdata")
+    if not profdata:
+        raise RuntimeError("llvm-profdata not found, set LLVM_PROFDATA")
+    raws = glob.glob(os.path.join(profile_dir, "*.profraw"))
+    run([profdata, "merge", "-o", os.path.join(profile_dir, "pywinble.profdata")] + raws)
+
+
+def compare(builds, seconds, repeat, out):
+    # runs alternate between builds so drift in machine speed hits both alike
+    best = dict((tag, {}) for tag in builds)
+    for i in range(repeat):
+        for tag, build_dir in builds.items():
+            results = workload(build_dir, seconds, os.path.join(out, "%s-%d.json" % (tag, i)))
+            for name, value in results.items():
+                best[tag][name] = max(best[tag].get(name, 0), value)
+    return best
+
+
+def main():
+    ap = argparse.ArgumentParser()
+    ap.add_argument("--out", default=os.path.join(ROOT, "build", "pgo"))
+    ap.add_argument("--lto", action="store_true", help="also link-time optimize")
+    ap.add_argument("--compare", action="store_true", help="benchmark against a plain Release build")
+    ap.add_argument("--wheel", action="store_true", help="build a wheel into dist/ with the profile")
+    ap.add_argument("--seconds", type=float, default=2.0, help="length of each workload section")
+    ap.add_argument("--repeat", type=int, default=3, help="comparison runs per build, best is kept")
+    ap.add_argument("cmake_args", nargs="*", help="extra cmake arguments, after --")
+    args = ap.parse_args()
+
+    out = os.path.abspath(args.out)
+    profile = os.path.join(out, "profile")
+    extra = list(args.cmake_args)
+    if args.lto:
+        extra.append("-DPYWINBLE_LTO=ON")
+
+    # stale counters from an older build would be merged into the new ones
+    shutil.rmtree(profile, ignore_errors=True)
+    generate = os.path.join(out, "generate")
+    build(generate, ["-DPYWINBLE_PGO=GENERATE", "-DPYWINBLE_PGO_DIR=" + profile] + extra)
+    workload(generate, args.seconds)
+    if "Clang" in compiler_id(generate):
+        merge_clang_profiles(profile)
+
+    use_args = ["-DPYWINBLE_PGO=USE", "-DPYWINBLE_PGO_DIR=" + profile] + extra
+    use = os.path.join(out, "use")
+    build(use, use_args)
+
+    if args.compare:
+        baseline = os.path.join(out, "baseline")
+        build(baseline, extra)
+        best = compare({"baseline": baseline, "pgo": use}, args.seconds, args.repeat, out)
+        before, after = best["baseline"], best["pgo"]
+        print("\n%-28s %14s %14s %8s" % ("", "release", "pgo", "change"))
+        for name in before:
+            print("%-28s %14.0f %14.0f %+7.1f%%" % (name, before[name], after[name],
+                                                     100.0 * (after[name] / before[name] - 1)))
+
+    if args.wheel:
+        env = dict(os.environ, PYWINBLE_CMAKE_ARGS=" ".join(shlex.quote(a) for a in use_args))
+        run([sys.executable, "-m", "pip", "wheel", ROOT, "-w", os.path.join(ROOT, "dist"),
+             "--no-deps", "--no-build-isolation"], env=env)
+
+    print("\noptimized module in " + module_dir(use))
+
+
+if __name__ == "__main__":
+    main()
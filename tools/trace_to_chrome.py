@@ -0,0 +1,105 @@
+"""Decode a pywinble trace ring file into Chrome trace JSON.
+
+    python tools/trace_to_chrome.py pywinble.trace [out.json]
+
+Open the output in chrome://tracing or https://ui.perfetto.dev.  Works on the
+file of a running process too; records still being written are skipped.
+"""
+
+import json
+import mmap
+import struct
+import sys
+
+HEADER = struct.Struct("<8sIIQQQQII")
+KIND = struct.Struct("<23sc")
+KINDS_OFFSET = HEADER.size
+# version 2 on: gilprof call site names, the id of gil_wait records
+SITES = struct.Struct("<II")
+SITE = struct.Struct("<24s")
+SITES_OFFSET = KINDS_OFFSET + 64 * KIND.size
+RECORD = struct.Struct("<IIQQIHH")
+HEADER_SIZE = 4096
+
+
+def format_id(id_type, value):
+    if id_type == b"a":
+        return ":".join("%02x" % ((value >> shift) & 0xff) for shift in range(40, -8, -8))
+    if id_type == b"g":
+        return "%08x-%04x-%04x" % (value >> 32, (value >> 16) & 0xffff, value & 0xffff)
+    return value
+
+
+def decode(path):
+    with open(path, "rb") as f:
+        data = mmap.mmap(f.fileno(), 0, access=mmap.ACCESS_READ)
+    magic, version, record_size, capacity, position, start_steady, start_unix, pid, kind_count = HEADER.unpack_from(data, 0)
+    if magic != b"PWBTRACE":
+        raise ValueError("%s is not a pywinble trace" % path)
+    if version not in (1, 2) or record_size != RECORD.size:
+        raise ValueError("unsupported trace version %d" % version)
+
+    kinds = []
+    for i in range(kind_count):
+        name, id_type = KIND.unpack_from(data, KINDS_OFFSET + i * KIND.size)
+        kinds.append((name.rstrip(b"\0").decode(), id_type))
+    sites = []
+    if version >= 2:
+        site_count, _ = SITES.unpack_from(data, SITES_OFFSET)
+        for i in range(site_count):
+            name, = SITE.unpack_from(data, SITES_OFFSET + SITES.size + i * SITE.size)
+            sites.append(name.rstrip(b"\0").decode())
+
+    events = [{"ph": "M", "pid": pid, "name": "process_name", "args": {"name": "pywinble"}}]
+    torn = 0
+    # the ring holds the last `capacity` records, oldest first
+    for slot in range(max(0, position - capacity), position):
+        seq, tid, ts, ident, dur, kind, arg = RECORD.unpack_from(data, HEADER_SIZE + (slot % capacity) * RECORD.size)
+        if seq != (slot + 1) & 0xffffffff or kind >= len(kinds):
+            torn += 1
+            continue
+        name, id_type = kinds[kind]
+        args = {}
+        if id_type != b"\0":
+            args["id"] = format_id(id_type, ident)
+        if arg:
+            args["arg"] = arg
+        if name == "gil_wait" and ident < len(sites):
+            args["site"] = sites[ident]
+        event = {
+            "name": name,
+            "pid": pid,
+            "tid": tid,
+            # microseconds since the unix epoch, so traces from several runs line up
+            "ts": (start_unix + (ts - start_steady)) / 1000.0,
+            "args": args,
+        }
+        if dur:
+            event["ph"] = "X"
+            event["dur"] = dur / 1000.0
+        else:
+            event["ph"] = "i"
+            event["s"] = "t"
+        events.append(event)
+
+    return {
+        "traceEvents": events,
+        "displayTimeUnit": "ns",
+        "otherData": {"records": position, "capacity": capacity, "torn": torn},
+    }
+
+
+def main():
+    if len(sys.argv) < 2:
+        sys.exit(__doc__)
+    trace = decode(sys.argv[1])
+    out = open(sys.argv[2], "w") if len(sys.argv) > 2 else sys.stdout
+    json.dump(trace, out)
+    out.write("\n")
+    other = trace["otherData"]
+    sys.stderr.write("%d events (%d written, ring of %d, %d torn)\n"
+                     % (len(trace["traceEvents"]) - 1, other["records"], other["capacity"], other["torn"]))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,405 @@
+#pragma once
+
+// Event tracer writing fixed-size binary records into a memory-mapped ring
+// file, for post-mortem analysis of what the radio and callbacks were doing.
+//
+// The file is a 4KB header followed by a power-of-two ring of 32-byte records.
+// Writers claim a slot with one atomic add on the header's position, fill the
+// record and publish it by storing its sequence number last, so a reader (or
+// the decoder after a crash) can tell complete records from torn ones.  The
+// mapping is shared, so the OS writes it back even when the process dies.
+// When tracing is off each trace point costs one relaxed load.
+//
+// Restarting or stopping the trace retires the old ring.  Trace points count
+// themselves in and out against an epoch, so the ring is unmapped as soon as
+// no thread that might have loaded it is still writing.
+//
+// tools/trace_to_chrome.py turns a trace file into Chrome trace JSON.
+
+#include <stdint.h>
+#include <string.h>
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+#endif
+
+#include "gilprof.h"
+#include "util.h"
+
+namespace tracer {
+
+enum Kind : uint16_t {
+    WatcherAdded,
+    WatcherUpdated,
+    WatcherRemoved,
+    WatcherCompleted,
+    WatcherStopped,
+    WatcherLost,
+    WatcherExpiry,
+    GilWait,
+    AdStatusCallback,
+    Advertise,
+    ProviderCreate,
+    CharacteristicCreate,
+    ProviderStart,
+    ProviderStop,
+    FleetAdvertisement,
+    FleetWrite,
+    KindCount
+};
+
+// how the decoder should show a record's id
+enum IdType : char {
+    NoId = 0,
+    AddressId = 'a',    // bluetooth address
+    GuidId = 'g',       // Data1..Data3 of a guid
+    NumberId = 'n',
+};
+
+struct KindInfo {
+    const char *name;
+    IdType idType;
+};
+
+inline KindInfo info(Kind kind) {
+    static const KindInfo kinds[KindCount] = {
+        {"watcher_added", AddressId},
+        {"watcher_updated", AddressId},
+        {"watcher_removed", AddressId},
+        {"watcher_completed", NoId},
+        {"watcher_stopped", NoId},
+        {"watcher_lost", AddressId},
+        {"watcher_expiry", NumberId},
+        {"gil_wait", NumberId},
+        {"adstatus_callback", NumberId},
+        {"advertise", NoId},
+        {"provider_create", GuidId},
+        {"characteristic_create", GuidId},
+        {"provider_start", GuidId},
+        {"provider_stop", GuidId},
+        {"fleet_advertisement", AddressId},
+        {"fleet_write", NumberId},
+    };
+    return kinds[kind];
+}
+
+struct Record {
+    std::atomic<uint32_t> seq;  // low bits of slot + 1, stored last
+    uint32_t tid;
+    uint64_t ts;                // steady clock ns at the start of the event
+    uint64_t id;
+    uint32_t dur;               // ns, saturating; 0 for instant events
+    uint16_t kind;
+    uint16_t arg;               // kind specific, e.g. the gil call site
+};
+
+static_assert(sizeof(Record) == 32, "trace record layout");
+
+struct Header {
+    char magic[8];              // "PWBTRACE"
+    uint32_t version;
+    uint32_t recordSize;
+    uint64_t capacity;          // records, a power of two
+    std::atomic<uint64_t> position;     // slots claimed so far
+    uint64_t startSteadyNs;     // steady clock and wall clock at start,
+    uint64_t startUnixNs;       // to place records in real time
+    uint32_t pid;
+    uint32_t kindCount;
+    struct {
+        char name[23];
+        char idType;
+    } kinds[64];
+    uint32_t siteCount;         // gilprof sites, the id of gil_wait records
+    uint32_t reserved;
+    struct {
+        char name[24];
+    } sites[32];
+};
+
+static_assert(sizeof(Header) <= 4096, "trace header fits its page");
+
+static const uint64_t headerSize = 4096;
+static const uint32_t version = 2;
+
+static_assert(KindCount <= 64 && gilprof::SiteCount <= 32, "trace header tables");
+
+inline uint32_t thread_id() {
+    thread_local uint32_t tid = 0;
+    if (!tid) {
+#if defined(_WIN32)
+        tid = (uint32_t) GetCurrentThreadId();
+#elif defined(__linux__)
+        tid = (uint32_t) syscall(SYS_gettid);
+#else
+        tid = (uint32_t) std::hash<std::thread::id>()(std::this_thread::get_id());
+#endif
+    }
+    return tid;
+}
+
+// id of a guid-keyed event: Data1, Data2 and Data3
+inline uint64_t guid_id(const Guid &guid) {
+    return (uint64_t) guid.Data1 << 32 | (uint64_t) guid.Data2 << 16 | guid.Data3;
+}
+
+class Ring {
+    public:
+        Header *header = nullptr;
+        Record *records = nullptr;
+        uint64_t mask = 0;
+        std::string path;
+
+        // maps `path` with room for `capacity` records, rounded up to a power of two
+        bool open(const std::string &path, uint64_t capacity, std::string &error) {
+            uint64_t size = 1;
+            while (size < capacity)
+                size <<= 1;
+            this->path = path;
+            mappedSize = headerSize + size * sizeof(Record);
+#ifdef _WIN32
+            file = CreateFileW(utf8_to_wide(path).c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ,
+                    NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+            if (file == INVALID_HANDLE_VALUE) {
+                error = "Could not create trace file";
+                return false;
+            }
+            mapping = CreateFileMappingW(file, NULL, PAGE_READWRITE, (DWORD) (mappedSize >> 32), (DWORD) mappedSize, NULL);
+            void *base = mapping ? MapViewOfFile(mapping, FILE_MAP_WRITE, 0, 0, mappedSize) : NULL;
+            if (!base) {
+                error = "Could not map trace file";
+                close();
+                return false;
+            }
+#else
+            // a new file rather than truncating the old one, which a ring being
+            // retired may still have mapped: writes past its end would fault
+            ::unlink(path.c_str());
+            fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+            if (fd < 0) {
+                error = "Could not create trace file";
+                return false;
+            }
+            void *base = MAP_FAILED;
+            if (ftruncate(fd, (off_t) mappedSize) == 0)
+                base = mmap(NULL, mappedSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            if (base == MAP_FAILED) {
+                error = "Could not map trace file";
+                close();
+                return false;
+            }
+#endif
+            header = (Header *) base;
+            records = (Record *) ((char *) base + headerSize);
+            mask = size - 1;
+
+            memcpy(header->magic, "PWBTRACE", 8);
+            header->version = version;
+            header->recordSize = sizeof(Record);
+            header->capacity = size;
+            header->position.store(0, std::memory_order_relaxed);
+            header->startSteadyNs = steady_now();
+            header->startUnixNs = (uint64_t) std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::system_clock::now().time_since_epoch()).count();
+#ifdef _WIN32
+            header->pid = (uint32_t) GetCurrentProcessId();
+#else
+            header->pid = (uint32_t) getpid();
+#endif
+            header->kindCount = KindCount;
+            for (int i = 0; i < KindCount; ++i) {
+                KindInfo kind = info((Kind) i);
+                strncpy(header->kinds[i].name, kind.name, sizeof(header->kinds[i].name) - 1);
+                header->kinds[i].idType = kind.idType;
+            }
+            header->siteCount = gilprof::SiteCount;
+            for (int i = 0; i < gilprof::SiteCount; ++i) {
+                const char *name = gilprof::site_name((gilprof::Site) i);
+                strncpy(header->sites[i].name, name, sizeof(header->sites[i].name) - 1);
+            }
+            return true;
+        }
+
+        // unmapping writes the records back to the file
+        ~Ring() {
+            if (!header)
+                return;
+#ifdef _WIN32
+            FlushViewOfFile(header, 0);
+            UnmapViewOfFile(header);
+#else
+            munmap(header, mappedSize);
+#endif
+            close();
+        }
+
+        void emit(Kind kind, uint64_t id, uint64_t startNs, uint64_t durNs, uint16_t arg) {
+            uint64_t slot = header->position.fetch_add(1, std::memory_order_relaxed);
+            Record &r = records[slot & mask];
+            r.seq.store(0, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+            r.tid = thread_id();
+            r.ts = startNs;
+            r.id = id;
+            r.dur = durNs > 0xffffffffu ? 0xffffffffu : (uint32_t) durNs;
+            r.kind = kind;
+            r.arg = arg;
+            r.seq.store((uint32_t) (slot + 1), std::memory_order_release);
+        }
+
+    private:
+        uint64_t mappedSize = 0;
+#ifdef _WIN32
+        HANDLE file = INVALID_HANDLE_VALUE;
+        HANDLE mapping = NULL;
+
+        void close() {
+            if (mapping)
+                CloseHandle(mapping);
+            if (file != INVALID_HANDLE_VALUE)
+                CloseHandle(file);
+            mapping = NULL;
+            file = INVALID_HANDLE_VALUE;
+        }
+#else
+        int fd = -1;
+
+        void close() {
+            if (fd >= 0)
+                ::close(fd);
+            fd = -1;
+        }
+#endif
+};
+
+class Tracer {
+    public:
+        static Tracer &get() {
+            static Tracer *tracer = new Tracer();
+            return *tracer;
+        }
+
+        bool start(const std::string &path, uint64_t capacity, std::string &error) {
+            std::lock_guard<std::mutex> lock(mtx);
+#ifdef _WIN32
+            // windows won't recreate a file that is still mapped
+            Ring *current = active.load();
+            if (current && current->path == path)
+                replace(nullptr);
+#endif
+            Ring *ring = new Ring();
+            if (!ring->open(path, capacity, error)) {
+                delete ring;
+                return false;
+            }
+            replace(ring);
+            return true;
+        }
+
+        void stop() {
+            std::lock_guard<std::mutex> lock(mtx);
+            replace(nullptr);
+        }
+
+        bool running() const {
+            return active.load(std::memory_order_relaxed) != nullptr;
+        }
+
+        // one record into the active ring, if there is one
+        void emit(Kind kind, uint64_t id, uint64_t startNs, uint64_t durNs, uint16_t arg) {
+            if (!running())
+                return;
+            // count in under the current epoch; one that moved on meanwhile
+            // may not be waiting for us, so count in again under the new one
+            uint32_t e = epoch.load();
+            writers[e & 1].fetch_add(1);
+            while (epoch.load() != e) {
+                writers[e & 1].fetch_sub(1);
+                e = epoch.load();
+                writers[e & 1].fetch_add(1);
+            }
+            if (Ring *ring = active.load())
+                ring->emit(kind, id, startNs, durNs, arg);
+            writers[e & 1].fetch_sub(1, std::memory_order_release);
+        }
+
+    private:
+        std::mutex mtx;
+        std::atomic<Ring *> active{nullptr};
+        std::atomic<uint32_t> epoch{0};
+        std::atomic<uint32_t> writers[2] = {{0}, {0}};
+
+        // with mtx held.  Writers that counted in under the old epoch may hold
+        // the old ring; later ones see the new one.  Waiting for the old
+        // epoch's count to drain every time also means a writer is never
+        // still around by the swap after next, which reuses its counter.
+        void replace(Ring *next) {
+            Ring *old = active.exchange(next);
+            uint32_t e = epoch.fetch_add(1);
+            while (writers[e & 1].load())
+                std::this_thread::yield();
+            delete old;
+        }
+};
+
+inline bool enabled() {
+    return Tracer::get().running();
+}
+
+inline void emit(Kind kind, uint64_t id, uint64_t startNs, uint64_t durNs, uint16_t arg) {
+    Tracer::get().emit(kind, id, startNs, durNs, arg);
+}
+
+inline void instant(Kind kind, uint64_t id = 0, uint16_t arg = 0) {
+    if (enabled())
+        emit(kind, id, steady_now(), 0, arg);
+}
+
+// records the time from construction to destruction as one event
+class Span {
+    public:
+        Span(Kind kind, uint64_t id = 0, uint16_t arg = 0)
+            : kind(kind), id(id), arg(arg), start(enabled() ? steady_now() : 0) {}
+
+        ~Span() {
+            if (start)
+                emit(kind, id, start, steady_now() - start, arg);
+        }
+
+        // false when tracing was off at construction, so ids needn't be looked up
+        bool active() const {
+            return start != 0;
+        }
+
+        void setId(uint64_t next) {
+            id = next;
+        }
+
+        void setArg(uint16_t next) {
+            arg = next;
+        }
+
+    private:
+        Kind kind;
+        uint64_t id;
+        uint16_t arg;
+        uint64_t start;
+};
+
+}
@@ -0,0 +1,161 @@
+#pragma once
+
+// Small portable helpers shared by the module's headers: clock, string
+// conversion and GUID text, none of which need windows headers.
+
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <chrono>
+#include <string>
+
+inline uint64_t steady_now() {
+    return (uint64_t) std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// utf-16 (windows) or utf-32 wide text to utf-8; bad surrogates become U+FFFD
+inline std::string wide_to_utf8(const wchar_t *s, size_t n) {
+    std::string out;
+    out.reserve(n);
+    for (size_t i = 0; i < n; ++i) {
+        uint32_t c = (uint32_t) s[i];
+        if (c < 0x80) {
+            out += (char) c;
+            continue;
+        }
+        if (sizeof(wchar_t) == 2 && c >= 0xD800 && c <= 0xDFFF) {
+            uint32_t lo = i + 1 < n ? (uint32_t) s[i + 1] : 0;
+            if (c <= 0xDBFF && lo >= 0xDC00 && lo <= 0xDFFF) {
+                c = 0x10000 + ((c - 0xD800) << 10) + (lo - 0xDC00);
+                ++i;
+            } else {
+                c = 0xFFFD;
+            }
+        }
+        if (c > 0x10FFFF)
+            c = 0xFFFD;
+        if (c < 0x800) {
+            out += (char) (0xC0 | (c >> 6));
+        } else if (c < 0x10000) {
+            out += (char) (0xE0 | (c >> 12));
+            out += (char) (0x80 | ((c >> 6) & 0x3F));
+        } else {
+            out += (char) (0xF0 | (c >> 18));
+            out += (char) (0x80 | ((c >> 12) & 0x3F));
+            out += (char) (0x80 | ((c >> 6) & 0x3F));
+        }
+        out += (char) (0x80 | (c & 0x3F));
+    }
+    return out;
+}
+
+inline std::string wide_to_utf8(const std::wstring &s) {
+    return wide_to_utf8(s.data(), s.size());
+}
+
+// utf-8 to wide text; invalid sequences become U+FFFD
+inline std::wstring utf8_to_wide(const char *s, size_t n) {
+    std::wstring out;
+    out.reserve(n);
+    const unsigned char *p = (const unsigned char *) s, *end = p + n;
+    while (p < end) {
+        uint32_t c = *p++;
+        int extra = c < 0x80 ? 0 : c < 0xC2 ? -1 : c < 0xE0 ? 1 : c < 0xF0 ? 2 : c < 0xF5 ? 3 : -1;
+        if (extra < 0 || end - p < extra) {
+            out += (wchar_t) 0xFFFD;
+            continue;
+        }
+        if (extra)
+            c &= 0x3F >> extra;
+        int i = 0;
+        for (; i < extra && (p[i] & 0xC0) == 0x80; ++i)
+            c = (c << 6) | (p[i] & 0x3F);
+        if (i < extra) {
+            out += (wchar_t) 0xFFFD;
+            p += i;
+            continue;
+        }
+        p += extra;
+        if (sizeof(wchar_t) == 2 && c >= 0x10000) {
+            c -= 0x10000;
+            out += (wchar_t) (0xD800 + (c >> 10));
+            out += (wchar_t) (0xDC00 + (c & 0x3FF));
+        } else {
+            out += (wchar_t) c;
+        }
+    }
+    return out;
+}
+
+inline std::wstring utf8_to_wide(const std::string &s) {
+    return utf8_to_wide(s.data(), s.size());
+}
+
+inline std::string hexlify(uint64_t v, bool add_colons = false) {
+    std::string ret;
+    ret.resize(33);
+    int len = sprintf(&ret[0], "%" PRIx64, v);
+    ret.resize(len);
+    if (! add_colons || len <= 2)
+        return ret;
+    std::string ret2;
+    ret2.resize(len + (len / 2 - 1));
+    for (int i = 0, j = 0; i < len; ++i, ++j) {
+        ret2[j]=ret[i];
+        if (i % 2 && i < (len-1))
+            ret2[++j] = ':';
+    }
+    return ret2;
+}
+
+// same layout as the windows GUID / winrt::guid
+struct Guid {
+    uint32_t Data1;
+    uint16_t Data2;
+    uint16_t Data3;
+    uint8_t Data4[8];
+};
+
+// "xxxxxxxx-xxxx-xxxx-xxxx-xxxxxxxxxxxx", with or without braces
+inline bool parse_guid(const char *str, Guid &guid) {
+    size_t len = strlen(str);
+    if (len == 38 && str[0] == '{' && str[37] == '}') {
+        ++str;
+        len -= 2;
+    }
+    if (len != 36 || str[8] != '-' || str[13] != '-' || str[18] != '-' || str[23] != '-')
+        return false;
+    uint8_t bytes[16];
+    for (int i = 0, pos = 0; i < 16; ++i) {
+        if (str[pos] == '-')
+            ++pos;
+        int v = 0;
+        for (int k = 0; k < 2; ++k, ++pos) {
+            char c = str[pos];
+            v <<= 4;
+            if (c >= '0' && c <= '9') v |= c - '0';
+            else if (c >= 'a' && c <= 'f') v |= c - 'a' + 10;
+            else if (c >= 'A' && c <= 'F') v |= c - 'A' + 10;
+            else return false;
+        }
+        bytes[i] = (uint8_t) v;
+    }
+    guid.Data1 = (uint32_t) bytes[0] << 24 | (uint32_t) bytes[1] << 16 | (uint32_t) bytes[2] << 8 | bytes[3];
+    guid.Data2 = (uint16_t) (bytes[4] << 8 | bytes[5]);
+    guid.Data3 = (uint16_t) (bytes[6] << 8 | bytes[7]);
+    memcpy(guid.Data4, bytes + 8, 8);
+    return true;
+}
+
+// "{XXXXXXXX-XXXX-XXXX-XXXX-XXXXXXXXXXXX}", as StringFromGUID2 writes it
+inline std::string format_guid(const Guid &guid) {
+    char buf[39];
+    snprintf(buf, sizeof(buf), "{%08" PRIX32 "-%04X-%04X-%02X%02X-%02X%02X%02X%02X%02X%02X}",
+            guid.Data1, guid.Data2, guid.Data3,
+            guid.Data4[0], guid.Data4[1], guid.Data4[2], guid.Data4[3],
+            guid.Data4[4], guid.Data4[5], guid.Data4[6], guid.Data4[7]);
+    return std::string(buf, 38);
+}
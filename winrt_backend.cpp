@@ -0,0 +1,930 @@
+// Windows backend: the adapter, advertising, gatt provider and device
+// watcher on top of C++/WinRT.
+
+#pragma comment(lib, "windowsapp")
+
+#include "pywinble.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "characteristics.h"
+
+#include "winrt/Windows.Foundation.h"
+#include "winrt/Windows.Storage.Streams.h"
+#include "winrt/Windows.System.Threading.h"
+#include "winrt/Windows.Devices.Bluetooth.h"
+#include "winrt/Windows.Devices.Enumeration.h"
+#include "winrt/Windows.Devices.Bluetooth.Advertisement.h"
+#include "winrt/Windows.Devices.Bluetooth.GenericAttributeProfile.h"
+
+//#include <collection.h>
+using namespace std;
+using namespace winrt::Windows::Foundation;
+using namespace winrt::Windows::Devices;
+using namespace winrt::Windows::Storage::Streams;
+using namespace winrt::Windows::Devices::Bluetooth;
+using namespace winrt::Windows::Devices::Bluetooth::GenericAttributeProfile;
+using namespace winrt::Windows::Devices::Enumeration;
+using winrt::Windows::System::Threading::ThreadPoolTimer;
+
+
+// ################ GENERIC WINRT
+//
+std::string w2a(const winrt::hstring& hs) {
+    // # can be used in an exception
+    return wide_to_utf8(hs.c_str(), hs.size());
+}
+
+winrt::guid to_winrt(const Guid &guid) {
+    static_assert(sizeof(Guid) == sizeof(winrt::guid), "guid layout");
+    winrt::guid out;
+    memcpy(&out, &guid, sizeof(out));
+    return out;
+}
+
+Guid from_winrt(const winrt::guid &guid) {
+    Guid out;
+    memcpy(&out, &guid, sizeof(out));
+    return out;
+}
+
+// nothing winrt is touched at import.  Each thread joins the multithreaded
+// apartment the first time it calls into the backend; threads that never do
+// are treated as implicitly multithreaded by com once any thread has joined.
+void winrt_init() {
+    static thread_local bool did = false;
+    if (did)
+        return;
+    try {
+        winrt::init_apartment();
+    } catch (const winrt::hresult_error &e) {
+        // the host already made this thread single-threaded, which works too
+        if (e.code() != RPC_E_CHANGED_MODE)
+            Py_RETURN_ERROR(PyExc_OSError, w2a(e.message()).c_str());
+    }
+    did = true;
+}
+
+PyObject *PyVar(const winrt::hstring &var) {
+#if PY_MAJOR_VERSION > 2
+    return PyUnicode_FromWideChar(var.c_str(), var.size());
+#else
+    // todo : support unicode in py 2
+    return PyString_FromString(w2a(var).c_str());
+#endif
+}
+
+// boxed winrt property values, as found in DeviceInformation::Properties()
+PyObject *PyVar(const IInspectable &var) {
+    auto prop = var.try_as<IPropertyValue>();
+    if (!prop)
+        Py_RETURN_NONE;
+    switch (prop.Type()) {
+        case PropertyType::String: return PyVar(prop.GetString());
+        case PropertyType::Boolean: return PyBool_FromLong(prop.GetBoolean());
+        case PropertyType::UInt8: return PyLong_FromUnsignedLong(prop.GetUInt8());
+        case PropertyType::Int16: return PyLong_FromLong(prop.GetInt16());
+        case PropertyType::UInt16: return PyLong_FromUnsignedLong(prop.GetUInt16());
+        case PropertyType::Int32: return PyLong_FromLong(prop.GetInt32());
+        case PropertyType::UInt32: return PyLong_FromUnsignedLong(prop.GetUInt32());
+        case PropertyType::Int64: return PyLong_FromLongLong(prop.GetInt64());
+        case PropertyType::UInt64: return PyLong_FromUnsignedLongLong(prop.GetUInt64());
+        case PropertyType::Single: return PyFloat_FromDouble(prop.GetSingle());
+        case PropertyType::Double: return PyFloat_FromDouble(prop.GetDouble());
+        default: Py_RETURN_NONE;
+    }
+}
+
+// ################ BLUTOOTH
+// mtx guards the rest and is never held while taking the GIL
+struct BackendState {
+    std::mutex mtx;
+    // an async operation takes a single completion handler, so one waiter at a time
+    std::mutex waitMtx;
+    // the adapter is resolved on first use, or in the background after prewarm()
+    BluetoothAdapter adapter = nullptr;
+    IAsyncOperation<BluetoothAdapter> adapterLookup = nullptr;
+    uint64_t adapterLookupStart = 0;
+    Advertisement::BluetoothLEAdvertisementPublisher publisher = nullptr;
+    py::object onStatus;
+};
+
+// caller holds backend.mtx
+static void begin_adapter_lookup(BackendState &backend) {
+    if (backend.adapter || backend.adapterLookup)
+        return;
+    metrics::count(metrics::AdapterLookups);
+    backend.adapterLookupStart = steady_now();
+    backend.adapterLookup = BluetoothAdapter::GetDefaultAsync();
+}
+
+BluetoothAdapter get_adapter(BackendState &backend) {
+    winrt_init();
+    {
+        std::lock_guard<std::mutex> lock(backend.mtx);
+        if (backend.adapter)
+            return backend.adapter;
+        begin_adapter_lookup(backend);
+    }
+
+    {
+        py::gil_scoped_release release;
+        std::lock_guard<std::mutex> wait(backend.waitMtx);
+        IAsyncOperation<BluetoothAdapter> op = nullptr;
+        {
+            std::lock_guard<std::mutex> lock(backend.mtx);
+            op = backend.adapterLookup;
+        }
+        if (op) {
+            BluetoothAdapter adapter = nullptr;
+            try {
+                adapter = op.get();
+            } catch (const winrt::hresult_error &) {
+            }
+            std::lock_guard<std::mutex> lock(backend.mtx);
+            metrics::record(metrics::AdapterLookupTime, steady_now() - backend.adapterLookupStart);
+            // a failed lookup is retried by the next call
+            backend.adapterLookup = nullptr;
+            backend.adapter = adapter;
+            if (!adapter)
+                metrics::count(metrics::AdapterErrors);
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(backend.mtx);
+    if (!backend.adapter)
+        Py_RETURN_ERROR(PyExc_OSError, "Adapter discovery error");
+    return backend.adapter;
+}
+
+void pywinble_prewarm(ModuleState &state) {
+    winrt_init();
+    std::lock_guard<std::mutex> lock(state.backend->mtx);
+    begin_adapter_lookup(*state.backend);
+}
+
+// on a winrt thread; the publisher's handler holds the state weakly, so a
+// status change that arrives after the module is gone is dropped
+void call_on_adstatus_callback(BackendState &backend, const Advertisement::BluetoothLEAdvertisementPublisherStatusChangedEventArgs &status) {
+    {
+        std::lock_guard<std::mutex> lock(backend.mtx);
+        if (!backend.onStatus)
+            return;
+    }
+    tracer::Span span(tracer::AdStatusCallback, (uint64_t) status.Status(), (uint16_t) status.Error());
+    gil_lock acquire(gilprof::AdStatusCallback);
+    py::object cb;
+    {
+        // shutdown() may have let go of it while we waited for the GIL
+        std::lock_guard<std::mutex> lock(backend.mtx);
+        cb = backend.onStatus;
+    }
+    if (!cb)
+        return;
+    metrics::Timer timer(metrics::CallbackTime);
+    StatusCallback notify(cb);
+    notify((int)status.Error(), (int)status.Status());
+}
+
+static void stop_publisher(Advertisement::BluetoothLEAdvertisementPublisher &publisher) {
+    metrics::Timer timer(metrics::AdvertisementStopTime);
+    publisher.Stop();
+    publisher = nullptr;
+    metrics::count(metrics::AdvertisementsStopped);
+}
+
+py::dict pywinble_info(ModuleState &state) {
+    BluetoothAdapter adapter = get_adapter(*state.backend);
+
+    py::dict dict;
+
+    #define ADD_DICT(key, var) dict[key]=var
+    #define ADD_DICT_O(ob, var) dict[#var]=ob.var()
+
+    ADD_DICT("BluetoothAddress", hexlify(adapter.BluetoothAddress(), true));
+    ADD_DICT("DeviceId", w2a(adapter.DeviceId()));
+
+    ADD_DICT_O(adapter, IsLowEnergySupported);
+    ADD_DICT_O(adapter, IsClassicSupported);
+    ADD_DICT_O(adapter, IsPeripheralRoleSupported);
+    ADD_DICT_O(adapter, IsAdvertisementOffloadSupported);
+    ADD_DICT_O(adapter, AreLowEnergySecureConnectionsSupported);
+
+    return dict;
+}
+
+void pywinble_advertise(ModuleState &state, const std::string &data, py::object onStatus) {
+    winrt_init();
+    if (!onStatus.is_none() && !PyCallable_Check(onStatus.ptr()))
+        Py_RETURN_ERROR(PyExc_TypeError, "parameter must be callable");
+
+    BackendState &backend = *state.backend;
+    Advertisement::BluetoothLEAdvertisementPublisher previous = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(backend.mtx);
+        // the old callback is released after the lock, with onStatus
+        if (!onStatus.is_none())
+            std::swap(backend.onStatus, onStatus);
+        std::swap(previous, backend.publisher);
+    }
+    if (previous)
+        stop_publisher(previous);
+
+    Advertisement::BluetoothLEAdvertisementPublisher publisher;
+    if (!publisher) {
+        Py_RETURN_ERROR(PyExc_RuntimeError, "Pub create failed");
+    }
+
+    auto advertisement = publisher.Advertisement();
+
+    Advertisement::BluetoothLEManufacturerData mandat;
+    mandat.CompanyId(0xFFFE);
+    auto writer = DataWriter();
+    writer.WriteString(utf8_to_wide(data));
+    mandat.Data(writer.DetachBuffer());
+    advertisement.ManufacturerData().Append(mandat);
+
+    try {
+        metrics::Timer timer(metrics::AdvertisementStartTime);
+    	publisher.Start();
+    } catch (const winrt::hresult_error &e) {
+        metrics::count(metrics::AdvertisementErrors);
+        Py_RETURN_ERROR(PyExc_RuntimeError, w2a(e.message()).c_str());
+    }
+    metrics::count(metrics::AdvertisementsStarted);
+    tracer::instant(tracer::Advertise);
+
+    weak_ptr<BackendState> weak = state.backend;
+    publisher.StatusChanged([weak](const Advertisement::BluetoothLEAdvertisementPublisher &,
+            const Advertisement::BluetoothLEAdvertisementPublisherStatusChangedEventArgs &status) {
+        if (auto backend = weak.lock())
+            call_on_adstatus_callback(*backend, status);
+    });
+
+    {
+        std::lock_guard<std::mutex> lock(backend.mtx);
+        std::swap(previous, backend.publisher);
+        backend.publisher = publisher;
+    }
+    // a concurrent advertise() got there first; the last one wins
+    if (previous)
+        stop_publisher(previous);
+}
+
+class BLEProvider : public lifecycle::Resource {
+    public:
+        GattServiceProvider provider;
+
+        BLEProvider(GattServiceProvider ref) : provider(ref) {
+            if (!provider) 
+                throw std::exception("empty provider error");
+            metrics::gauge_add(metrics::ActiveProviders, 1);
+        }
+
+        ~BLEProvider() {
+            if (!closed)
+                provider.StopAdvertising();
+            metrics::gauge_add(metrics::ActiveProviders, -1);
+        }
+
+        bool close(uint64_t) override {
+            lock_guard<mutex> lock(mtx);
+            if (!closed)
+                stopLocked();
+            closed = true;
+            return true;
+        }
+
+        std::string getUUID() {
+            return format_guid(from_winrt(provider.Service().Uuid()));
+        }
+
+        GattLocalService Service() {
+            return provider.Service();
+        }
+
+        void StartAdvertising() {
+            lock_guard<mutex> lock(mtx);
+            if (closed)
+                Py_RETURN_ERROR(PyExc_RuntimeError, "Provider is closed");
+            auto cparam = GattServiceProviderAdvertisingParameters();
+            cparam.IsDiscoverable(true);
+            tracer::Span span(tracer::ProviderStart);
+            if (span.active())
+                span.setId(tracer::guid_id(from_winrt(provider.Service().Uuid())));
+            metrics::Timer timer(metrics::AdvertisementStartTime);
+            provider.StartAdvertising(cparam);
+            metrics::count(metrics::AdvertisementsStarted);
+        }
+
+        void StopAdvertising() {
+            lock_guard<mutex> lock(mtx);
+            stopLocked();
+        }
+
+    private:
+        mutex mtx;
+        bool closed = false;
+
+        void stopLocked() {
+            tracer::Span span(tracer::ProviderStop);
+            if (span.active())
+                span.setId(tracer::guid_id(from_winrt(provider.Service().Uuid())));
+            metrics::Timer timer(metrics::AdvertisementStopTime);
+            provider.StopAdvertising();
+            metrics::count(metrics::AdvertisementsStopped);
+        }
+};
+
+
+shared_ptr<BLEProvider> pywinble_provide(ModuleState &state, const std::string &uuid_str, characteristic_map characteristics) {
+    winrt_init();
+    Guid uuid;
+    if (!parse_guid(uuid_str.c_str(), uuid))
+        Py_RETURN_ERROR(PyExc_ValueError, "Invalid service uuid");
+
+    auto specs = parse_characteristics(characteristics);
+
+    GattServiceProviderResult result = nullptr;
+    {
+        tracer::Span span(tracer::ProviderCreate, tracer::guid_id(uuid));
+        metrics::Timer timer(metrics::ProviderCreateTime);
+        result = GattServiceProvider::CreateAsync(to_winrt(uuid)).get();
+    }
+
+    if (result.Error() != BluetoothError::Success) {
+        metrics::count(metrics::ProviderErrors);
+        Py_RETURN_ERROR(PyExc_RuntimeError, "Bluetooth error");
+    }
+
+    auto ble = make_shared<BLEProvider>(result.ServiceProvider());
+    metrics::count(metrics::ProvidersCreated);
+
+    for (auto &spec : specs) {
+        GattLocalCharacteristicParameters cParams;
+        cParams.CharacteristicProperties((GattCharacteristicProperties) spec.flags);
+        if (spec.hasDescription)
+            cParams.UserDescription(spec.description);
+
+        GattLocalCharacteristicResult result = nullptr;
+        {
+            tracer::Span span(tracer::CharacteristicCreate, tracer::guid_id(spec.uuid));
+            metrics::Timer timer(metrics::CharacteristicCreateTime);
+            result = ble->Service().CreateCharacteristicAsync(to_winrt(spec.uuid), cParams).get();
+        }
+
+        if (result.Error() != BluetoothError::Success) {
+            metrics::count(metrics::CharacteristicErrors);
+            Py_RETURN_ERROR(PyExc_RuntimeError, "Bluetooth error");
+        }
+        metrics::count(metrics::CharacteristicsCreated);
+    }
+
+    return lifecycle::track(state.resources, ble);
+}
+
+const wchar_t *AEP_DEVICE_ADDRESS = L"System.Devices.Aep.DeviceAddress";
+const wchar_t *AEP_SIGNAL_STRENGTH = L"System.Devices.Aep.SignalStrength";
+
+class BLEWatcher : public lifecycle::Resource, public enable_shared_from_this<BLEWatcher> {
+    public:
+        DeviceWatcher watcher;
+
+        BLEWatcher(std::vector<std::string> props, py::object callback, double ttl = 0, size_t maxDevices = 0,
+                const RssiFilter &filter = RssiFilter()) : watcher(nullptr), callback(callback) {
+            if (!callback.is_none() && !PyCallable_Check(callback.ptr()))
+                Py_RETURN_ERROR(PyExc_TypeError, "callback must be callable");
+            if (ttl < 0)
+                Py_RETURN_ERROR(PyExc_ValueError, "ttl must not be negative");
+            devices->setExpiry((uint64_t) (ttl * 1e9), maxDevices);
+            devices->setFilter(filter);
+            for (int i = 0; i < (int) WatchEvent::Count; ++i)
+                eventNames[i] = py::str(watch_event_name((WatchEvent) i));
+            std::vector<winrt::hstring> wprops;
+            for (auto &prop : props)
+                wprops.emplace_back(utf8_to_wide(prop));
+            // the device table needs these regardless of what the caller asked for
+            for (auto required : {AEP_DEVICE_ADDRESS, AEP_SIGNAL_STRENGTH}) {
+                if (std::find(wprops.begin(), wprops.end(), required) == wprops.end())
+                    wprops.emplace_back(required);
+            }
+            watcher = DeviceInformation::CreateWatcher(
+                    BluetoothLEDevice::GetDeviceSelectorFromPairingState(false),
+                    wprops,
+                    DeviceInformationKind::AssociationEndpoint);
+            // last: the destructor that takes it back doesn't run if we throw
+            metrics::gauge_add(metrics::ActiveWatchers, 1);
+        }
+
+        // handlers hold a weak reference, so events in flight during teardown are dropped
+        void bind() {
+            weak_ptr<BLEWatcher> weak = shared_from_this();
+            auto received = [](const weak_ptr<BLEWatcher> &weak) {
+                metrics::count(metrics::WatcherEventsReceived);
+                auto self = weak.lock();
+                if (!self)
+                    metrics::count(metrics::WatcherEventsDropped);
+                return self;
+            };
+            addedToken = watcher.Added(winrt::auto_revoke, [weak, received](const DeviceWatcher &, const DeviceInformation &devinfo) {
+                if (auto self = received(weak)) self->onAdded(devinfo);
+            });
+            updatedToken = watcher.Updated(winrt::auto_revoke, [weak, received](const DeviceWatcher &, const DeviceInformationUpdate &update) {
+                if (auto self = received(weak)) self->onUpdated(update);
+            });
+            removedToken = watcher.Removed(winrt::auto_revoke, [weak, received](const DeviceWatcher &, const DeviceInformationUpdate &update) {
+                if (auto self = received(weak)) self->onRemoved(update);
+            });
+            completedToken = watcher.EnumerationCompleted(winrt::auto_revoke, [weak, received](const DeviceWatcher &, const winrt::Windows::Foundation::IInspectable &) {
+                if (auto self = received(weak)) self->onEnumerationCompleted();
+            });
+            stoppedToken = watcher.Stopped(winrt::auto_revoke, [weak, received](const DeviceWatcher &, const winrt::Windows::Foundation::IInspectable &) {
+                if (auto self = received(weak)) self->onStopped();
+            });
+        }
+
+        // single dispatch path for every watcher event: callback(event, id, properties)
+        void onCb(WatchEvent type, const DeviceInformation &devinfo = nullptr) {
+            static_assert(tracer::WatcherLost - tracer::WatcherAdded == (int) WatchEvent::Lost, "trace kinds follow WatchEvent");
+            tracer::Span span((tracer::Kind) (tracer::WatcherAdded + (int) type));
+            uint64_t address;
+            if (span.active() && devinfo && deviceAddress(devinfo, address))
+                span.setId(address);
+
+            // close() drops the callbacks once nothing is inside this gate
+            lifecycle::Gate::Pass pass(gate);
+            if (!pass || !callback)
+                return;
+
+            gil_lock gil(gilprof::WatcherEvent);
+            metrics::Timer timer(metrics::CallbackTime);
+            try {
+                callPython(type, devinfo);
+            } catch (py::error_already_set &e) {
+                metrics::count(metrics::CallbackErrors);
+                e.restore();
+                PyErr_WriteUnraisable(callback.function().ptr());
+            }
+            metrics::count(metrics::WatcherEventsDelivered);
+        }
+
+        void callPython(WatchEvent type, const DeviceInformation &devinfo) {
+            py::object id = devinfo ? py::reinterpret_steal<py::object>(PyVar(devinfo.Id())) : py::none();
+            py::dict props;
+            if (devinfo) {
+                for (auto const &kv : devinfo.Properties())
+                    props[py::reinterpret_steal<py::object>(PyVar(kv.Key()))] = py::reinterpret_steal<py::object>(PyVar(kv.Value()));
+            }
+            uint64_t address;
+            DeviceTable::Row row;
+            if (devinfo && deviceAddress(devinfo, address) && devices->get(address, row) &&
+                    row.rssi != DeviceTable::noReading) {
+                props["rssi"] = row.smoothed;
+                props["distance"] = row.distance;
+            }
+            callback(eventNames[(int) type], id, props);
+        }
+
+        void onAdded(const DeviceInformation &devinfo) {
+            {
+                lock_guard<mutex> lock(mtx);
+                if (resyncing) {
+                    // re-enumeration after resume: known devices are refreshed silently
+                    seen.insert(devinfo.Id());
+                    auto known = cache.find(devinfo.Id());
+                    if (known != cache.end()) {
+                        known->second = devinfo;
+                        record(devinfo, devinfo.Properties());
+                        return;
+                    }
+                }
+                cache[devinfo.Id()] = devinfo;
+                lostIds.erase(devinfo.Id());
+                record(devinfo, devinfo.Properties());
+                if (paused) {
+                    metrics::count(metrics::WatcherEventsDropped);
+                    return;
+                }
+            }
+            onCb(WatchEvent::Added, devinfo);
+        }
+
+        void onUpdated(const DeviceInformationUpdate &update) {
+            DeviceInformation devinfo = nullptr;
+            WatchEvent type = WatchEvent::Updated;
+            {
+                lock_guard<mutex> lock(mtx);
+                auto known = cache.find(update.Id());
+                if (known == cache.end())
+                    return;
+                known->second.Update(update);
+                // aged out earlier, so this is a new sighting as far as python knows
+                if (lostIds.erase(update.Id()))
+                    type = WatchEvent::Added;
+                record(known->second, update.Properties());
+                if (paused) {
+                    metrics::count(metrics::WatcherEventsDropped);
+                    return;
+                }
+                devinfo = known->second;
+            }
+            onCb(type, devinfo);
+        }
+
+        void onRemoved(const DeviceInformationUpdate &update) {
+            DeviceInformation devinfo = nullptr;
+            {
+                lock_guard<mutex> lock(mtx);
+                auto known = cache.find(update.Id());
+                if (known == cache.end())
+                    return;
+                devinfo = known->second;
+                forget(devinfo);
+                cache.erase(known);
+                if (lostIds.erase(update.Id()))
+                    return;
+                if (paused) {
+                    metrics::count(metrics::WatcherEventsDropped);
+                    return;
+                }
+            }
+            onCb(WatchEvent::Removed, devinfo);
+        }
+
+        void onEnumerationCompleted() {
+            std::vector<DeviceInformation> lost;
+            bool notify;
+            {
+                lock_guard<mutex> lock(mtx);
+                if (state == WatcherState::Started)
+                    state = WatcherState::Enumerated;
+                notify = !resyncing;
+                if (resyncing) {
+                    // anything cached but not re-announced went away while paused
+                    for (auto it = cache.begin(); it != cache.end();) {
+                        if (seen.count(it->first)) {
+                            ++it;
+                        } else if (lostIds.erase(it->first)) {
+                            it = cache.erase(it);
+                        } else {
+                            lost.push_back(it->second);
+                            forget(it->second);
+                            it = cache.erase(it);
+                        }
+                    }
+                    seen.clear();
+                    resyncing = false;
+                }
+            }
+            for (auto &devinfo : lost)
+                onCb(WatchEvent::Removed, devinfo);
+            if (notify)
+                onCb(WatchEvent::Completed);
+        }
+
+        void onStopped() {
+            bool notify;
+            {
+                lock_guard<mutex> lock(mtx);
+                state = watcher.Status() == DeviceWatcherStatus::Aborted ? WatcherState::Aborted : WatcherState::Stopped;
+                notify = !paused && !resumePending;
+                if (resumePending) {
+                    resumePending = false;
+                    seen.clear();
+                    resyncing = true;
+                    try {
+                        startLocked();
+                    } catch (const winrt::hresult_error &) {
+                        resyncing = false;
+                        state = WatcherState::Aborted;
+                        notify = true;
+                    }
+                }
+            }
+            if (notify)
+                onCb(WatchEvent::Stopped);
+            {
+                lock_guard<mutex> lock(mtx);
+                ++stops;
+            }
+            stopped.notify_all();
+        }
+
+        // reports devices aged out by ttl or evicted by the size cap, under one GIL hold
+        void expireDevices() {
+            std::vector<DeviceInformation> lost;
+            {
+                lock_guard<mutex> lock(mtx);
+                if (resyncing || paused)
+                    return;
+                std::vector<uint64_t> addresses;
+                if (!devices->expire(steady_now(), addresses))
+                    return;
+                syncTracked();
+                for (auto address : addresses) {
+                    auto id = addressIds.find(address);
+                    if (id == addressIds.end())
+                        continue;
+                    auto known = cache.find(id->second);
+                    if (known != cache.end()) {
+                        // winrt still tracks it, a later update brings it back
+                        lostIds.insert(id->second);
+                        lost.push_back(known->second);
+                    }
+                    addressIds.erase(id);
+                }
+            }
+            if (lost.empty())
+                return;
+            lifecycle::Gate::Pass pass(gate);
+            if (!pass)
+                return;
+            tracer::Span span(tracer::WatcherExpiry, lost.size());
+            unique_ptr<gil_lock> gil;
+            if (callback)
+                gil.reset(new gil_lock(gilprof::WatcherExpiry));
+            for (auto &devinfo : lost)
+                onCb(WatchEvent::Lost, devinfo);
+        }
+
+        void start() {
+            lock_guard<mutex> lock(mtx);
+            if (closed)
+                Py_RETURN_ERROR(PyExc_RuntimeError, "Watcher is closed");
+            paused = false;
+            resumePending = false;
+            switch (state) {
+                case WatcherState::Started:
+                case WatcherState::Enumerated:
+                    return;
+                case WatcherState::Stopping:
+                    Py_RETURN_ERROR(PyExc_RuntimeError, "Watcher is stopping");
+                default:
+                    cache.clear();
+                    addressIds.clear();
+                    lostIds.clear();
+                    devices->clear();
+                    syncTracked();
+                    resyncing = false;
+                    startChecked();
+            }
+        }
+
+        void stop() {
+            lock_guard<mutex> lock(mtx);
+            paused = false;
+            resumePending = false;
+            stopLocked();
+        }
+
+        // stops the radio scan but keeps the device cache for resume()
+        void pause() {
+            lock_guard<mutex> lock(mtx);
+            if (state != WatcherState::Started && state != WatcherState::Enumerated)
+                return;
+            paused = true;
+            stopLocked();
+        }
+
+        void resume() {
+            lock_guard<mutex> lock(mtx);
+            if (closed)
+                Py_RETURN_ERROR(PyExc_RuntimeError, "Watcher is closed");
+            if (!paused)
+                return;
+            paused = false;
+            if (state == WatcherState::Stopping) {
+                resumePending = true;
+                return;
+            }
+            seen.clear();
+            resyncing = true;
+            startChecked();
+        }
+
+        std::string getState() {
+            lock_guard<mutex> lock(mtx);
+            return watcher_state_name(state);
+        }
+
+        bool isPaused() {
+            lock_guard<mutex> lock(mtx);
+            return paused;
+        }
+
+        size_t size() {
+            lock_guard<mutex> lock(mtx);
+            return cache.size();
+        }
+
+        DeviceTableView getDevices() {
+            return DeviceTableView(devices);
+        }
+
+        // stops the radio scan, waits for its stopped event and the callbacks
+        // still in flight, then lets go of the python callback
+        bool close(uint64_t deadlineNs) override {
+            bool stopping;
+            uint64_t stopsBefore;
+            {
+                lock_guard<mutex> lock(mtx);
+                closed = true;
+                paused = false;
+                resumePending = false;
+                cancelExpiry();
+                try {
+                    stopLocked();
+                } catch (const winrt::hresult_error &) {
+                }
+                stopping = state == WatcherState::Stopping;
+                stopsBefore = stops;
+            }
+            bool drained = true;
+            {
+                py::gil_scoped_release release;
+                // winrt won't raise Stopped while we block in one of its events
+                if (stopping && !gate.inside()) {
+                    unique_lock<mutex> lock(mtx);
+                    drained = stopped.wait_until(lock, lifecycle::time_point(deadlineNs), [&] { return stops != stopsBefore; });
+                }
+                drained = gate.close(deadlineNs) && drained;
+            }
+            addedToken.revoke();
+            updatedToken.revoke();
+            removedToken.revoke();
+            completedToken.revoke();
+            stoppedToken.revoke();
+            if (drained)
+                callback = EventCallback();
+            return drained;
+        }
+
+        ~BLEWatcher() {
+            cancelExpiry();
+            metrics::gauge_add(metrics::ActiveWatchers, -1);
+            metrics::gauge_add(metrics::TrackedDevices, -tracked);
+            addedToken.revoke();
+            updatedToken.revoke();
+            removedToken.revoke();
+            completedToken.revoke();
+            stoppedToken.revoke();
+            auto status = watcher.Status();
+            if (status == DeviceWatcherStatus::Started || status == DeviceWatcherStatus::EnumerationCompleted)
+                watcher.Stop();
+            // the last reference may be dropped on a winrt thread; during
+            // finalization taking the GIL can hang, so the references are leaked
+            if (Py_IsInitialized() && !py::detail::interpreter_finalizing()) {
+                gil_lock gil(gilprof::WatcherTeardown);
+                callback = EventCallback();
+                for (auto &name : eventNames)
+                    name = py::object();
+            } else {
+                callback.leak();
+                for (auto &name : eventNames)
+                    name.release();
+            }
+        }
+
+    private:
+        EventCallback callback;
+        lifecycle::Gate gate;
+        py::object eventNames[(int) WatchEvent::Count];
+
+        mutex mtx;
+        WatcherState state = WatcherState::Created;
+        bool closed = false;
+        bool paused = false;
+        bool resyncing = false;
+        bool resumePending = false;
+        // Stopped events handled, close() waits on it
+        uint64_t stops = 0;
+        condition_variable stopped;
+        unordered_map<winrt::hstring, DeviceInformation> cache;
+        unordered_set<winrt::hstring> seen;
+        shared_ptr<DeviceTable> devices = make_shared<DeviceTable>();
+        unordered_map<uint64_t, winrt::hstring> addressIds;
+        unordered_set<winrt::hstring> lostIds;
+        ThreadPoolTimer expiryTimer{ nullptr };
+        int64_t tracked = 0;
+
+        DeviceWatcher::Added_revoker addedToken;
+        DeviceWatcher::Updated_revoker updatedToken;
+        DeviceWatcher::Removed_revoker removedToken;
+        DeviceWatcher::EnumerationCompleted_revoker completedToken;
+        DeviceWatcher::Stopped_revoker stoppedToken;
+
+        static bool deviceAddress(const DeviceInformation &devinfo, uint64_t &address) {
+            auto value = devinfo.Properties().TryLookup(AEP_DEVICE_ADDRESS);
+            auto str = value ? value.try_as<IPropertyValue>() : nullptr;
+            if (!str || str.Type() != PropertyType::String)
+                return false;
+            return parse_address(w2a(str.GetString()).c_str(), address);
+        }
+
+        // the signal strength comes from the event's own properties: an update
+        // without one isn't a new reading, and the value cached on devinfo
+        // would feed a stale one back into the filter
+        void record(const DeviceInformation &devinfo, const Collections::IMapView<winrt::hstring, IInspectable> &reported) {
+            uint64_t address;
+            if (!deviceAddress(devinfo, address))
+                return;
+            int16_t rssi = DeviceTable::noReading;
+            auto value = reported.TryLookup(AEP_SIGNAL_STRENGTH);
+            if (auto strength = value ? value.try_as<IPropertyValue>() : nullptr)
+                rssi = (int16_t) strength.GetInt32();
+            std::string name = w2a(devinfo.Name());
+            devices->upsert(address, rssi, steady_now(), &name);
+            addressIds[address] = devinfo.Id();
+            syncTracked();
+        }
+
+        void forget(const DeviceInformation &devinfo) {
+            uint64_t address;
+            if (deviceAddress(devinfo, address)) {
+                devices->remove(address);
+                addressIds.erase(address);
+                syncTracked();
+            }
+        }
+
+        void syncTracked() {
+            int64_t now = (int64_t) devices->size();
+            metrics::gauge_add(metrics::TrackedDevices, now - tracked);
+            tracked = now;
+        }
+
+        void startLocked() {
+            watcher.Start();
+            state = WatcherState::Started;
+            if (!expiryTimer && (devices->getTtl() || devices->getCapacity())) {
+                // sweep four times per ttl, or once a second to flush cap evictions
+                uint64_t period = devices->getTtl() ? devices->getTtl() / 4 : 1000000000ull;
+                if (period < 100000000ull)
+                    period = 100000000ull;
+                weak_ptr<BLEWatcher> weak = shared_from_this();
+                expiryTimer = ThreadPoolTimer::CreatePeriodicTimer([weak](const ThreadPoolTimer &) {
+                    if (auto self = weak.lock()) self->expireDevices();
+                }, std::chrono::duration_cast<TimeSpan>(std::chrono::nanoseconds(period)));
+            }
+        }
+
+        void cancelExpiry() {
+            if (expiryTimer) {
+                expiryTimer.Cancel();
+                expiryTimer = nullptr;
+            }
+        }
+
+        // only from python-facing calls, which hold the GIL
+        void startChecked() {
+            try {
+                startLocked();
+            } catch (const winrt::hresult_error &e) {
+                resyncing = false;
+                Py_RETURN_ERROR(PyExc_RuntimeError, w2a(e.message()).c_str());
+            }
+        }
+
+        void stopLocked() {
+            if (state != WatcherState::Started && state != WatcherState::Enumerated)
+                return;
+            state = WatcherState::Stopping;
+            cancelExpiry();
+            watcher.Stop();
+        }
+};
+
+
+shared_ptr<BLEWatcher> pywinble_watch(ModuleState &state, vector<string> props, py::object callback, double ttl,
+        size_t maxDevices, const RssiFilter &filter) {
+    winrt_init();
+    auto ble = lifecycle::track(state.resources, make_shared<BLEWatcher>(props, callback, ttl, maxDevices, filter));
+    ble->bind();
+    return ble;
+}
+
+bool backend_shutdown(ModuleState &state, uint64_t) {
+    BackendState &backend = *state.backend;
+    Advertisement::BluetoothLEAdvertisementPublisher publisher = nullptr;
+    py::object callback;
+    {
+        std::lock_guard<std::mutex> lock(backend.mtx);
+        std::swap(publisher, backend.publisher);
+        std::swap(callback, backend.onStatus);
+    }
+    if (publisher)
+        stop_publisher(publisher);
+    return true;
+}
+
+void bind_backend(py::module &m, const std::shared_ptr<ModuleState> &state) {
+    state->backend = make_shared<BackendState>();
+    def_backend<BLEProvider, BLEWatcher>(m, state, pywinble_advertise, pywinble_provide, pywinble_info, pywinble_prewarm,
+        pywinble_watch);
+    m.attr("backend") = "winrt";
+}